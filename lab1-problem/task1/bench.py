@@ -0,0 +1,205 @@
+#!/usr/bin/python3
+
+# Host-performance benchmark: how fast does the simulator itself run?
+#
+# By default this covers inputs/long, inputs/random and the generated kernels
+# in kernels/ (see 'make kernels'). Each program is simulated to completion
+# several times with its output discarded; we report simulated instructions
+# and cycles per host second (mean and standard deviation over the repeats).
+# Every run is appended to a history file tagged with the current git commit,
+# and compared against the most recent run from a different commit so
+# regressions show up.
+
+import sys, os, subprocess, re, glob, argparse, json, time, statistics, platform, tempfile
+
+sim = "./sim"
+history = "bench-results.jsonl"
+
+bold="\033[1m"
+green="\033[0;32m"
+red="\033[0;31m"
+normal="\033[0m"
+
+
+def default_inputs():
+    return sorted(glob.glob("inputs/long/*.x")) + \
+           sorted(glob.glob("inputs/random/*.x")) + \
+           sorted(glob.glob("kernels/*.s"))
+
+
+def positive_int(text):
+    n = int(text)
+    if n < 1:
+        raise argparse.ArgumentTypeError("must be at least 1")
+    return n
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("inputs", nargs="*", default=default_inputs())
+    parser.add_argument("-n", "--repeat", type=positive_int, default=5,
+                        help="timed runs per program (default 5)")
+    parser.add_argument("--sim", default=sim, help="simulator binary")
+    parser.add_argument("--history", default=history,
+                        help="results file (JSON lines), '' to disable")
+    parser.add_argument("--threshold", type=float, default=5.0,
+                        help="flag changes larger than this many percent")
+    args = parser.parse_args()
+
+    commit = git_commit()
+    print(bold + "Benchmarking " + args.sim + normal + " at " + commit +
+          ", " + str(args.repeat) + " runs each")
+    print("  " + "Program".ljust(28) + "Insts".rjust(12) + "Cycles".rjust(12) +
+          "Host s".rjust(10) + "MIPS".rjust(16) + "Mcycles/s".rjust(16))
+
+    results = {}
+    for i in args.inputs:
+        if not os.path.exists(i):
+            print(red + "ERROR -- input file not found: " + i + normal)
+            continue
+        r = bench(args.sim, i, args.repeat)
+        if r is None:
+            print(red + "ERROR -- no statistics from " + i + normal)
+            continue
+        results[i] = r
+        print("  " + i.ljust(28) + str(r["insts"]).rjust(12) + str(r["cycles"]).rjust(12) +
+              ("%.3f" % r["seconds"]).rjust(10) +
+              fmt_rate(r["ips"], r["ips_stdev"]).rjust(16) +
+              fmt_rate(r["cps"], r["cps_stdev"]).rjust(16))
+
+    if not results:
+        return 1
+
+    total_insts = sum(r["insts"] for r in results.values())
+    total_secs = sum(r["seconds"] for r in results.values())
+    print("  " + "Total".ljust(28) + str(total_insts).rjust(12) + "".rjust(12) +
+          ("%.3f" % total_secs).rjust(10) + ("%.2f" % (total_insts / total_secs / 1e6)).rjust(16))
+
+    record = {
+        "commit": commit,
+        "time": time.strftime("%Y-%m-%dT%H:%M:%S"),
+        "host": platform.node(),
+        "repeat": args.repeat,
+        "results": results,
+    }
+
+    if args.history:
+        previous = last_record(args.history, commit)
+        if previous:
+            compare(previous, record, args.threshold)
+        with open(args.history, "a") as f:
+            f.write(json.dumps(record) + "\n")
+
+    return 0
+
+
+def bench(simbin, i, repeat):
+    # Programs that need register setup (.cmd) go through the command
+    # prompt; everything else runs in batch mode with statistics as JSON.
+    cmds = None
+    cmdfile = os.path.splitext(i)[0] + ".cmd"
+    if os.path.exists(cmdfile):
+        cmds = open(cmdfile).read().encode('utf-8') + b"\ngo\nrdump\nquit\n"
+
+    fd, json_file = tempfile.mkstemp(suffix=".json")
+    os.close(fd)
+
+    times = []
+    stats = None
+    for _ in range(repeat):
+        start = time.perf_counter()
+        if cmds is None:
+            subprocess.run([simbin, "--go", "--quiet", "--stats-json", json_file, i],
+                           stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+            times.append(time.perf_counter() - start)
+            stats = parse_json(json_file)
+        else:
+            proc = subprocess.run([simbin, i], input=cmds, stdout=subprocess.PIPE,
+                                  stderr=subprocess.DEVNULL)
+            times.append(time.perf_counter() - start)
+            stats = parse_stats(proc.stdout.decode('utf-8', 'replace'))
+
+    os.unlink(json_file)
+    if stats is None:
+        return None
+
+    insts, cycles = stats
+    ips = [insts / t for t in times]
+    cps = [cycles / t for t in times]
+    return {
+        "insts": insts,
+        "cycles": cycles,
+        "seconds": statistics.mean(times),
+        "ips": statistics.mean(ips),
+        "ips_stdev": statistics.stdev(ips) if repeat > 1 else 0.0,
+        "cps": statistics.mean(cps),
+        "cps_stdev": statistics.stdev(cps) if repeat > 1 else 0.0,
+    }
+
+
+def parse_json(path):
+    try:
+        with open(path) as f:
+            stats = json.load(f)
+        return stats["retired"], stats["cycles"]
+    except (OSError, ValueError, KeyError):
+        return None
+
+
+def parse_stats(out):
+    insts = re.search(r"^RetiredInstr: (\d+)", out, re.M)
+    cycles = re.search(r"^Cycles: (\d+)", out, re.M)
+    if not insts or not cycles:
+        return None
+    return int(insts.group(1)), int(cycles.group(1))
+
+
+def fmt_rate(mean, stdev):
+    return "%.2f+-%.2f" % (mean / 1e6, stdev / 1e6)
+
+
+def git_commit():
+    try:
+        rev = subprocess.run(["git", "rev-parse", "--short", "HEAD"], stdout=subprocess.PIPE,
+                             stderr=subprocess.DEVNULL).stdout.decode().strip()
+        dirty = subprocess.run(["git", "status", "--porcelain", "--untracked-files=no", "src"],
+                               stdout=subprocess.PIPE, stderr=subprocess.DEVNULL).stdout.strip()
+        return (rev or "unknown") + ("-dirty" if dirty else "")
+    except OSError:
+        return "unknown"
+
+
+def last_record(path, commit):
+    if not os.path.exists(path):
+        return None
+    previous = None
+    for line in open(path):
+        try:
+            r = json.loads(line)
+        except ValueError:
+            continue
+        if r.get("commit") != commit:
+            previous = r
+    return previous
+
+
+def compare(previous, current, threshold):
+    print()
+    print(bold + "Compared to " + previous["commit"] + " (" + previous["time"] + ")" + normal)
+    for i, r in current["results"].items():
+        p = previous["results"].get(i)
+        if p is None:
+            continue
+        delta = 100.0 * (r["ips"] - p["ips"]) / p["ips"]
+        note = ""
+        if p["insts"] != r["insts"] or p["cycles"] != r["cycles"]:
+            note = " (simulated insts/cycles changed)"
+        color = normal
+        if delta < -threshold:
+            color = red
+        elif delta > threshold:
+            color = green
+        print("  " + i.ljust(28) + color + ("%+.1f%%" % delta).rjust(10) + normal + note)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,269 @@
+#!/usr/bin/python3
+
+# Scalable benchmark kernel generator.
+#
+# Unlike inputs/random/randomgen.py (a fixed 1000-instruction straight-line
+# program), this emits loop kernels whose dynamic length, memory footprint
+# and control behaviour are set on the command line, so programs running
+# 10^8+ instructions can stress the caches and the branch handling. Each
+# kernel is written as assembly (<name>.s), which the simulator assembles
+# itself when it loads it (src/asm.h), so no external toolchain is needed.
+#
+# Loop body (per inner iteration), in shuffled order:
+#   --loads/--stores  strided accesses into a --ws byte window at 0x10000000
+#   --chase           dependent loads walking a pseudo-random pointer ring
+#                     of --chase-ws bytes placed after the stream window
+#   --alu             random register/immediate ALU operations
+#   --muldiv          mult/div followed by mflo/mfhi (--div-frac are divides)
+#   --branches        data-dependent forward branches on an xorshift value;
+#                     taken unless the low --branch-bits bits are zero, so
+#                     1 bit is a coin flip and larger values get predictable
+
+import sys, os, random, argparse
+
+MEM_DATA_START = 0x10000000
+MEM_DATA_SIZE = 0x00100000
+MEM_TEXT_START = 0x00400000
+
+# Register roles
+BASE, MASK, OFF, CHASE, RNG, INNER, OUTER, ACC = "$s0", "$s1", "$s2", "$s3", "$s4", "$s5", "$s6", "$s7"
+STRIDE, ADDR, FLAG = "$a1", "$t8", "$t9"
+TEMPS = ["$t0", "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7"]
+
+class Program:
+    def __init__(self):
+        self.insts = []   # (mnemonic, operands) or ("label", name)
+
+    def label(self, name):
+        self.insts.append(("label", name))
+
+    def emit(self, mnem, *ops):
+        self.insts.append((mnem, ops))
+
+    def li(self, reg, value):
+        value &= 0xFFFFFFFF
+        if value <= 0xFFFF:
+            self.emit("ori", reg, "$zero", value)
+        else:
+            self.emit("lui", reg, value >> 16)
+            if value & 0xFFFF:
+                self.emit("ori", reg, reg, value & 0xFFFF)
+
+    def lines(self):
+        """The assembly, one statement or label per line."""
+        return [ops + ":" if mnem == "label" else "    " + fmt(mnem, ops)
+                for mnem, ops in self.insts]
+
+    def words(self):
+        return len([i for i in self.insts if i[0] != "label"])
+
+
+def fmt(mnem, ops):
+    if mnem in ("lw", "lbu", "sw"):
+        return "%s %s, %d(%s)" % (mnem, ops[0], ops[1], ops[2])
+    args = []
+    for o in ops:
+        args.append(o if isinstance(o, str) else ("0x%x" % o if o > 9 else str(o)))
+    return (mnem + " " + ", ".join(args)).strip()
+
+
+def log2(x):
+    return x.bit_length() - 1
+
+
+def is_pow2(x):
+    return x > 0 and x & (x - 1) == 0
+
+
+def body_blocks(args, rng):
+    """Build the loop body as a shuffled list of small instruction blocks.
+    Returns the blocks and the number of instructions they retire per
+    iteration (a taken branch skips one)."""
+    blocks = []
+    temps = lambda: rng.choice(TEMPS)
+
+    for _ in range(args.loads):
+        blocks.append([("addu", (OFF, OFF, STRIDE)), ("and", (OFF, OFF, MASK)),
+                       ("addu", (ADDR, BASE, OFF)), ("lw", (temps(), 0, ADDR))])
+    for _ in range(args.stores):
+        blocks.append([("addu", (OFF, OFF, STRIDE)), ("and", (OFF, OFF, MASK)),
+                       ("addu", (ADDR, BASE, OFF)), ("sw", (temps(), 0, ADDR))])
+    for _ in range(args.chase):
+        blocks.append([("lw", (CHASE, 0, CHASE))])
+    for _ in range(args.alu):
+        blocks.append([alu_op(rng)])
+    for _ in range(args.muldiv):
+        if rng.random() < args.div_frac:
+            blocks.append([(rng.choice(["div", "divu"]), (temps(), temps())),
+                           ("mfhi", (temps(),))])
+        else:
+            blocks.append([(rng.choice(["mult", "multu"]), (temps(), temps())),
+                           ("mflo", (temps(),))])
+
+    rng.shuffle(blocks)
+
+    # Branches go between the other blocks; each steps the xorshift
+    # generator and conditionally skips one ALU op.
+    for i in range(args.branches):
+        blocks.insert(rng.randrange(len(blocks) + 1), [("branch", i)])
+
+    per_iter = sum(len(b) for b in blocks if b[0][0] != "branch")
+    taken = 1.0 - 2.0 ** -args.branch_bits if args.branch_bits > 0 else 0.0
+    per_iter += args.branches * (9 + (1.0 - taken))
+    return blocks, per_iter
+
+
+def alu_op(rng):
+    rd, rs, rt = rng.choice(TEMPS), rng.choice(TEMPS), rng.choice(TEMPS)
+    kind = rng.choice(["addu", "subu", "and", "or", "xor", "nor", "slt", "sltu",
+                       "sll", "srl", "addiu", "andi", "ori", "xori"])
+    if kind in ("sll", "srl"):
+        return (kind, (rd, rt, rng.randrange(32)))
+    if kind == "addiu":
+        return (kind, (rd, rs, rng.randrange(-32768, 32768)))
+    if kind in ("andi", "ori", "xori"):
+        return (kind, (rd, rs, rng.randrange(0x10000)))
+    return (kind, (rd, rs, rt))
+
+
+def generate(args):
+    rng = random.Random(args.seed)
+    p = Program()
+
+    # Setup
+    p.label("main")
+    p.li(BASE, MEM_DATA_START)
+    p.li(MASK, (args.ws - 1) & ~3)
+    p.li(STRIDE, args.stride)
+    p.li(OFF, 0)
+    p.li(RNG, rng.randrange(1, 1 << 32))
+    p.li(ACC, 0)
+    for i, t in enumerate(TEMPS):
+        p.li(t, rng.randrange(1 << 32) if i else 0x12345678)
+    setup = p.words()
+
+    if args.chase:
+        # Ring of --chase-ws/--chase-spacing nodes after the stream window,
+        # visited in the order of the full-period LCG idx' = 5*idx + 1 mod n
+        n = args.chase_ws // args.chase_spacing
+        shift = log2(args.chase_spacing)
+        p.li(CHASE, MEM_DATA_START + args.ws)
+        p.li("$t0", 0)
+        p.li("$t1", n)
+        p.li("$t2", n - 1)
+        p.label("chase_init")
+        p.emit("sll", "$t3", "$t0", 2)
+        p.emit("addu", "$t3", "$t3", "$t0")
+        p.emit("addiu", "$t3", "$t3", 1)
+        p.emit("and", "$t3", "$t3", "$t2")
+        p.emit("sll", "$t4", "$t0", shift)
+        p.emit("addu", "$t4", "$t4", CHASE)
+        p.emit("sll", "$t5", "$t3", shift)
+        p.emit("addu", "$t5", "$t5", CHASE)
+        p.emit("sw", "$t5", 0, "$t4")
+        p.emit("addu", "$t0", "$t3", "$zero")
+        p.emit("addiu", "$t1", "$t1", -1)
+        p.emit("bgtz", "$t1", "chase_init")
+        setup += 7 + 12 * n
+
+    blocks, per_iter = body_blocks(args, rng)
+    per_outer = args.trip * (per_iter + 2) + 4
+    outer = max(1, int(round((args.insts - setup) / per_outer)))
+
+    p.li(OUTER, outer)
+    p.label("outer")
+    p.li(INNER, args.trip)
+    p.label("inner")
+    for b in blocks:
+        if b[0][0] == "branch":
+            skip = "skip%d" % b[0][1]
+            p.emit("sll", FLAG, RNG, 13)
+            p.emit("xor", RNG, RNG, FLAG)
+            p.emit("srl", FLAG, RNG, 17)
+            p.emit("xor", RNG, RNG, FLAG)
+            p.emit("sll", FLAG, RNG, 5)
+            p.emit("xor", RNG, RNG, FLAG)
+            p.emit("andi", FLAG, RNG, (1 << args.branch_bits) - 1)
+            p.emit("bne", FLAG, "$zero", skip)
+            p.emit("addu", ACC, ACC, RNG)
+            p.label(skip)
+            p.emit("addiu", ACC, ACC, 1)
+        else:
+            for mnem, ops in b:
+                p.emit(mnem, *ops)
+    p.emit("addiu", INNER, INNER, -1)
+    p.emit("bgtz", INNER, "inner")
+    p.emit("addiu", OUTER, OUTER, -1)
+    p.emit("bgtz", OUTER, "outer")
+
+    # Fold the temporaries into $v1 so every result is live, then halt
+    for t in TEMPS:
+        p.emit("xor", "$v1", "$v1", t)
+    p.emit("addiu", "$v0", "$zero", 10)
+    p.emit("syscall")
+
+    expected = setup + outer * per_outer + len(TEMPS) + 2
+    return p, outer, expected
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate a loop benchmark kernel (.s)")
+    parser.add_argument("name", help="output path without extension, e.g. kernels/stream")
+    parser.add_argument("--insts", type=float, default=1e8,
+                        help="target dynamic instruction count (default 1e8)")
+    parser.add_argument("--trip", type=int, default=1000, help="inner loop trip count")
+    parser.add_argument("--ws", type=int, default=64 * 1024,
+                        help="stream working set in bytes (power of two)")
+    parser.add_argument("--stride", type=int, default=4, help="stream stride in bytes")
+    parser.add_argument("--loads", type=int, default=2, help="stream loads per iteration")
+    parser.add_argument("--stores", type=int, default=1, help="stream stores per iteration")
+    parser.add_argument("--chase", type=int, default=0, help="pointer-chasing loads per iteration")
+    parser.add_argument("--chase-ws", type=int, default=64 * 1024,
+                        help="pointer ring size in bytes (power of two)")
+    parser.add_argument("--chase-spacing", type=int, default=32,
+                        help="bytes between ring nodes (power of two, >= 4)")
+    parser.add_argument("--alu", type=int, default=8, help="ALU ops per iteration")
+    parser.add_argument("--muldiv", type=int, default=0, help="mult/div ops per iteration")
+    parser.add_argument("--div-frac", type=float, default=0.25,
+                        help="fraction of --muldiv ops that divide")
+    parser.add_argument("--branches", type=int, default=1, help="data-dependent branches per iteration")
+    parser.add_argument("--branch-bits", type=int, default=1,
+                        help="branch falls through when this many low random bits are zero "
+                             "(0 = never taken, 1 = 50%%, larger = mostly taken)")
+    parser.add_argument("--mem-size", type=int, default=MEM_DATA_SIZE,
+                        help="data segment size of the simulator in bytes (its --data-size)")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    for name in ("ws", "chase_ws", "chase_spacing"):
+        if not is_pow2(getattr(args, name)):
+            parser.error("--%s must be a power of two" % name.replace("_", "-"))
+    if args.stride % 4:
+        parser.error("--stride must be a multiple of 4")
+    if args.chase_spacing < 4 or args.chase_spacing > args.chase_ws:
+        parser.error("--chase-spacing must be between 4 and --chase-ws")
+    if not 0 <= args.branch_bits <= 16:
+        parser.error("--branch-bits must be in 0..16")
+    footprint = args.ws + (args.chase_ws if args.chase else 0)
+    if footprint > args.mem_size:
+        parser.error("working set (%d bytes) exceeds the data segment (%d bytes)"
+                     % (footprint, args.mem_size))
+
+    p, outer, expected = generate(args)
+
+    d = os.path.dirname(args.name)
+    if d:
+        os.makedirs(d, exist_ok=True)
+    with open(args.name + ".s", "w") as f:
+        f.write("# generated by kernelgen.py " + " ".join(sys.argv[1:]) + "\n")
+        f.write("# ~%d dynamic instructions (%d outer x %d inner iterations)\n"
+                % (expected, outer, args.trip))
+        f.write(".text\n")
+        f.write("\n".join(p.lines()) + "\n")
+
+    print("%s.s: %d words, ~%d dynamic instructions, %d bytes of data"
+          % (args.name, p.words(), expected, footprint))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,137 @@
+#!/usr/bin/python3
+
+# Convert a pipeline trace written by 'sim --trace' (src/ptrace.h) into a
+# Kanata log, the format of the Konata pipeline viewer
+# (https://github.com/shioyadan/Konata). Each instruction becomes one row
+# with its stages; flushed instructions are marked as such, and the hover
+# text lists the caches and TLBs it missed in.
+#
+#   ./sim --go --trace run.trace.gz --trace-cycles 100000:200000 prog.x
+#   python3 ptrace2kanata.py run.trace.gz -o run.kanata
+
+import sys, struct, gzip, heapq, argparse
+
+MAGIC = 0x43525450
+VERSION = 1
+HEADER = struct.Struct("<IIII")
+RECORD = struct.Struct("<Q5QQIIBB6x")
+
+FLUSHED, ICACHE_MISS, DCACHE_MISS, ITLB_MISS, DTLB_MISS, OOO = 0x01, 0x02, 0x04, 0x08, 0x10, 0x20
+MISSES = [(ICACHE_MISS, "icache miss"), (ITLB_MISS, "itlb miss"),
+          (DCACHE_MISS, "dcache miss"), (DTLB_MISS, "dtlb miss")]
+
+# Stage names by core model, in PROF_FETCH..PROF_WB order
+STAGES = ["F", "D", "X", "M", "W"]
+OOO_STAGES = ["F", "Ds", "Is", "Cm", "Rt"]
+
+
+def open_trace(path):
+    f = open(path, "rb")
+    if f.read(2) == b"\x1f\x8b":
+        f.close()
+        return gzip.open(path, "rb")
+    f.seek(0)
+    return f
+
+
+def read_records(path, window):
+    """The trace's records in fetch (seq) order, as a stream. A record is
+    written when its instruction retires or is flushed, which is at most
+    a reorder buffer plus a pipeline's worth of instructions out of fetch
+    order, so a heap of 'window' records puts them back in order."""
+    with open_trace(path) as f:
+        magic, version, size, _ = HEADER.unpack(f.read(HEADER.size))
+        if magic != MAGIC or version != VERSION or size != RECORD.size:
+            sys.exit("error: %s is not a version %d pipeline trace" % (path, VERSION))
+        heap, last = [], -1
+        while True:
+            chunk = f.read(RECORD.size * 4096)
+            if not chunk:
+                break
+            for r in RECORD.iter_unpack(chunk):
+                if len(heap) < window:
+                    heapq.heappush(heap, r)
+                    continue
+                r = heapq.heappushpop(heap, r)
+                if r[0] < last:
+                    sys.exit("error: records more than %d apart in fetch order; "
+                             "raise --window" % window)
+                last = r[0]
+                yield r
+        while heap:
+            yield heapq.heappop(heap)
+
+
+def events(uid, retire_id, r):
+    """The Kanata commands of one instruction as (cycle, text) in order."""
+    seq, cycles, end, pc, inst, stages, flags = r[0], r[1:6], r[6], r[7], r[8], r[9], r[10]
+    names = OOO_STAGES if flags & OOO else STAGES
+    present = [(cycles[s], names[s]) for s in range(5) if stages & (1 << s)]
+    present.sort(key=lambda p: p[0])
+
+    misses = ", ".join(name for bit, name in MISSES if flags & bit)
+    out = [(present[0][0], "I\t%d\t%d\t0" % (uid, seq)),
+           (present[0][0], "L\t%d\t0\t%08x: %08x" % (uid, pc, inst))]
+    if misses or flags & FLUSHED:
+        hover = misses + ("; " if misses and flags & FLUSHED else "") + ("flushed" if flags & FLUSHED else "")
+        out.append((present[0][0], "L\t%d\t1\t%s" % (uid, hover)))
+
+    for k, (start, name) in enumerate(present):
+        stop = present[k + 1][0] if k + 1 < len(present) else max(end, start + 1)
+        out.append((start, "S\t%d\t0\t%s" % (uid, name)))
+        out.append((max(stop, start), "E\t%d\t0\t%s" % (uid, name)))
+    last = max(c for c, _ in out)
+    out.append((last, "R\t%d\t%d\t%d" % (uid, retire_id, 1 if flags & FLUSHED else 0)))
+    return out
+
+
+def convert(records, out):
+    """Write the log; returns the number of instructions."""
+    out.write("Kanata\t0004\n")
+
+    # Instructions come in fetch order, so every event before the next
+    # instruction's fetch can be written: a heap holds the rest
+    heap, order, now, retired, uid = [], 0, None, 0, -1
+    for uid, r in enumerate(records):
+        fetch = min(r[1 + s] for s in range(5) if r[9] & (1 << s))
+        while heap and heap[0][0] < fetch:
+            now = emit(heapq.heappop(heap), now, out)
+        for cycle, text in events(uid, retired, r):
+            heapq.heappush(heap, (cycle, order, text))
+            order += 1
+        if not r[10] & FLUSHED:
+            retired += 1
+    while heap:
+        now = emit(heapq.heappop(heap), now, out)
+    return uid + 1
+
+
+def emit(event, now, out):
+    cycle, _, text = event
+    if now is None:
+        out.write("C=\t%d\n" % cycle)
+    elif cycle > now:
+        out.write("C\t%d\n" % (cycle - now))
+    out.write(text + "\n")
+    return cycle if now is None or cycle > now else now
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Convert a sim --trace file to a Kanata log")
+    parser.add_argument("trace")
+    parser.add_argument("-o", "--output", help="Kanata log (default: standard output)")
+    parser.add_argument("--window", type=int, default=65536,
+                        help="records held to restore fetch order; at least the "
+                             "ROB size plus the pipeline depth (default 65536)")
+    args = parser.parse_args()
+
+    records = read_records(args.trace, max(args.window, 1))
+    out = open(args.output, "w") if args.output else sys.stdout
+    n = convert(records, out)
+    if args.output:
+        out.close()
+        print("%d instructions -> %s" % (n, args.output), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -5,7 +5,7 @@
 # Juan Gomez Luna, 2017
 # Minesh Patel, 2020
 
-import sys, os, subprocess, re, glob, argparse
+import sys, os, subprocess, re, glob, argparse, json
 
 ref = "./basesim"
 sim = "./sim"
@@ -21,13 +21,29 @@ def main():
 
     parser = argparse.ArgumentParser()
     parser.add_argument("inputs", nargs="*", default=all_inputs)
+    parser.add_argument("--check", action="store_true",
+                        help="check the simulator against its own functional model (sim --check) instead of basesim")
+    parser.add_argument("--server", action="store_true",
+                        help="run every input in one resident simulator (sim --server)")
+    parser.add_argument("--lockstep", action="store_true",
+                        help="run the inputs without a .cmd file together in one sim --lockstep (registers only, no timing)")
     parser = parser.parse_args()
 
+    global server, lockstep_out
+    if parser.server:
+        server = Server(["--check"] if parser.check else [])
+    if parser.lockstep and not parser.check:
+        lockstep_out = lockstep([i for i in parser.inputs if os.path.exists(i) and not os.path.exists(cmdfile(i))])
+
     for i in parser.inputs:
         if not os.path.exists(i):
             print(red + "ERROR -- input file (*.x) not found: " + i + normal)
             continue
 
+        if parser.check:
+            cosim(i)
+            continue
+
         print(bold + "Testing: " + normal + i)
         ref_out, sim_out = run(i)
 
@@ -59,19 +75,102 @@ def main():
         print()
 
 
-def run(i):
-    global ref, sim
+# A resident simulator (src/server.h): one request per line, each answered
+# by "ok <n>" or "error <n>" and n bytes of payload
+class Server:
+    def __init__(self, args):
+        self.proc = subprocess.Popen([sim, "--server"] + args, executable=sim, stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+
+    def request(self, line):
+        self.proc.stdin.write(line.encode('utf-8') + b"\n")
+        self.proc.stdin.flush()
+        status, n = self.proc.stdout.readline().decode('utf-8').split()
+        payload = self.proc.stdout.read(int(n)).decode('utf-8')
+        if status != "ok":
+            raise RuntimeError(line + ": " + payload.strip())
+        return payload
+
+    # Same as feeding commands(i) to a fresh sim: the rdump text and the JSON
+    def run(self, i):
+        self.request("load " + i)
+        for l in commands(i).decode('utf-8').split("\n"):
+            if l.split() and l.split()[0] not in ("go", "rdump", "quit"):
+                self.request(l)
+        state = json.loads(self.request("go"))
+        return self.request("rdump"), state
+
+server = None
+
+
+# sim --lockstep runs every program it is given side by side and prints
+# each one's registers after a "Program:" line; returns them by input
+def lockstep(inputs):
+    out = {}
+    if not inputs:
+        return out
+    s = subprocess.run([sim, "--lockstep"] + inputs, executable=sim, stdout=subprocess.PIPE).stdout
+    for block in s.decode('utf-8').split("Program: ")[1:]:
+        name, rest = block.split("\n", 1)
+        # the registers only: there is no timing to compare
+        out[name] = "\n".join(l for l in filter_stats(rest).split("\n") if not l.startswith("Retired"))
+    return out
+
+lockstep_out = {}
+
+
+def cmdfile(i):
+    return os.path.splitext(i)[0] + ".cmd"
 
-    refproc = subprocess.Popen([ref, i], executable=ref, stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
-    simproc = subprocess.Popen([sim, i], executable=sim, stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
 
+def commands(i):
     cmds = b""
-    cmdfile = os.path.splitext(i)[0] + ".cmd"
-    if os.path.exists(cmdfile):
-      cmds += open(cmdfile).read().encode('utf-8')
+    if os.path.exists(cmdfile(i)):
+      cmds += open(cmdfile(i)).read().encode('utf-8')
 
-    cmds += b"\ngo\nrdump\nquit\n"
+    return cmds + b"\ngo\nrdump\nquit\n"
+
+
+def cosim(i):
+    print(bold + "Checking: " + normal + i)
+    if server:
+        # the mismatch report goes to the server's stderr
+        out, state = server.run(i)
+        if state["check_failed"]:
+            print(red + "  Co-simulation mismatch" + normal)
+        else:
+            print("  " + green + "CO-SIMULATION OK" + normal)
+        print()
+        return
+
+    simproc = subprocess.Popen([sim, "--check", i], executable=sim, stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    (s, s_err) = simproc.communicate(input=commands(i))
+
+    # the report is the mismatch line and the indented lines after it
+    report = []
+    for l in s.decode('utf-8').split("\n"):
+        if l.startswith("Co-simulation mismatch") or (report and (l.startswith(" ") or l.startswith("Pipeline"))):
+            report.append(l)
+        elif report:
+            break
+    if report:
+        print(red + "\n".join(report) + normal)
+    else:
+        print("  " + green + "CO-SIMULATION OK" + normal)
+    print()
+
+
+def run(i):
+    global ref, sim
+
+    refproc = subprocess.Popen([ref, i], executable=ref, stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    cmds = commands(i)
     (r, r_err) = refproc.communicate(input=cmds)
+    if i in lockstep_out:
+        return filter_stats(r.decode('utf-8')), lockstep_out[i]
+    if server:
+        return filter_stats(r.decode('utf-8')), filter_stats(server.run(i)[0])
+
+    simproc = subprocess.Popen([sim, i], executable=sim, stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
     (s, s_err) = simproc.communicate(input=cmds)
 
     return filter_stats(r.decode('utf-8')), filter_stats(s.decode('utf-8'))
@@ -0,0 +1,760 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include "asm.h"
+#include "shell.h"
+#include "mips.h"
+
+#define MAX_LINE 1024
+#define MAX_OPERANDS 4
+#define MAX_LABEL 64
+#define REG_AT 1
+
+#define SEG_TEXT 0
+#define SEG_DATA 1
+
+typedef struct{
+    char name[MAX_LABEL];
+    uint32_t addr;
+} asm_label;
+
+// Two passes over the file: the first sizes everything and places the
+// labels, the second (final) encodes with the labels known
+typedef struct{
+    const char* file;
+    int line;
+    bool final;
+    bool failed;
+
+    int seg;
+    uint8_t* buf[2];            // final pass only, 'cap' bytes
+    uint32_t size[2], cap[2];
+    uint32_t* text_line;        // final pass only, a line per text word
+
+    asm_label* labels;
+    int nlabels, label_cap;
+} assembler;
+
+static const uint32_t seg_start[2] = { MEM_TEXT_START, MEM_DATA_START };
+
+static void error(assembler* a, const char* fmt, ...){
+    if(a->failed)
+        return;
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "%s:%d: ", a->file, a->line);
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    a->failed = true;
+}
+
+static uint32_t here(assembler* a){
+    return seg_start[a->seg] + a->size[a->seg];
+}
+
+static void emit8(assembler* a, uint8_t v){
+    if(a->final && a->size[a->seg] < a->cap[a->seg])
+        a->buf[a->seg][a->size[a->seg]] = v;
+    a->size[a->seg]++;
+}
+
+static void emit32(assembler* a, uint32_t v){
+    uint32_t at = a->size[a->seg];
+    if(a->final && a->seg == SEG_TEXT && at % 4 == 0 && at < a->cap[SEG_TEXT])
+        a->text_line[at / 4] = a->line;
+    for(int i=0; i<4; i++)
+        emit8(a, v >> (8 * i));
+}
+
+static void align(assembler* a, uint32_t bytes){
+    while(a->size[a->seg] % bytes)
+        emit8(a, 0);
+}
+
+/* Labels and operands */
+
+static asm_label* find_label(assembler* a, const char* name, size_t len){
+    for(int i=0; i<a->nlabels; i++)
+        if(strlen(a->labels[i].name) == len && strncmp(a->labels[i].name, name, len) == 0)
+            return &a->labels[i];
+    return NULL;
+}
+
+static void define_label(assembler* a, const char* name, size_t len){
+    if(a->final)
+        return;
+    if(len >= MAX_LABEL){
+        error(a, "label too long");
+        return;
+    }
+    if(find_label(a, name, len)){
+        error(a, "label %.*s defined twice", (int)len, name);
+        return;
+    }
+    if(a->nlabels == a->label_cap){
+        a->label_cap = a->label_cap ? 2 * a->label_cap : 64;
+        a->labels = realloc(a->labels, a->label_cap * sizeof(asm_label));
+    }
+    asm_label* l = &a->labels[a->nlabels++];
+    memcpy(l->name, name, len);
+    l->name[len] = '\0';
+    l->addr = here(a);
+}
+
+static bool ident_char(char c){
+    return isalnum((unsigned char)c) || c == '_' || c == '.' || c == '$';
+}
+
+// A number, a character, or a label plus or minus a number. 'symbolic'
+// (if given) is set when a label is involved: its value is only known in
+// the final pass.
+static uint32_t value(assembler* a, const char* s, bool* symbolic){
+    char* end;
+    if(symbolic)
+        *symbolic = false;
+
+    if(s[0] == '\'' && s[1] && s[2] == '\'' && s[3] == '\0')
+        return (uint8_t)s[1];
+    if(isdigit((unsigned char)s[0]) || ((s[0] == '-' || s[0] == '+') && isdigit((unsigned char)s[1]))){
+        // SPIM reads a decimal number as a 32-bit long, saturating; the
+        // random tests' .x files depend on it
+        int digits = s[0] == '-' || s[0] == '+';
+        bool hex = s[digits] == '0' && (s[digits+1] == 'x' || s[digits+1] == 'X');
+        long long v = strtoll(s, &end, 0);
+        if(*end != '\0' || (hex && (v < INT32_MIN || v > UINT32_MAX)))
+            error(a, "bad number %s", s);
+        if(!hex)
+            v = v > INT32_MAX ? INT32_MAX : v < INT32_MIN ? INT32_MIN : v;
+        return (uint32_t)v;
+    }
+
+    size_t len = 0;
+    while(ident_char(s[len]))
+        len++;
+    if(len == 0 || s[0] == '$'){
+        error(a, "expected a value, not %s", s);
+        return 0;
+    }
+    uint32_t offset = 0;
+    if(s[len] == '+' || s[len] == '-'){
+        long long v = strtoll(s + len + 1, &end, 0);
+        if(*end != '\0' || end == s + len + 1)
+            error(a, "bad offset in %s", s);
+        offset = s[len] == '+' ? (uint32_t)v : -(uint32_t)v;
+    }
+    else if(s[len] != '\0')
+        error(a, "bad operand %s", s);
+
+    if(symbolic)
+        *symbolic = true;
+    asm_label* l = find_label(a, s, len);
+    if(l == NULL){
+        if(a->final)
+            error(a, "undefined label %.*s", (int)len, s);
+        return 0;
+    }
+    return l->addr + offset;
+}
+
+static const char* reg_names[32] = {
+    "zero", "at", "v0", "v1", "a0", "a1", "a2", "a3",
+    "t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+    "s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+    "t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra"
+};
+
+static uint32_t reg(assembler* a, const char* s){
+    if(s[0] == '$'){
+        char* end;
+        if(isdigit((unsigned char)s[1])){
+            long r = strtol(s + 1, &end, 10);
+            if(*end == '\0' && r < 32)
+                return r;
+        }
+        for(int r=0; r<32; r++)
+            if(strcmp(s + 1, reg_names[r]) == 0)
+                return r;
+        if(strcmp(s + 1, "s8") == 0)
+            return 30;
+    }
+    error(a, "bad register %s", s);
+    return 0;
+}
+
+// "offset(base)", "(base)" or "offset", where the offset may be a label;
+// 'symbolic' is set as value() sets it
+static void mem_operand(assembler* a, char* s, uint32_t* offset, uint32_t* base, bool* symbolic){
+    char* paren = strchr(s, '(');
+    *offset = *base = 0;
+    *symbolic = false;
+    if(paren){
+        char* close = strchr(paren, ')');
+        if(close == NULL || close[1] != '\0'){
+            error(a, "bad address %s", s);
+            return;
+        }
+        *close = '\0';
+        *base = reg(a, paren + 1);
+        *paren = '\0';
+    }
+    if(s[0])
+        *offset = value(a, s, symbolic);
+}
+
+/* Encoding */
+
+static uint32_t rtype(uint32_t rs, uint32_t rt, uint32_t rd, uint32_t shamt, uint32_t funct){
+    return (OP_SPECIAL << 26) | (rs << 21) | (rt << 16) | (rd << 11) | (shamt << 6) | funct;
+}
+
+static uint32_t itype(uint32_t op, uint32_t rs, uint32_t rt, uint32_t imm){
+    return (op << 26) | (rs << 21) | (rt << 16) | (imm & 0xFFFF);
+}
+
+// The offset field of a branch at the current address to 'target'
+static uint32_t branch_offset(assembler* a, const char* target){
+    int32_t delta = value(a, target, NULL) - (here(a) + 4);
+    if(a->final && (delta % 4 != 0 || delta < -(32768 * 4) || delta > 32767 * 4))
+        error(a, "branch target %s out of range", target);
+    return (uint32_t)(delta >> 2) & 0xFFFF;
+}
+
+static void emit_li(assembler* a, uint32_t rd, const char* operand){
+    bool symbolic;
+    uint32_t v = value(a, operand, &symbolic);
+    if(!symbolic && v <= 0xFFFF)
+        emit32(a, itype(OP_ORI, 0, rd, v));
+    else if(!symbolic && (int32_t)v < 0 && (int32_t)v >= -32768)
+        emit32(a, itype(OP_ADDIU, 0, rd, v));
+    else{
+        emit32(a, itype(OP_LUI, 0, REG_AT, v >> 16));
+        emit32(a, itype(OP_ORI, REG_AT, rd, v));
+    }
+}
+
+// The register-register form of an immediate op, for operands that
+// don't fit its field
+static uint32_t register_form(uint32_t opcode){
+    switch(opcode){
+    case OP_ADDI:  return SUBOP_ADD;
+    case OP_ADDIU: return SUBOP_ADDU;
+    case OP_SLTI:  return SUBOP_SLT;
+    case OP_SLTIU: return SUBOP_SLTU;
+    case OP_ANDI:  return SUBOP_AND;
+    case OP_ORI:   return SUBOP_OR;
+    }
+    return SUBOP_XOR;
+}
+
+// An immediate op. Like SPIM, an operand that doesn't fit the field (the
+// logical ops zero-extend it, the others sign-extend) or is a label is
+// built in $at first, then used with the register form; added or or'ed
+// to $zero, it goes straight to rt.
+static void emit_imm(assembler* a, uint32_t opcode, uint32_t rs, uint32_t rt, const char* operand){
+    bool symbolic;
+    uint32_t v = value(a, operand, &symbolic);
+    bool logical = opcode == OP_ANDI || opcode == OP_ORI || opcode == OP_XORI;
+    bool fits = logical ? v <= 0xFFFF : (int32_t)v >= -32768 && (int32_t)v <= 32767;
+
+    if(!symbolic && fits)
+        emit32(a, itype(opcode, rs, rt, v));
+    else if(rs == 0 && (opcode == OP_ADDI || opcode == OP_ADDIU || opcode == OP_ORI)){
+        emit32(a, itype(OP_LUI, 0, REG_AT, v >> 16));
+        emit32(a, itype(OP_ORI, REG_AT, rt, v));
+    }
+    else{
+        emit32(a, itype(OP_LUI, 0, REG_AT, v >> 16));
+        emit32(a, itype(OP_ORI, REG_AT, REG_AT, v));
+        emit32(a, rtype(rs, REG_AT, rt, 0, register_form(opcode)));
+    }
+}
+
+// The immediate op for a register-register op whose last operand is a
+// value, as in "add $t0, $t1, 4"; 0 if there is none, and the value
+// goes through $at
+static uint32_t immediate_form(uint32_t funct){
+    switch(funct){
+    case SUBOP_ADD:  return OP_ADDI;
+    case SUBOP_ADDU: return OP_ADDIU;
+    case SUBOP_SLT:  return OP_SLTI;
+    case SUBOP_SLTU: return OP_SLTIU;
+    case SUBOP_AND:  return OP_ANDI;
+    case SUBOP_OR:   return OP_ORI;
+    case SUBOP_XOR:  return OP_XORI;
+    }
+    return 0;
+}
+
+// Operand shapes
+#define F_R3      0     // rd, rs, rt
+#define F_SHIFT   1     // rd, rt, shamt
+#define F_SHIFTV  2     // rd, rt, rs
+#define F_MULDIV  3     // rs, rt
+#define F_MFHILO  4     // rd
+#define F_MTHILO  5     // rs
+#define F_JR      6     // rs
+#define F_JALR    7     // [rd,] rs
+#define F_SYSCALL 8
+#define F_IMM     9     // rt, [rs,] imm
+#define F_LUI     10    // rt, imm
+#define F_MEM     11    // rt, offset(base)
+#define F_BR2     12    // rs, rt, label
+#define F_BR1     13    // rs, label
+#define F_BRSPEC  14    // rs, label (code is the rt field)
+#define F_JUMP    15    // label
+
+typedef struct{
+    const char* name;
+    int format;
+    uint32_t code;      // funct, opcode or BROP_*
+} asm_op;
+
+static const asm_op ops[] = {
+    { "sll", F_SHIFT, SUBOP_SLL }, { "srl", F_SHIFT, SUBOP_SRL }, { "sra", F_SHIFT, SUBOP_SRA },
+    { "sllv", F_SHIFTV, SUBOP_SLLV }, { "srlv", F_SHIFTV, SUBOP_SRLV }, { "srav", F_SHIFTV, SUBOP_SRAV },
+    { "jr", F_JR, SUBOP_JR }, { "jalr", F_JALR, SUBOP_JALR }, { "syscall", F_SYSCALL, SUBOP_SYSCALL },
+    { "mfhi", F_MFHILO, SUBOP_MFHI }, { "mflo", F_MFHILO, SUBOP_MFLO },
+    { "mthi", F_MTHILO, SUBOP_MTHI }, { "mtlo", F_MTHILO, SUBOP_MTLO },
+    { "mult", F_MULDIV, SUBOP_MULT }, { "multu", F_MULDIV, SUBOP_MULTU },
+    { "div", F_MULDIV, SUBOP_DIV }, { "divu", F_MULDIV, SUBOP_DIVU },
+    { "add", F_R3, SUBOP_ADD }, { "addu", F_R3, SUBOP_ADDU }, { "sub", F_R3, SUBOP_SUB },
+    { "subu", F_R3, SUBOP_SUBU }, { "and", F_R3, SUBOP_AND }, { "or", F_R3, SUBOP_OR },
+    { "xor", F_R3, SUBOP_XOR }, { "nor", F_R3, SUBOP_NOR }, { "slt", F_R3, SUBOP_SLT },
+    { "sltu", F_R3, SUBOP_SLTU },
+    { "bltz", F_BRSPEC, BROP_BLTZ }, { "bgez", F_BRSPEC, BROP_BGEZ },
+    { "bltzal", F_BRSPEC, BROP_BLTZAL }, { "bgezal", F_BRSPEC, BROP_BGEZAL },
+    { "j", F_JUMP, OP_J }, { "jal", F_JUMP, OP_JAL },
+    { "beq", F_BR2, OP_BEQ }, { "bne", F_BR2, OP_BNE },
+    { "blez", F_BR1, OP_BLEZ }, { "bgtz", F_BR1, OP_BGTZ },
+    { "addi", F_IMM, OP_ADDI }, { "addiu", F_IMM, OP_ADDIU }, { "slti", F_IMM, OP_SLTI },
+    { "sltiu", F_IMM, OP_SLTIU }, { "andi", F_IMM, OP_ANDI }, { "ori", F_IMM, OP_ORI },
+    { "xori", F_IMM, OP_XORI }, { "lui", F_LUI, OP_LUI },
+    { "lb", F_MEM, OP_LB }, { "lh", F_MEM, OP_LH }, { "lw", F_MEM, OP_LW },
+    { "lbu", F_MEM, OP_LBU }, { "lhu", F_MEM, OP_LHU },
+    { "sb", F_MEM, OP_SB }, { "sh", F_MEM, OP_SH }, { "sw", F_MEM, OP_SW },
+    { NULL, 0, 0 }
+};
+
+static bool operands(assembler* a, int n, int want){
+    if(n != want)
+        error(a, "expected %d operands, not %d", want, n);
+    return n == want;
+}
+
+static void instruction(assembler* a, const asm_op* op, char** o, int n){
+    uint32_t off, base;
+
+    switch(op->format){
+    case F_R3:
+        if(!operands(a, n, 3))
+            break;
+        if(o[2][0] != '$' && immediate_form(op->code))
+            emit_imm(a, immediate_form(op->code), reg(a, o[1]), reg(a, o[0]), o[2]);
+        else if(o[2][0] != '$'){
+            uint32_t v = value(a, o[2], NULL);
+            emit32(a, itype(OP_LUI, 0, REG_AT, v >> 16));
+            emit32(a, itype(OP_ORI, REG_AT, REG_AT, v));
+            emit32(a, rtype(reg(a, o[1]), REG_AT, reg(a, o[0]), 0, op->code));
+        }
+        else
+            emit32(a, rtype(reg(a, o[1]), reg(a, o[2]), reg(a, o[0]), 0, op->code));
+        break;
+    case F_SHIFT:
+        if(operands(a, n, 3)){
+            uint32_t shamt = value(a, o[2], NULL);
+            if(shamt > 31)
+                error(a, "shift amount %s out of range", o[2]);
+            emit32(a, rtype(0, reg(a, o[1]), reg(a, o[0]), shamt & 31, op->code));
+        }
+        break;
+    case F_SHIFTV:
+        if(operands(a, n, 3))
+            emit32(a, rtype(reg(a, o[2]), reg(a, o[1]), reg(a, o[0]), 0, op->code));
+        break;
+    case F_MULDIV:
+        if(operands(a, n, 2))
+            emit32(a, rtype(reg(a, o[0]), reg(a, o[1]), 0, 0, op->code));
+        break;
+    case F_MFHILO:
+        if(operands(a, n, 1))
+            emit32(a, rtype(0, 0, reg(a, o[0]), 0, op->code));
+        break;
+    case F_MTHILO:
+    case F_JR:
+        if(operands(a, n, 1))
+            emit32(a, rtype(reg(a, o[0]), 0, 0, 0, op->code));
+        break;
+    case F_JALR:
+        if(n == 1)
+            emit32(a, rtype(reg(a, o[0]), 0, 31, 0, op->code));
+        else if(operands(a, n, 2))
+            emit32(a, rtype(reg(a, o[1]), 0, reg(a, o[0]), 0, op->code));
+        break;
+    case F_SYSCALL:
+        if(operands(a, n, 0))
+            emit32(a, rtype(0, 0, 0, 0, op->code));
+        break;
+    case F_IMM:
+        // "addiu $t0, 4" adds to $t0 itself
+        if(n == 2)
+            emit_imm(a, op->code, reg(a, o[0]), reg(a, o[0]), o[1]);
+        else if(operands(a, n, 3))
+            emit_imm(a, op->code, reg(a, o[1]), reg(a, o[0]), o[2]);
+        break;
+    case F_LUI:
+        // SPIM loads a value that is no upper half as li would
+        if(operands(a, n, 2)){
+            bool symbolic;
+            uint32_t v = value(a, o[1], &symbolic);
+            if(!symbolic && v <= 0xFFFF)
+                emit32(a, itype(op->code, 0, reg(a, o[0]), v));
+            else{
+                emit32(a, itype(OP_LUI, 0, REG_AT, v >> 16));
+                emit32(a, itype(OP_ORI, REG_AT, reg(a, o[0]), v));
+            }
+        }
+        break;
+    case F_MEM:
+        // A label or a wide offset goes through $at: its upper half,
+        // rounded for the sign-extended lower half, plus the base
+        if(operands(a, n, 2)){
+            bool symbolic;
+            mem_operand(a, o[1], &off, &base, &symbolic);
+            if(symbolic || (int32_t)off < -32768 || (int32_t)off > 32767){
+                emit32(a, itype(OP_LUI, 0, REG_AT, (off + 0x8000) >> 16));
+                if(base)
+                    emit32(a, rtype(REG_AT, base, REG_AT, 0, SUBOP_ADDU));
+                base = REG_AT;
+            }
+            emit32(a, itype(op->code, base, reg(a, o[0]), off));
+        }
+        break;
+    case F_BR2:
+        if(operands(a, n, 3))
+            emit32(a, itype(op->code, reg(a, o[0]), reg(a, o[1]), branch_offset(a, o[2])));
+        break;
+    case F_BR1:
+        if(operands(a, n, 2))
+            emit32(a, itype(op->code, reg(a, o[0]), 0, branch_offset(a, o[1])));
+        break;
+    case F_BRSPEC:
+        if(operands(a, n, 2))
+            emit32(a, itype(OP_BRSPEC, reg(a, o[0]), op->code, branch_offset(a, o[1])));
+        break;
+    case F_JUMP:
+        if(operands(a, n, 1)){
+            uint32_t target = value(a, o[0], NULL);
+            if(a->final && ((target ^ (here(a) + 4)) & 0xF0000000 || target & 3))
+                error(a, "jump target %s out of range", o[0]);
+            emit32(a, (op->code << 26) | ((target >> 2) & 0x3FFFFFF));
+        }
+        break;
+    }
+}
+
+// Pseudo-instructions; false if 'name' is not one
+static bool pseudo(assembler* a, const char* name, char** o, int n){
+    if(strcmp(name, "nop") == 0){
+        // or $zero, $zero, $zero, as the .x files have it
+        if(operands(a, n, 0))
+            emit32(a, rtype(0, 0, 0, 0, SUBOP_OR));
+    }
+    else if(strcmp(name, "li") == 0){
+        if(operands(a, n, 2))
+            emit_li(a, reg(a, o[0]), o[1]);
+    }
+    else if(strcmp(name, "la") == 0){
+        if(operands(a, n, 2)){
+            uint32_t v = value(a, o[1], NULL);
+            emit32(a, itype(OP_LUI, 0, REG_AT, v >> 16));
+            emit32(a, itype(OP_ORI, REG_AT, reg(a, o[0]), v));
+        }
+    }
+    else if(strcmp(name, "move") == 0){
+        if(operands(a, n, 2))
+            emit32(a, rtype(reg(a, o[1]), 0, reg(a, o[0]), 0, SUBOP_ADDU));
+    }
+    else if(strcmp(name, "not") == 0){
+        if(operands(a, n, 2))
+            emit32(a, rtype(reg(a, o[1]), 0, reg(a, o[0]), 0, SUBOP_NOR));
+    }
+    else if(strcmp(name, "neg") == 0 || strcmp(name, "negu") == 0){
+        if(operands(a, n, 2))
+            emit32(a, rtype(0, reg(a, o[1]), reg(a, o[0]), 0, name[3] ? SUBOP_SUBU : SUBOP_SUB));
+    }
+    else if(strcmp(name, "b") == 0){
+        if(operands(a, n, 1))
+            emit32(a, itype(OP_BEQ, 0, 0, branch_offset(a, o[0])));
+    }
+    else if(strcmp(name, "beqz") == 0 || strcmp(name, "bnez") == 0){
+        if(operands(a, n, 2))
+            emit32(a, itype(name[1] == 'e' ? OP_BEQ : OP_BNE, reg(a, o[0]), 0, branch_offset(a, o[1])));
+    }
+    else if(strcmp(name, "blt") == 0 || strcmp(name, "bge") == 0 ||
+            strcmp(name, "bgt") == 0 || strcmp(name, "ble") == 0){
+        // slt $at, then branch on it: blt/bge compare rs < rt, bgt/ble rt < rs
+        if(operands(a, n, 3)){
+            bool swap = name[1] == 'g' ? name[2] == 't' : name[2] == 'e';
+            uint32_t rs = reg(a, o[0]), rt = reg(a, o[1]);
+            emit32(a, rtype(swap ? rt : rs, swap ? rs : rt, REG_AT, 0, SUBOP_SLT));
+            bool taken_if_less = strcmp(name, "blt") == 0 || strcmp(name, "bgt") == 0;
+            emit32(a, itype(taken_if_less ? OP_BNE : OP_BEQ, REG_AT, 0, branch_offset(a, o[2])));
+        }
+    }
+    else
+        return false;
+    return true;
+}
+
+// Bytes of an .ascii/.asciiz string, with C escapes
+static void string(assembler* a, const char* s, bool terminate){
+    size_t len = strlen(s);
+    if(len < 2 || s[0] != '"' || s[len-1] != '"'){
+        error(a, "expected a quoted string");
+        return;
+    }
+    for(size_t i=1; i<len-1; i++){
+        char c = s[i];
+        if(c == '\\' && i + 1 < len - 1){
+            c = s[++i];
+            c = c == 'n' ? '\n' : c == 't' ? '\t' : c == '0' ? '\0' : c;
+        }
+        emit8(a, c);
+    }
+    if(terminate)
+        emit8(a, 0);
+}
+
+static void directive(assembler* a, const char* name, char** o, int n){
+    if(strcmp(name, ".text") == 0)
+        a->seg = SEG_TEXT;
+    else if(strcmp(name, ".data") == 0)
+        a->seg = SEG_DATA;
+    else if(strcmp(name, ".globl") == 0 || strcmp(name, ".global") == 0)
+        ;
+    else if(strcmp(name, ".word") == 0){
+        align(a, 4);
+        for(int i=0; i<n; i++)
+            emit32(a, value(a, o[i], NULL));
+    }
+    else if(strcmp(name, ".half") == 0){
+        align(a, 2);
+        for(int i=0; i<n; i++){
+            uint32_t v = value(a, o[i], NULL);
+            emit8(a, v);
+            emit8(a, v >> 8);
+        }
+    }
+    else if(strcmp(name, ".byte") == 0){
+        for(int i=0; i<n; i++)
+            emit8(a, value(a, o[i], NULL));
+    }
+    else if(strcmp(name, ".space") == 0){
+        if(operands(a, n, 1)){
+            uint32_t bytes = value(a, o[0], NULL);
+            if(bytes > (1 << 28))
+                error(a, ".space %s too large", o[0]);
+            else
+                for(uint32_t i=0; i<bytes; i++)
+                    emit8(a, 0);
+        }
+    }
+    else if(strcmp(name, ".align") == 0){
+        if(operands(a, n, 1)){
+            uint32_t bits = value(a, o[0], NULL);
+            if(bits > 12)
+                error(a, ".align %s too large", o[0]);
+            else
+                align(a, 1u << bits);
+        }
+    }
+    else if(strcmp(name, ".ascii") == 0 || strcmp(name, ".asciiz") == 0){
+        if(operands(a, n, 1))
+            string(a, o[0], name[6] == 'z');
+    }
+    else
+        error(a, "unknown directive %s", name);
+
+    if(a->seg == SEG_TEXT && a->size[SEG_TEXT] % 4)
+        error(a, "text is not word aligned");
+}
+
+// Split at the commas outside quotes, trimming the pieces; returns the count
+static int split_operands(assembler* a, char* s, char** o){
+    int n = 0;
+    while(isspace((unsigned char)*s))
+        s++;
+    if(*s == '\0')
+        return 0;
+
+    while(true){
+        if(n == MAX_OPERANDS){
+            error(a, "too many operands");
+            return n;
+        }
+        o[n++] = s;
+        bool quoted = false;
+        while(*s && (quoted || *s != ',')){
+            if(*s == '"' && (s == o[n-1] || s[-1] != '\\'))
+                quoted = !quoted;
+            s++;
+        }
+        char* end = s;
+        while(end > o[n-1] && isspace((unsigned char)end[-1]))
+            end--;
+        bool more = *s == ',';
+        *end = '\0';
+        if(!more)
+            return n;
+        s++;
+        while(isspace((unsigned char)*s))
+            s++;
+    }
+}
+
+static void assemble_line(assembler* a, char* s){
+    // Cut the comment, minding strings
+    bool quoted = false;
+    for(char* p = s; *p; p++){
+        if(*p == '"' && (p == s || p[-1] != '\\'))
+            quoted = !quoted;
+        if(*p == '#' && !quoted){
+            *p = '\0';
+            break;
+        }
+    }
+
+    // Labels, then a mnemonic or directive
+    while(true){
+        while(isspace((unsigned char)*s))
+            s++;
+        if(*s == '\0')
+            return;
+        char* name = s;
+        while(ident_char(*s))
+            s++;
+        size_t len = s - name;
+        if(len == 0){
+            error(a, "syntax error");
+            return;
+        }
+        char* after = s;
+        while(isspace((unsigned char)*after))
+            after++;
+        if(*after == ':'){
+            define_label(a, name, len);
+            s = after + 1;
+            continue;
+        }
+
+        char mnemonic[16];
+        if(len >= sizeof(mnemonic)){
+            error(a, "unknown instruction %.*s", (int)len, name);
+            return;
+        }
+        for(size_t i=0; i<len; i++)
+            mnemonic[i] = tolower((unsigned char)name[i]);
+        mnemonic[len] = '\0';
+
+        char* o[MAX_OPERANDS];
+        int n = split_operands(a, s, o);
+        if(a->failed)
+            return;
+        if(mnemonic[0] == '.'){
+            directive(a, mnemonic, o, n);
+            return;
+        }
+        if(a->seg != SEG_TEXT){
+            error(a, "instruction in the data segment");
+            return;
+        }
+        if(pseudo(a, mnemonic, o, n))
+            return;
+        for(const asm_op* op = ops; op->name; op++)
+            if(strcmp(op->name, mnemonic) == 0){
+                instruction(a, op, o, n);
+                return;
+            }
+        error(a, "unknown instruction %s", mnemonic);
+        return;
+    }
+}
+
+static bool assemble_pass(assembler* a, FILE* f){
+    char line[MAX_LINE];
+
+    rewind(f);
+    a->line = 0;
+    a->seg = SEG_TEXT;
+    a->size[SEG_TEXT] = a->size[SEG_DATA] = 0;
+    while(!a->failed && fgets(line, sizeof(line), f)){
+        a->line++;
+        if(strchr(line, '\n') == NULL && !feof(f)){
+            error(a, "line too long");
+            break;
+        }
+        assemble_line(a, line);
+    }
+    return !a->failed;
+}
+
+bool asm_is_source(const char* filename){
+    size_t len = strlen(filename);
+    return len > 2 && strcmp(filename + len - 2, ".s") == 0;
+}
+
+bool asm_file(const char* filename, asm_image* image){
+    assembler a;
+    memset(&a, 0, sizeof(a));
+    memset(image, 0, sizeof(*image));
+    a.file = filename;
+
+    FILE* f = fopen(filename, "r");
+    if(f == NULL){
+        fprintf(stderr, "%s: can't open\n", filename);
+        return false;
+    }
+
+    bool ok = assemble_pass(&a, f);
+    if(ok){
+        uint32_t text_size = a.size[SEG_TEXT], data_size = a.size[SEG_DATA];
+        a.buf[SEG_TEXT] = calloc(text_size + 1, 1);
+        a.buf[SEG_DATA] = calloc(data_size + 1, 1);
+        a.cap[SEG_TEXT] = text_size;
+        a.cap[SEG_DATA] = data_size;
+        a.text_line = calloc(text_size / 4 + 1, sizeof(uint32_t));
+        a.final = true;
+        ok = assemble_pass(&a, f);
+        if(ok && (a.size[SEG_TEXT] != text_size || a.size[SEG_DATA] != data_size)){
+            error(&a, "sizes changed between passes");
+            ok = false;
+        }
+    }
+    fclose(f);
+    free(a.labels);
+
+    if(!ok){
+        free(a.buf[SEG_TEXT]);
+        free(a.buf[SEG_DATA]);
+        free(a.text_line);
+        return false;
+    }
+    image->text = a.buf[SEG_TEXT];
+    image->text_line = a.text_line;
+    image->text_size = a.size[SEG_TEXT];
+    image->data = a.buf[SEG_DATA];
+    image->data_size = a.size[SEG_DATA];
+    return true;
+}
+
+void asm_free(asm_image* image){
+    free(image->text);
+    free(image->text_line);
+    free(image->data);
+    memset(image, 0, sizeof(*image));
+}
@@ -0,0 +1,42 @@
+/************************************/
+/*                                  */
+/*      MIPS Assembler              */
+/*                                  */
+/************************************/
+
+#ifndef _ASM_H
+#define _ASM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// load_program() assembles a program file whose name ends in ".s"
+// instead of reading it as hex words. The assembler takes every
+// instruction in mips.h, in the usual operand order, plus:
+//   pseudo-instructions  li, la, move, nop, not, neg, negu, b, beqz, bnez,
+//                        blt, bgt, ble, bge (these four through $at)
+//   directives           .text, .data, .word, .half, .byte, .space,
+//                        .align, .ascii, .asciiz; .globl is ignored
+//   labels               "name:", as operands also "name+n"
+// Like the simulator, it knows no delay slots. Immediates too wide for
+// their field, labels as immediates or load/store addresses, and values
+// in place of the last register of add, or, slt and the like are built
+// in $at the way SPIM does it, so the .s files in inputs/ assemble to
+// the words of their .x files.
+
+typedef struct{
+    uint8_t* text;          // at MEM_TEXT_START
+    uint32_t* text_line;    // the source line of each text word, from 1
+    uint32_t text_size;     // bytes, a multiple of 4
+    uint8_t* data;          // at MEM_DATA_START
+    uint32_t data_size;
+} asm_image;
+
+bool asm_is_source(const char* filename);
+
+// False, after a "file:line: message" on stderr, if the file can't be
+// read or assembled
+bool asm_file(const char* filename, asm_image*);
+void asm_free(asm_image*);
+
+#endif
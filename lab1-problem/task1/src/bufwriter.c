@@ -0,0 +1,136 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#include "bufwriter.h"
+
+#define BUFWRITER_SIZE (1 << 20)    // bytes per buffer
+
+struct bufwriter{
+    FILE* file;
+#ifdef HAVE_ZLIB
+    gzFile gz;
+#endif
+
+    // The caller fills buffer[fill]; the thread writes buffer[!fill]
+    // while 'pending'
+    uint8_t* buffer[2];
+    size_t used[2];
+    int fill;
+    bool pending, closing;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+};
+
+static void write_out(bufwriter* w, const void* data, size_t n){
+#ifdef HAVE_ZLIB
+    if(w->gz){
+        gzwrite(w->gz, data, n);
+        return;
+    }
+#endif
+    fwrite(data, 1, n, w->file);
+}
+
+static void* writer_thread(void* arg){
+    bufwriter* w = arg;
+
+    pthread_mutex_lock(&w->lock);
+    for(;;){
+        while(!w->pending && !w->closing)
+            pthread_cond_wait(&w->changed, &w->lock);
+        if(!w->pending)
+            break;
+
+        int b = !w->fill;
+        pthread_mutex_unlock(&w->lock);
+        write_out(w, w->buffer[b], w->used[b]);
+        pthread_mutex_lock(&w->lock);
+
+        w->used[b] = 0;
+        w->pending = false;
+        pthread_cond_broadcast(&w->changed);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+// Hand the filled buffer to the thread and continue in the other one
+static void flip(bufwriter* w){
+    pthread_mutex_lock(&w->lock);
+    while(w->pending)
+        pthread_cond_wait(&w->changed, &w->lock);
+    w->fill = !w->fill;
+    w->pending = true;
+    pthread_cond_broadcast(&w->changed);
+    pthread_mutex_unlock(&w->lock);
+}
+
+bufwriter* bufwriter_open(const char* filename){
+    size_t len = strlen(filename);
+    bufwriter* w = calloc(1, sizeof(bufwriter));
+
+    if(len > 3 && strcmp(filename + len - 3, ".gz") == 0){
+#ifdef HAVE_ZLIB
+        w->gz = gzopen(filename, "wb1");
+        if(w->gz == NULL){
+            free(w);
+            return NULL;
+        }
+#else
+        fprintf(stderr, "Error: built without zlib, can't compress %s\n", filename);
+        free(w);
+        return NULL;
+#endif
+    }
+    else if((w->file = fopen(filename, "wb")) == NULL){
+        free(w);
+        return NULL;
+    }
+
+    for(int b=0; b<2; b++)
+        w->buffer[b] = malloc(BUFWRITER_SIZE);
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->changed, NULL);
+    pthread_create(&w->thread, NULL, writer_thread, w);
+    return w;
+}
+
+void bufwriter_write(bufwriter* w, const void* data, size_t n){
+    while(n > 0){
+        size_t room = BUFWRITER_SIZE - w->used[w->fill];
+        size_t k = n < room ? n : room;
+        memcpy(w->buffer[w->fill] + w->used[w->fill], data, k);
+        w->used[w->fill] += k;
+        data = (const uint8_t*)data + k;
+        n -= k;
+        if(w->used[w->fill] == BUFWRITER_SIZE)
+            flip(w);
+    }
+}
+
+void bufwriter_close(bufwriter* w){
+    if(w->used[w->fill])
+        flip(w);
+    pthread_mutex_lock(&w->lock);
+    w->closing = true;
+    pthread_cond_broadcast(&w->changed);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+
+#ifdef HAVE_ZLIB
+    if(w->gz)
+        gzclose(w->gz);
+#endif
+    if(w->file)
+        fclose(w->file);
+    free(w->buffer[0]);
+    free(w->buffer[1]);
+    free(w);
+}
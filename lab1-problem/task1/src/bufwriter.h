@@ -0,0 +1,24 @@
+/************************************/
+/*                                  */
+/*      Background File Writer      */
+/*                                  */
+/************************************/
+
+#ifndef _BUFWRITER_H
+#define _BUFWRITER_H
+
+#include <stddef.h>
+
+// Writes go into one of two buffers; a full buffer is handed to a writer
+// thread that writes it out (gzip-compressed if the file name ends in
+// .gz and the simulator was built with zlib) while the caller fills the
+// other. The caller only waits if it fills a buffer before the thread
+// has finished the previous one.
+
+typedef struct bufwriter bufwriter;
+
+bufwriter* bufwriter_open(const char* filename);    // NULL if it can't be written
+void bufwriter_write(bufwriter*, const void* data, size_t n);
+void bufwriter_close(bufwriter*);                   // flush, join the thread
+
+#endif
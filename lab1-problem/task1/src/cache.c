@@ -3,9 +3,28 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
 #include "cache.h"
 #include "shell.h"
 #include "pipe.h"
+#include "core.h"
+#include "dram.h"
+#include "hostprof.h"
+
+// Per-access trace of the cache internals. Compiled out by default: it
+// prints several lines per fetch and dominates simulator run time.
+// #define CACHE_DEBUG
+
+#ifdef CACHE_DEBUG
+#define cache_trace(...) printf(__VA_ARGS__)
+#else
+#define cache_trace(...) do{}while(0)
+#endif
+
+cache_config dcache_cfg = { false, true, 0 };
+
+static int find_way(cache_unit*, uint32_t, uint32_t*);
 
 // Allocate and initialize cache
 cache_unit* init_cache(uint32_t block_size, uint32_t ways, uint32_t sets){
@@ -18,6 +37,7 @@ cache_unit* init_cache(uint32_t block_size, uint32_t ways, uint32_t sets){
             // Each way
             cache->set[i].way[j].valid = false;
             cache->set[i].way[j].dirty = false;
+            cache->set[i].way[j].shared = false;
             cache->set[i].way[j].tag = 0;
             cache->set[i].way[j].lru = 0;
 
@@ -34,10 +54,66 @@ cache_unit* init_cache(uint32_t block_size, uint32_t ways, uint32_t sets){
     cache->mdata.block_size = block_size;
     cache->mdata.ways = ways;
     cache->mdata.sets = sets;
+    cache->penalty = 0;
+
+    cache->write_through = false;
+    cache->write_allocate = true;
+    cache->victim = NULL;
+    cache->stat_victim_hits = cache->stat_writebacks = 0;
+    cache->stat_write_through = cache->stat_write_around = 0;
+    cache->profile = setprof_enabled ? setprof_new(sets, ways, block_size) : NULL;
+
+    cache->coherent = false;
+    cache->stat_upgrades = cache->stat_snoop_inv = cache->stat_snoop_wb = 0;
 
     return cache;
 }
 
+void cache_configure(cache_unit* cache, const cache_config* cfg){
+    cache->write_through = cfg->write_through;
+    cache->write_allocate = cfg->write_allocate;
+    if(cfg->victim_entries == 0)
+        return;
+
+    victim_cache* vc = malloc(sizeof(victim_cache));
+    vc->entries = cfg->victim_entries;
+    vc->entry = calloc(vc->entries, sizeof(cache_block));
+    vc->last_use = calloc(vc->entries, sizeof(uint64_t));
+    vc->clock = 0;
+    for(int i=0; i<vc->entries; i++)
+        vc->entry[i].value = calloc(cache->mdata.block_size, sizeof(uint32_t));
+    cache->victim = vc;
+}
+
+void free_cache(cache_unit* cache){
+    for(int i=0; i<cache->mdata.sets; i++){
+        for(int j=0; j<cache->mdata.ways; j++)
+            free(cache->set[i].way[j].value);
+        free(cache->set[i].way);
+    }
+    free(cache->set);
+    if(cache->victim){
+        for(int i=0; i<cache->victim->entries; i++)
+            free(cache->victim->entry[i].value);
+        free(cache->victim->entry);
+        free(cache->victim->last_use);
+        free(cache->victim);
+    }
+    setprof_free(cache->profile);
+    free(cache);
+}
+
+// Write the block at 'addr' back to memory
+static void write_back(cache_unit* cache, uint32_t addr, uint32_t* value){
+    if(dram)
+        dram_write(addr, stat_cycles);
+    for(int m=addr; m<(addr + cache->mdata.block_size); ){
+        mem_write_32(m, value[m-addr]);
+        m+=4;
+    }
+    cache->stat_writebacks++;
+}
+
 void evict_block(cache_unit* cache, uint32_t idx, int w){
     cache_block* block = &cache->set[idx].way[w];
 
@@ -47,31 +123,120 @@ void evict_block(cache_unit* cache, uint32_t idx, int w){
     
     // Evicted block populated back into memory
     else{
-        printf("Eviction procedure started!\n");
+        HOSTPROF_ENTER(HP_EVICT);
+        cache_trace("Eviction procedure started!\n");
         uint32_t sets = cache->mdata.sets;
         uint32_t block_size = cache->mdata.block_size;
         uint32_t tag = block->tag;
         block->dirty = false;
         uint32_t evict_addr = (tag<<(clog2(sets)+clog2(block_size))) | (idx<<clog2(block_size));
 
-        printf("Evicted address? - %x, tag - %x, set - %x\n", evict_addr, tag, idx);
-        for(int m=evict_addr; m<(evict_addr + block_size); ){
-            mem_write_32(m, block->value[m-evict_addr]);
-            m+=4;
-        }
+        cache_trace("Evicted address? - %x, tag - %x, set - %x\n", evict_addr, tag, idx);
+        write_back(cache, evict_addr, block->value);
+        HOSTPROF_LEAVE();
     }
 }
 
 void fill_block(cache_unit* cache, uint32_t idx, int w, uint32_t mem_addr){
     uint32_t block_size = cache->mdata.block_size;
 
+    HOSTPROF_ENTER(HP_FILL);
     for(int m=mem_addr; m< (mem_addr + block_size); ){
         cache->set[idx].way[w].value[m - mem_addr] = mem_read_32(m);
         m += 4; // address increment in multiples of 4-bytes
     }
+    HOSTPROF_LEAVE();
 }
 
-uint32_t cache_read(cache_unit* cache, uint32_t addr){
+// Cycles to bring in the block at 'mem_addr'
+static uint32_t miss_penalty(uint32_t mem_addr){
+    return dram ? dram_read(mem_addr, stat_cycles) : MISS_PENALTY;
+}
+
+// Victim cache entry holding the block at 'mem_addr', or -1
+static int victim_find(victim_cache* vc, uint32_t mem_addr){
+    for(int i=0; i<vc->entries; i++)
+        if(vc->entry[i].valid && vc->entry[i].addr == mem_addr)
+            return i;
+    return -1;
+}
+
+// Swap way 'w' of set 'idx' with victim entry 'v' (the block buffers trade
+// owners); the entry becomes the most recently used
+static void victim_swap(cache_unit* cache, uint32_t idx, int w, int v){
+    victim_cache* vc = cache->victim;
+    cache_block* block = &cache->set[idx].way[w];
+    cache_block* entry = &vc->entry[v];
+    uint32_t sets = cache->mdata.sets;
+    uint32_t block_size = cache->mdata.block_size;
+    uint32_t block_addr = (block->tag<<(clog2(sets)+clog2(block_size))) | (idx<<clog2(block_size));
+
+    uint32_t* value = entry->value;
+    bool dirty = entry->dirty;
+    entry->value = block->value;
+    entry->dirty = block->dirty;
+    entry->valid = block->valid;
+    entry->addr = block_addr;
+    block->value = value;
+    block->dirty = dirty;
+    vc->last_use[v] = ++vc->clock;
+}
+
+// Bring the block at 'mem_addr' into way 'w' of set 'idx', which may hold
+// another block, and leave the cycles it took in cache->penalty. The
+// caller sets the way's tag and state.
+static void replace_block(cache_unit* cache, uint32_t idx, int w, uint32_t mem_addr){
+    victim_cache* vc = cache->victim;
+    cache_block* block = &cache->set[idx].way[w];
+
+    if(vc == NULL){
+        evict_block(cache, idx, w);
+        fill_block(cache, idx, w, mem_addr);
+        block->dirty = false;
+        cache->penalty = miss_penalty(mem_addr);
+        return;
+    }
+
+    // The victim cache has it: trade places with the evicted block
+    int v = victim_find(vc, mem_addr);
+    if(v >= 0){
+        victim_swap(cache, idx, w, v);
+        cache->stat_victim_hits++;
+        cache->penalty = VICTIM_PENALTY;
+        return;
+    }
+
+    // The evicted block moves to a free or the least recently used entry,
+    // pushing that one out to memory
+    if(block->valid){
+        v = 0;
+        for(int i=0; i<vc->entries; i++){
+            if(!vc->entry[i].valid){
+                v = i;
+                break;
+            }
+            if(vc->last_use[i] < vc->last_use[v])
+                v = i;
+        }
+        if(vc->entry[v].valid && vc->entry[v].dirty)
+            write_back(cache, vc->entry[v].addr, vc->entry[v].value);
+        victim_swap(cache, idx, w, v);
+    }
+    fill_block(cache, idx, w, mem_addr);
+    block->dirty = false;
+    cache->penalty = miss_penalty(mem_addr);
+}
+
+// Whether the cache or its victim cache holds 'addr'
+static bool holds(cache_unit* cache, uint32_t addr){
+    uint32_t idx;
+    if(find_way(cache, addr, &idx) >= 0)
+        return true;
+    return cache->victim && victim_find(cache->victim, addr & (-1U<<clog2(cache->mdata.block_size))) >= 0;
+}
+
+// Lookup, fill and eviction within one cache; coherence is layered on top
+static uint32_t local_read(cache_unit* cache, uint32_t addr){
     // Meta-data values
     uint32_t block_size = cache->mdata.block_size;
     uint32_t ways = cache->mdata.ways;
@@ -83,14 +248,14 @@ uint32_t cache_read(cache_unit* cache, uint32_t addr){
     uint32_t tag = addr>>(clog2(sets)+clog2(block_size));
     uint32_t offset = addr & (block_size-1);
 
-    bool rd_done = false;
+    bool rd_done = false, evicted = false;
     uint8_t evict_way=0, max_lru=0;
     uint32_t read_data = 0;
     bool cache_miss = false;
     
     // Performing check
-    printf("I'm in cache!\t");
-    printf("addr=%u, set=%d, tag=%u, offset=%u\n", addr, idx, tag, offset);
+    cache_trace("I'm in cache!\t");
+    cache_trace("addr=%u, set=%d, tag=%u, offset=%u\n", addr, idx, tag, offset);
 
     // access the cache
     for(int i=0; i<ways; i++){
@@ -99,18 +264,18 @@ uint32_t cache_read(cache_unit* cache, uint32_t addr){
         if(block->valid == false){
             if(rd_done) break;
             else{
-                printf("cache invalid block - miss!\n");
+                cache_trace("cache invalid block - miss!\n");
                 rd_done = true;
+                replace_block(cache, idx, i, mem_addr);
                 block->valid = true;
+                block->shared = false;
                 block->tag = tag;
                 block->lru = 0;
-                fill_block(cache, idx, i, mem_addr);    //TODO: Can make it better?
                 read_data = block->value[offset];
                 cache_miss = true;
 
                 // Performing check
-                uint32_t temp = mem_read_32(addr);
-                printf("cache_data = %u, mem_data=%u\n", read_data, temp);
+                cache_trace("cache_data = %u, mem_data=%u\n", read_data, mem_read_32(addr));
             }
         }
 
@@ -119,8 +284,8 @@ uint32_t cache_read(cache_unit* cache, uint32_t addr){
             if(rd_done) block->lru++;                   // Already read-done --> just update lru
             else{
                 if(tag != block->tag){
-                    printf("tag value - Expected = %u, In_cache = %u\t", tag, block->tag);                    
-                    printf("tag not matching! not yet decided if hit or miss!\n");
+                    cache_trace("tag value - Expected = %u, In_cache = %u\t", tag, block->tag);                    
+                    cache_trace("tag not matching! not yet decided if hit or miss!\n");
                     block->lru++;                       // tag ain't matching --> just update
                     if(block->lru > max_lru){
                         evict_way = i;
@@ -128,16 +293,15 @@ uint32_t cache_read(cache_unit* cache, uint32_t addr){
                     }
                 }
                 else{
-                    printf("tag value - Expected = %u, In_cache = %u\t", tag, block->tag);
-                    printf("cache hit!\n");
+                    cache_trace("tag value - Expected = %u, In_cache = %u\t", tag, block->tag);
+                    cache_trace("cache hit!\n");
                     rd_done = true;
                     block->lru = 0;                     // tag matching --> block reused
                     // read-data
                     read_data = block->value[offset];
 
                     // Performing check
-                    uint32_t temp = mem_read_32(addr);
-                    printf("cache_data = %u, mem_data=%u\n", read_data, temp);
+                    cache_trace("cache_data = %u, mem_data=%u\n", read_data, mem_read_32(addr));
                 }
             }
         }
@@ -145,30 +309,31 @@ uint32_t cache_read(cache_unit* cache, uint32_t addr){
     }
 
     if(rd_done == false){
-        printf("cache miss - eviction! - evicted block = %u\n", evict_way);
+        cache_trace("cache miss - eviction! - evicted block = %u\n", evict_way);
         cache_block* block = &cache->set[idx].way[evict_way];
-        evict_block(cache, idx, evict_way);
-        fill_block(cache, idx, evict_way, mem_addr);
+        replace_block(cache, idx, evict_way, mem_addr);
         block->lru = 0;
+        block->shared = false;
         block->tag = tag;
         read_data = block->value[offset];
-        cache_miss = true;
+        cache_miss = evicted = true;
 
         // Performing check
-        uint32_t temp = mem_read_32(addr);
-        printf("cache_data = %u, mem_data=%u\n", read_data, temp);
+        cache_trace("cache_data = %u, mem_data=%u\n", read_data, mem_read_32(addr));
     }
 
-    if(cache_miss){
-        // Check performed
-        stat_cycles+=50;
-        printf("Added 50 cycle delay!\n");
-    }
+    // The caller charges the penalty to its own stall accounting
+    if(!cache_miss)
+        cache->penalty = 0;
+    if(cache_miss)
+        cache_trace("Added %d cycle delay!\n", cache->penalty);
+    if(cache->profile)
+        setprof_access(cache->profile, addr, cache_miss, evicted, true);
 
     return read_data;
 }
 
-void cache_write(cache_unit* cache, uint32_t addr, uint32_t val){
+static void local_write(cache_unit* cache, uint32_t addr, uint32_t val, uint32_t bytes){
     // Meta-data values
     uint32_t block_size = cache->mdata.block_size;
     uint32_t ways = cache->mdata.ways;
@@ -180,24 +345,41 @@ void cache_write(cache_unit* cache, uint32_t addr, uint32_t val){
     uint32_t tag = addr>>(clog2(sets)+clog2(block_size));
     uint32_t offset = addr & (block_size-1);
 
-    bool cache_miss = false;
+    uint32_t mask = byte_mask(bytes);
+    bool cache_miss = false, evicted = false;
     bool wr_done = false;
     uint32_t evict_way = 0, max_lru = 0;
+    cache_block* written = NULL;
+
+    // No-write-allocate: a miss goes around the cache to memory, which
+    // takes the enabled bytes only
+    if(!cache->write_allocate && !holds(cache, addr)){
+        if(dram)
+            dram_write(mem_addr, stat_cycles);
+        mem_write_32(addr, (mem_read_32(addr) & ~mask) | (val & mask));
+        cache->stat_write_around++;
+        cache->penalty = 0;
+        if(cache->profile)
+            setprof_access(cache->profile, addr, true, false, false);
+        return;
+    }
 
     for(int i=0; i<ways; i++){
         cache_block* block = &cache->set[idx].way[i];
-        // Invalid way
+        // Invalid way (the valid ways come first, so after a hit there
+        // is nothing left to look at)
         if(block->valid == false){
+            if(wr_done) break;
             cache_miss = true;
             wr_done = true;
 
+            replace_block(cache, idx, i, mem_addr);
             block->lru = 0;
             block->valid = true;
             block->dirty = true;
+            block->shared = false;
             block->tag = tag;
-
-            fill_block(cache, idx, i, mem_addr);
-            block->value[offset] = val;
+            written = block;
         }
         // Valid way
         else{
@@ -205,8 +387,8 @@ void cache_write(cache_unit* cache, uint32_t addr, uint32_t val){
 
             else{
                 if(tag != block->tag){
-                    printf("tag value - Expected = %u, In_cache = %u\t", tag, block->tag);                    
-                    printf("tag not matching! not yet decided if hit or miss!\n");
+                    cache_trace("tag value - Expected = %u, In_cache = %u\t", tag, block->tag);                    
+                    cache_trace("tag not matching! not yet decided if hit or miss!\n");
                     block->lru++;                       // tag ain't matching --> just update
                     if(block->lru > max_lru){
                         evict_way = i;
@@ -216,12 +398,12 @@ void cache_write(cache_unit* cache, uint32_t addr, uint32_t val){
 
                 //Cache-hit!
                 else{
-                    printf("tag value - Expected = %u, In_cache = %u\t", tag, block->tag);
-                    printf("cache hit!\n");
+                    cache_trace("tag value - Expected = %u, In_cache = %u\t", tag, block->tag);
+                    cache_trace("cache hit!\n");
                     wr_done = true;
                     block->lru = 0;                     // tag matching --> block reused
                     block->dirty = true;
-                    block->value[offset] = val;
+                    written = block;
                 }
             }
         }
@@ -229,25 +411,236 @@ void cache_write(cache_unit* cache, uint32_t addr, uint32_t val){
 
     // Eviction - cache miss!
     if(wr_done == false){
-        printf("cache miss - eviction! - evicted block = %u\n", evict_way);
+        cache_trace("cache miss - eviction! - evicted block = %u\n", evict_way);
         cache_block* block = &cache->set[idx].way[evict_way];
 
-        evict_block(cache, idx, evict_way);
-        fill_block(cache, idx, evict_way, mem_addr);
+        replace_block(cache, idx, evict_way, mem_addr);
 
         block->lru = 0;
         block->tag = tag;
         block->dirty = true;
-        block->value[offset] = val;
+        block->shared = false;
+        written = block;
+
+        cache_miss = evicted = true;
+    }
+
+    // Merge into the word the lookup (or the fill) left in the block
+    written->value[offset] = (written->value[offset] & ~mask) | (val & mask);
+
+    // Write-through: memory gets the word too, the block stays clean
+    if(cache->write_through){
+        written->dirty = false;
+        if(dram)
+            dram_write(mem_addr, stat_cycles);
+        mem_write_32(addr, written->value[offset]);
+        cache->stat_write_through++;
+    }
+
+    if(!cache_miss)
+        cache->penalty = 0;
+    if(cache_miss)
+        cache_trace("Added %d cycle delay!\n", cache->penalty);
+    if(cache->profile)
+        setprof_access(cache->profile, addr, cache_miss, evicted, true);
+}
+
+
+// Multi-core coherence. Every dcache of a multi-core run joins one snooping
+// bus. A core accesses its own cache under that cache's lock; anything that
+// has to look at other caches (a miss, or a write to a shared block) takes
+// the bus lock first and then the cache locks, so that one transaction at a
+// time walks the caches and memory.
+static pthread_mutex_t bus_lock = PTHREAD_MUTEX_INITIALIZER;
+static cache_unit* bus_caches[MAX_CORES];
+static int bus_ncaches = 0;
+
+void cache_join_coherence(cache_unit* cache){
+    pthread_mutex_init(&cache->lock, NULL);
+    pthread_mutex_lock(&bus_lock);
+    cache->coherent = true;
+    bus_caches[bus_ncaches++] = cache;
+    pthread_mutex_unlock(&bus_lock);
+}
+
+// Way holding 'addr' in its set, or -1
+static int find_way(cache_unit* cache, uint32_t addr, uint32_t* idx){
+    uint32_t block_size = cache->mdata.block_size;
+    uint32_t sets = cache->mdata.sets;
+    uint32_t tag = addr>>(clog2(sets)+clog2(block_size));
+
+    *idx = (addr>>clog2(block_size)) & (sets-1);
+    for(int i=0; i<cache->mdata.ways; i++){
+        cache_block* block = &cache->set[*idx].way[i];
+        if(block->valid && block->tag == tag)
+            return i;
+    }
+    return -1;
+}
+
+// Drop a block. Lookups assume the valid ways of a set come first, so the
+// last valid way moves into the hole.
+static void invalidate_block(cache_unit* cache, uint32_t idx, int w){
+    cache_block* way = cache->set[idx].way;
+    int last = w;
+    while(last+1 < cache->mdata.ways && way[last+1].valid)
+        last++;
+
+    cache_block dropped = way[w];
+    way[w] = way[last];
+    way[last] = dropped;
+    way[last].valid = false;
+    way[last].dirty = false;
+    way[last].shared = false;
+}
+
+// Look for 'addr' in every other cache on the bus. A dirty copy is written
+// back so memory is current; the copies are then shared (read) or
+// invalidated (write). Returns whether any other cache held the block.
+// Called with the bus lock held.
+static bool snoop(cache_unit* self, uint32_t addr, bool invalidate){
+    bool found = false;
+
+    for(int c=0; c<bus_ncaches; c++){
+        cache_unit* other = bus_caches[c];
+        if(other == self)
+            continue;
+
+        pthread_mutex_lock(&other->lock);
+        uint32_t idx;
+        int w = find_way(other, addr, &idx);
+        if(w >= 0){
+            cache_block* block = &other->set[idx].way[w];
+            found = true;
+            if(block->dirty){
+                evict_block(other, idx, w);
+                other->stat_snoop_wb++;
+            }
+            if(invalidate){
+                invalidate_block(other, idx, w);
+                other->stat_snoop_inv++;
+                if(other->profile)
+                    setprof_invalidate(other->profile, addr);
+            }
+            else
+                block->shared = true;
+        }
+        pthread_mutex_unlock(&other->lock);
+    }
+
+    return found;
+}
+
+static uint32_t coherent_read(cache_unit* cache, uint32_t addr){
+    uint32_t idx, val;
+    core_wait_turn();
+
+    // Hit in any valid state
+    pthread_mutex_lock(&cache->lock);
+    if(find_way(cache, addr, &idx) >= 0){
+        val = local_read(cache, addr);
+        pthread_mutex_unlock(&cache->lock);
+        return val;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    // Miss: fetch the block after the other caches gave up ownership
+    pthread_mutex_lock(&bus_lock);
+    bool shared = snoop(cache, addr, false);
+    pthread_mutex_lock(&cache->lock);
+    val = local_read(cache, addr);
+    int w = find_way(cache, addr, &idx);
+    cache->set[idx].way[w].shared = shared;
+    pthread_mutex_unlock(&cache->lock);
+    pthread_mutex_unlock(&bus_lock);
+
+    return val;
+}
+
+static void coherent_write(cache_unit* cache, uint32_t addr, uint32_t val, uint32_t bytes){
+    uint32_t idx;
+    core_wait_turn();
 
-        cache_miss = true;
+    // Hit in M or E: no other copy exists
+    pthread_mutex_lock(&cache->lock);
+    int w = find_way(cache, addr, &idx);
+    if(w >= 0 && !cache->set[idx].way[w].shared){
+        local_write(cache, addr, val, bytes);
+        pthread_mutex_unlock(&cache->lock);
+        return;
     }
+    pthread_mutex_unlock(&cache->lock);
+
+    // Shared or missing: invalidate every other copy first. Our own copy
+    // may have been invalidated meanwhile, so look again under the locks.
+    pthread_mutex_lock(&bus_lock);
+    snoop(cache, addr, true);
+    pthread_mutex_lock(&cache->lock);
+    bool upgrade = find_way(cache, addr, &idx) >= 0;
+    local_write(cache, addr, val, bytes);
+    cache->set[idx].way[find_way(cache, addr, &idx)].shared = false;
+    if(upgrade){
+        cache->penalty = UPGRADE_PENALTY;
+        cache->stat_upgrades++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    pthread_mutex_unlock(&bus_lock);
+}
+
+uint32_t cache_read(cache_unit* cache, uint32_t addr){
+    HOSTPROF_ENTER(HP_CACHE_READ);
+    uint32_t val = cache->coherent ? coherent_read(cache, addr) : local_read(cache, addr);
+    HOSTPROF_LEAVE();
+    return val;
+}
+
+void cache_write(cache_unit* cache, uint32_t addr, uint32_t val, uint32_t bytes){
+    HOSTPROF_ENTER(HP_CACHE_WRITE);
+    if(cache->coherent)
+        coherent_write(cache, addr, val, bytes);
+    else
+        local_write(cache, addr, val, bytes);
+    HOSTPROF_LEAVE();
+}
+
+uint32_t fetch_buffer_read(fetch_buffer* buf, cache_unit* cache, uint32_t addr){
+    uint32_t block_size = cache->mdata.block_size;
+    uint32_t mem_addr = addr & (-1U<<clog2(block_size));
 
-    if(cache_miss == true){
-        // Check performed
-        stat_cycles+=50;
-        printf("Added 50 cycle delay!\n");
+    if(buf->valid && buf->addr == mem_addr){
+        buf->stat_hits++;
+        cache->penalty = 0;
+        return buf->value[addr - mem_addr];
     }
+
+    uint32_t idx;
+    uint32_t val = cache_read(cache, addr);
+    int w = find_way(cache, addr, &idx);
+    memcpy(buf->value, cache->set[idx].way[w].value, block_size * sizeof(uint32_t));
+    buf->valid = true;
+    buf->addr = mem_addr;
+    buf->stat_fills++;
+    return val;
+}
+
+void fetch_buffer_flush(fetch_buffer* buf){
+    buf->valid = false;
+}
+
+void cache_print_stats(cache_unit* cache, const char* name, FILE* out){
+    uint64_t block_bytes = cache->stat_writebacks * cache->mdata.block_size;
+    uint64_t word_bytes = 4 * (cache->stat_write_through + cache->stat_write_around);
+
+    fprintf(out, "%s (%s, %s", name, cache->write_through ? "write-through" : "write-back",
+            cache->write_allocate ? "write-allocate" : "no-write-allocate");
+    if(cache->victim)
+        fprintf(out, ", %u-entry victim cache", cache->victim->entries);
+    fprintf(out, "):\n");
+    if(cache->victim)
+        fprintf(out, "  victim hits %" PRIu64 "\n", cache->stat_victim_hits);
+    fprintf(out, "  writebacks %" PRIu64 ", written through %" PRIu64 ", written around %" PRIu64
+            " (%" PRIu64 " bytes to memory)\n", cache->stat_writebacks, cache->stat_write_through,
+            cache->stat_write_around, block_bytes + word_bytes);
 }
 
 
@@ -9,6 +9,10 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "shell.h"
+#include "setprof.h"
 
 /* Instruction cache */
 #define I_WAYS 4
@@ -20,6 +24,43 @@
 #define D_SETS 256
 #define D_BLOCK_SIZE 32
 
+/* Cycles charged for a miss (fill from memory), unless the DRAM model
+ * is on (dram.h) */
+#define MISS_PENALTY 50
+
+/* Cycles charged for a miss that hits in the victim cache */
+#define VICTIM_PENALTY 2
+
+/* Cycles charged for a write to a shared block (invalidate the other
+ * copies); only multi-core runs have shared blocks */
+#define UPGRADE_PENALTY 10
+
+// Byte enables of a store: bit i writes byte i of the word (the byte at
+// word address + i). A partial store merges into the cached word in the
+// one access that also looks it up.
+#define BYTES_ALL 0xF
+
+static inline uint32_t byte_mask(uint32_t bytes){
+    uint32_t mask = 0;
+    for(int i=0; i<4; i++)
+        if(bytes & (1 << i))
+            mask |= 0xFFu << (8 * i);
+    return mask;
+}
+
+// Write policy and victim cache of a cache. Stores that go to memory
+// (write-through, or a miss that does not allocate) wait in a write
+// buffer and stall nothing; with the DRAM model they still occupy its
+// write queue.
+typedef struct{
+    bool write_through;     // stores also update memory; blocks stay clean
+    bool write_allocate;    // a store miss fills the block first
+    uint32_t victim_entries;    // fully associative victim cache (0: none)
+} cache_config;
+
+// --dcache-write, --dcache-alloc and --victim (the icache is never written)
+extern cache_config dcache_cfg;
+
 // structure to hold cache metadata
 typedef struct{
     uint32_t block_size;
@@ -28,9 +69,11 @@ typedef struct{
 } cache_mdata;
 
 // structure to hold a cache_block
+// MESI state: I = !valid, M = dirty, S = shared, E = valid and neither
 typedef struct{
     bool valid;
     bool dirty;
+    bool shared;        // another core's dcache may hold a copy
     uint32_t tag;
     uint8_t lru;
     uint32_t* value;
@@ -43,24 +86,79 @@ typedef struct{
     cache_block* way;
 } cache_line;
 
+// Blocks evicted from a cache, fully associative. An entry's 'addr' is
+// its block address and 'lru' is unused: 'last_use' orders them.
+typedef struct{
+    cache_block* entry;
+    uint64_t* last_use;
+    uint32_t entries;
+    uint64_t clock;
+} victim_cache;
+
 // structure to hold a unified cache unit
 // can hold multiple cache lines
 typedef struct{
     cache_mdata mdata;
     cache_line* set;
+    uint32_t penalty;   // cycles owed by the last access (0 on a hit)
+
+    // Policy (init_cache: write-back, write-allocate, no victim cache)
+    bool write_through;
+    bool write_allocate;
+    victim_cache* victim;
+
+    // Statistics
+    uint64_t stat_victim_hits;  // misses served by the victim cache
+    uint64_t stat_writebacks;   // dirty blocks written to memory
+    uint64_t stat_write_through;    // stores written through to memory
+    uint64_t stat_write_around;     // store misses sent to memory unallocated
+    set_profile* profile;       // per-set counters (--set-stats), or NULL
+
+    // Coherence (dcaches of multi-core runs only)
+    bool coherent;
+    pthread_mutex_t lock;       // held while this cache's blocks change
+    uint64_t stat_upgrades;     // writes that had to invalidate other copies
+    uint64_t stat_snoop_inv;    // blocks invalidated by other cores' writes
+    uint64_t stat_snoop_wb;     // dirty blocks written back for other cores
 } cache_unit;
 
-extern cache_unit* icache;
-extern cache_unit* dcache;
+// Fetch buffer: the icache block fetch is reading from. Sequential fetch
+// within the block reads the buffer instead of looking up the icache; it
+// is refilled when fetch crosses into another block or is redirected.
+typedef struct{
+    bool valid;
+    uint32_t addr;                  // block address
+    uint32_t value[I_BLOCK_SIZE];   // indexed like cache_block.value
+
+    // Statistics
+    uint64_t stat_hits, stat_fills;
+} fetch_buffer;
+
+extern CORE_LOCAL cache_unit* icache;
+extern CORE_LOCAL cache_unit* dcache;
 
 // Member functions
 cache_unit* init_cache(uint32_t, uint32_t, uint32_t);
+void free_cache(cache_unit*);
 void fill_block(cache_unit*, uint32_t, int, uint32_t);
 void evict_block(cache_unit*, uint32_t, int);
 uint32_t cache_read(cache_unit*, uint32_t);
-void cache_write(cache_unit*, uint32_t, uint32_t);
+void cache_write(cache_unit*, uint32_t addr, uint32_t val, uint32_t bytes);
 void evict_block(cache_unit*, uint32_t, int);
 
+// Apply a write policy and victim cache to a new cache
+void cache_configure(cache_unit*, const cache_config*);
+
+void cache_print_stats(cache_unit*, const char* name, FILE*);
+
+// Read 'addr' through 'buf'. A hit leaves cache->penalty 0 without touching
+// the cache; a miss reads the cache and copies the block into the buffer.
+uint32_t fetch_buffer_read(fetch_buffer*, cache_unit*, uint32_t addr);
+void fetch_buffer_flush(fetch_buffer*);
+
+// Add a cache to the set kept coherent by snooping (MESI)
+void cache_join_coherence(cache_unit*);
+
 // Utility function - clog2
 uint32_t clog2(uint32_t);
 #endif
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "check.h"
+#include "func.h"
+#include "ooo.h"
+#include "pipe.h"
+#include "shell.h"
+#include "mips.h"
+
+bool check_enabled = false;
+bool check_failed = false;
+
+static func_state golden;
+static mem_region_t golden_mem[MEM_NREGIONS];
+static uint64_t checked;            // instructions that agreed
+
+void check_init(){
+    for(int r=0; r<MEM_NREGIONS; r++){
+        mem_free(golden_mem[r].mem, golden_mem[r].size);
+        golden_mem[r] = MEM_REGIONS[r];
+        golden_mem[r].mem = mem_alloc(MEM_REGIONS[r].size);
+
+        // Only the loaded pages; the rest stays unallocated
+        uint32_t npages = MEM_REGIONS[r].size >> MEM_PAGE_BITS;
+        uint8_t* used = malloc(npages);
+        mem_used_pages(MEM_REGIONS[r].mem, MEM_REGIONS[r].size, used);
+        for(uint32_t p=0; p<npages; p++)
+            if(used[p])
+                memcpy(golden_mem[r].mem + ((uint64_t)p << MEM_PAGE_BITS),
+                       MEM_REGIONS[r].mem + ((uint64_t)p << MEM_PAGE_BITS), 1u << MEM_PAGE_BITS);
+        free(used);
+    }
+
+    memset(&golden, 0, sizeof(golden));
+    golden.PC = pipe.PC;
+    check_sync();
+    checked = 0;
+    check_failed = false;
+}
+
+void check_sync(){
+    memcpy(golden.REGS, pipe.REGS, sizeof(golden.REGS));
+    golden.HI = pipe.HI;
+    golden.LO = pipe.LO;
+}
+
+static void print_stage(const char* stage, Pipe_Op* op){
+    if(op)
+        printf("  %-8s 0x%08x (0x%08x)\n", stage, op->pc, op->instruction);
+    else
+        printf("  %-8s -\n", stage);
+}
+
+static void print_pipeline(){
+    printf("Pipeline state (fetch at 0x%08x):\n", pipe.PC);
+    if(pipe_model == CORE_OOO){
+        for(int i=ooo.head, n=0; n<ooo.count; i=(i + 1) % ooo_cfg.rob_size, n++){
+            char name[16];
+            snprintf(name, sizeof(name), "rob%d", n);
+            print_stage(name, ooo.rob[i].op);
+        }
+        return;
+    }
+    print_stage("decode", pipe.decode_op);
+    print_stage("execute", pipe.execute_op);
+    print_stage("mem", pipe.mem_op);
+}
+
+static void mismatch(Pipe_Op* op, const char* what, uint32_t got, uint32_t expected){
+    if(!check_failed){
+        printf("Co-simulation mismatch after %" PRIu64 " instructions, retiring 0x%08x (0x%08x):\n",
+               checked, op->pc, op->instruction);
+        check_failed = true;
+        RUN_BIT = 0;
+    }
+    printf("  %s is 0x%08x, the functional model has 0x%08x\n", what, got, expected);
+}
+
+static uint32_t store_mask(Pipe_Op* op){
+    if(op->opcode == OP_SB) return 0xFF;
+    if(op->opcode == OP_SH) return 0xFFFF;
+    return 0xFFFFFFFF;
+}
+
+void check_retire(Pipe_Op* op, uint32_t hi, uint32_t lo, bool hilo_valid){
+    if(check_failed)
+        return;
+
+    Pipe_Op g;
+    mem_region_t* saved = mem_regions;
+    mem_regions = golden_mem;
+    func_step(&golden, &g);
+    mem_regions = saved;
+
+    if(op->pc != g.pc){
+        mismatch(op, "PC", op->pc, g.pc);
+    }
+    else{
+        char name[16];
+        int dst = g.reg_dst > 0 ? g.reg_dst : op->reg_dst;
+        snprintf(name, sizeof(name), "R%d", dst);
+        if(dst > 0 && op->reg_dst != g.reg_dst)
+            mismatch(op, "destination register", op->reg_dst, g.reg_dst);
+        else if(dst > 0 && op->reg_dst_value != g.reg_dst_value)
+            mismatch(op, name, op->reg_dst_value, g.reg_dst_value);
+
+        if(g.is_mem && g.mem_write){
+            uint32_t mask = store_mask(&g);
+            if(op->mem_addr != g.mem_addr)
+                mismatch(op, "store address", op->mem_addr, g.mem_addr);
+            if((op->mem_value & mask) != (g.mem_value & mask))
+                mismatch(op, "store data", op->mem_value & mask, g.mem_value & mask);
+        }
+
+        if(hilo_valid && hi != golden.HI)
+            mismatch(op, "HI", hi, golden.HI);
+        if(hilo_valid && lo != golden.LO)
+            mismatch(op, "LO", lo, golden.LO);
+    }
+
+    if(check_failed)
+        print_pipeline();
+    else
+        checked++;
+}
@@ -0,0 +1,29 @@
+/************************************/
+/*                                  */
+/*     Lockstep Co-Simulation       */
+/*                                  */
+/************************************/
+
+#ifndef _CHECK_H
+#define _CHECK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pipe.h"
+
+// With --check, every instruction the timing model retires is also run on
+// the functional model (func.h), which has its own copy of memory. The
+// destination register, HI/LO and store address and data must agree; the
+// first difference is reported with the pipeline state and stops the run.
+
+extern bool check_enabled;
+extern bool check_failed;
+
+void check_init();          // start from the current architectural state and memory
+void check_sync();          // take over registers the shell changed
+
+// 'op' retires; 'hi'/'lo' are the architectural HI/LO after it, if
+// 'hilo_valid' (the in-order core may already hold a younger op's HI/LO)
+void check_retire(Pipe_Op* op, uint32_t hi, uint32_t lo, bool hilo_valid);
+
+#endif
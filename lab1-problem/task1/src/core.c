@@ -0,0 +1,157 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include "core.h"
+#include "shell.h"
+#include "pipe.h"
+#include "cache.h"
+#include "stats.h"
+
+int ncores = 1;
+uint32_t core_quantum = 1000;
+core_t cores[MAX_CORES];
+CORE_LOCAL int core_id = 0;
+uint64_t core_time = 0;
+
+static pthread_t threads[MAX_CORES];
+static pthread_barrier_t quantum_start, quantum_end;
+static uint64_t quantum_target;     // every core runs up to this cycle
+
+// Each core's clock as the other cores see it: none of its later accesses
+// to shared state happens before it. A halted core publishes UINT64_MAX.
+static _Atomic uint64_t core_clock[MAX_CORES];
+static CORE_LOCAL bool in_quantum;
+
+// Initialize the calling thread's core and publish where its state lives
+static void core_setup(int id){
+    core_id = id;
+    pipe_init();
+
+    if(ncores > 1){
+        pipe.REGS[26] = id;         // $k0
+        pipe.REGS[27] = ncores;     // $k1
+        cache_join_coherence(dcache);
+    }
+
+    core_t* c = &cores[id];
+    c->pipe = &pipe;
+    c->run_bit = &RUN_BIT;
+    c->cycles = &stat_cycles;
+    c->retired = &stat_inst_retire;
+    c->fetched = &stat_inst_fetch;
+    c->squash = &stat_squash;
+    c->icache = &icache;
+    c->dcache = &dcache;
+    c->cpi = cpi_stack;
+    atomic_store(&core_clock[id], 0);
+}
+
+static void run_quantum(){
+    in_quantum = true;
+    while(RUN_BIT && stat_cycles < quantum_target){
+        atomic_store(&core_clock[core_id], stat_cycles);
+        cycle_skip(quantum_target);
+    }
+    atomic_store(&core_clock[core_id], RUN_BIT ? stat_cycles : UINT64_MAX);
+    in_quantum = false;
+}
+
+// A core waits until every other core is past this cycle, or at it with
+// a higher id, so shared state sees accesses in (cycle, core id) order
+// whatever order the host runs the threads in. The smallest pair can
+// always go, and a core at the barrier is past every running core.
+void core_wait_turn(){
+    if(!in_quantum)
+        return;
+
+    uint64_t now = stat_cycles;
+    atomic_store(&core_clock[core_id], now);
+    for(int i=0; i<ncores; i++){
+        if(i == core_id)
+            continue;
+        for(;;){
+            uint64_t t = atomic_load(&core_clock[i]);
+            if(t > now || (t == now && i > core_id))
+                break;
+            sched_yield();
+        }
+    }
+}
+
+static void* core_thread(void* arg){
+    core_setup((int)(intptr_t)arg);
+    pthread_barrier_wait(&quantum_end);
+
+    for(;;){
+        pthread_barrier_wait(&quantum_start);
+        run_quantum();
+        pthread_barrier_wait(&quantum_end);
+    }
+    return NULL;
+}
+
+void core_init(){
+    core_setup(0);
+    if(ncores == 1)
+        return;
+
+    pthread_barrier_init(&quantum_start, NULL, ncores);
+    pthread_barrier_init(&quantum_end, NULL, ncores);
+    for(int i=1; i<ncores; i++){
+        if(pthread_create(&threads[i], NULL, core_thread, (void*)(intptr_t)i) != 0){
+            fprintf(stderr, "Error: Can't start the thread of core %d\n", i);
+            exit(1);
+        }
+    }
+
+    // Wait until every core has initialized
+    pthread_barrier_wait(&quantum_end);
+}
+
+bool core_running(){
+    for(int i=0; i<ncores; i++)
+        if(*cores[i].run_bit)
+            return true;
+    return false;
+}
+
+uint64_t core_retired(){
+    uint64_t total = 0;
+    for(int i=0; i<ncores; i++)
+        total += *cores[i].retired;
+    return total;
+}
+
+// The barriers also order memory: after core_step returns, the main
+// thread sees everything the other cores wrote during the quantum.
+void core_step(uint64_t limit){
+    quantum_target = core_time + core_quantum;
+    if(quantum_target > limit)
+        quantum_target = limit;
+
+    pthread_barrier_wait(&quantum_start);
+    run_quantum();
+    pthread_barrier_wait(&quantum_end);
+
+    core_time = quantum_target;
+}
+
+void core_print_stats(FILE* out){
+    fprintf(out, "Cores (%d, quantum %u cycles):\n", ncores, core_quantum);
+    fprintf(out, "  %-4s %-10s %12s %12s %7s %10s %10s %10s %10s\n", "core", "pc", "cycles",
+            "retired", "ipc", "upgrades", "snoop_inv", "snoop_wb", "state");
+    for(int i=0; i<ncores; i++){
+        core_t* c = &cores[i];
+        cache_unit* d = *c->dcache;
+        fprintf(out, "  %-4d 0x%08x %12" PRIu64 " %12" PRIu64 " %7.3f %10" PRIu64 " %10" PRIu64
+                " %10" PRIu64 " %10s\n", i, c->pipe->PC, *c->cycles, *c->retired,
+                *c->cycles ? (double)*c->retired / *c->cycles : 0.0,
+                d->stat_upgrades, d->stat_snoop_inv, d->stat_snoop_wb,
+                *c->run_bit ? "running" : "halted");
+    }
+}
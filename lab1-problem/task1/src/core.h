@@ -0,0 +1,51 @@
+/************************************/
+/*                                  */
+/*      Multi-Core Simulation       */
+/*                                  */
+/************************************/
+
+#ifndef _CORE_H
+#define _CORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "shell.h"
+#include "pipe.h"
+
+#define MAX_CORES 16
+
+// Every core runs the loaded program on its own host thread, with its own
+// pipeline, caches and statistics (the CORE_LOCAL variables) and with
+// $k0 = core id, $k1 = number of cores. Memory is shared and the dcaches
+// are kept coherent. Threads run 'core_quantum' cycles at a time and then
+// wait for each other, so cores never drift more than a quantum apart.
+// Within a quantum the coherent dcaches and a shared DRAM are accessed in
+// (cycle, core id) order (core_wait_turn), so a run's timing does not
+// depend on how the host schedules the threads or on the quantum, and
+// repeats exactly.
+// The main thread is core 0: the shell's commands act on it.
+
+// Where a core's thread-local state lives, for other threads to read
+typedef struct{
+    Pipe_State* pipe;
+    int* run_bit;
+    uint64_t *cycles, *retired, *fetched, *squash;
+    cache_unit **icache, **dcache;
+    uint64_t* cpi;
+} core_t;
+
+extern int ncores;
+extern uint32_t core_quantum;
+extern core_t cores[MAX_CORES];
+extern CORE_LOCAL int core_id;
+extern uint64_t core_time;          // cycles simulated by every core
+
+void core_init();                   // set up core 0 here and start the rest
+bool core_running();                // any core not yet halted
+uint64_t core_retired();            // instructions retired by all cores
+void core_step(uint64_t limit);     // run one quantum, not past 'limit'
+void core_wait_turn();              // before touching state other cores share
+void core_print_stats(FILE*);
+
+#endif
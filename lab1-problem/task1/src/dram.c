@@ -0,0 +1,206 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include "dram.h"
+#include "cache.h"
+#include "core.h"
+#include "hostprof.h"
+
+dram_config dram_cfg = { false, 1, 8, 2048, true, 32 };
+CORE_LOCAL dram_t* dram = NULL;
+
+// The controller all cores of a multi-core run share
+static dram_t* shared_dram = NULL;
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void dram_clear(dram_t* d){
+    for(int i=0; i<dram_cfg.channels * dram_cfg.banks; i++){
+        d->bank[i].open_row = -1;
+        d->bank[i].ready = 0;
+    }
+    memset(d->bus_free, 0, dram_cfg.channels * sizeof(uint64_t));
+    d->wq_count = 0;
+    d->reads = d->writes = d->drains = 0;
+    d->row_hits = d->row_empty = d->row_conflicts = 0;
+    d->read_latency = 0;
+}
+
+static dram_t* dram_create(){
+    dram_t* d = calloc(1, sizeof(dram_t));
+    d->bank = calloc(dram_cfg.channels * dram_cfg.banks, sizeof(dram_bank));
+    d->bus_free = calloc(dram_cfg.channels, sizeof(uint64_t));
+    d->wq = calloc(dram_cfg.write_queue, sizeof(dram_request));
+    pthread_mutex_init(&d->lock, NULL);
+    dram_clear(d);
+    return d;
+}
+
+void dram_init(){
+    if(!dram_cfg.enabled)
+        return;
+
+    if(ncores > 1){
+        pthread_mutex_lock(&shared_lock);
+        if(shared_dram == NULL){
+            shared_dram = dram_create();
+            shared_dram->shared = true;
+        }
+        pthread_mutex_unlock(&shared_lock);
+        dram = shared_dram;
+        return;
+    }
+
+    // A thread that starts over (interval simulation) starts a new run
+    if(dram == NULL)
+        dram = dram_create();
+    else
+        dram_clear(dram);
+}
+
+void dram_reset_timing(){
+    if(dram == NULL)
+        return;
+    for(int i=0; i<dram_cfg.channels * dram_cfg.banks; i++)
+        dram->bank[i].ready = 0;
+    memset(dram->bus_free, 0, dram_cfg.channels * sizeof(uint64_t));
+    dram->wq_count = 0;
+}
+
+// Address mapping: line, then channel, then column within the row, then
+// bank; what is left is the row
+static dram_bank* map(uint32_t addr, int* channel, int64_t* row){
+    uint32_t line = addr / D_BLOCK_SIZE;
+    uint32_t lines_per_row = dram_cfg.row_size / D_BLOCK_SIZE;
+
+    *channel = line % dram_cfg.channels;
+    line /= dram_cfg.channels;
+    line /= lines_per_row;
+    int bank = line % dram_cfg.banks;
+    *row = line / dram_cfg.banks;
+    return &dram->bank[*channel * dram_cfg.banks + bank];
+}
+
+static bool row_hit(uint32_t addr){
+    int channel;
+    int64_t row;
+    return map(addr, &channel, &row)->open_row == row;
+}
+
+// Issue one line transfer no earlier than 'now'; returns the cycle its
+// last beat leaves the data bus
+static uint64_t transfer(uint32_t addr, uint64_t now){
+    int channel;
+    int64_t row;
+    dram_bank* bank = map(addr, &channel, &row);
+
+    uint64_t t = now > bank->ready ? now : bank->ready;
+    if(bank->open_row == row)
+        dram->row_hits++;
+    else if(bank->open_row < 0){
+        dram->row_empty++;
+        t += DRAM_T_RCD;
+    }
+    else{
+        dram->row_conflicts++;
+        t += DRAM_T_RP + DRAM_T_RCD;
+    }
+
+    uint64_t data = t + DRAM_T_CAS;
+    if(data < dram->bus_free[channel])
+        data = dram->bus_free[channel];
+    dram->bus_free[channel] = data + DRAM_T_BURST;
+
+    if(dram_cfg.open_page){
+        // Column commands to the open row pipeline one burst apart
+        bank->open_row = row;
+        bank->ready = t + DRAM_T_BURST;
+    }
+    else{
+        bank->open_row = -1;
+        bank->ready = data + DRAM_T_BURST + DRAM_T_RP;
+    }
+    return data + DRAM_T_BURST;
+}
+
+// Drain the write queue down to half, FR-FCFS: the oldest write to an
+// open row first, otherwise the oldest write
+static void drain(uint64_t now){
+    dram->drains++;
+    while(dram->wq_count > dram_cfg.write_queue / 2){
+        int pick = 0;
+        for(int i=0; i<dram->wq_count; i++){
+            if(row_hit(dram->wq[i].addr)){
+                pick = i;
+                break;
+            }
+        }
+
+        dram_request* w = &dram->wq[pick];
+        transfer(w->addr, now > w->arrival ? now : w->arrival);
+        memmove(w, w + 1, (dram->wq_count - pick - 1) * sizeof(dram_request));
+        dram->wq_count--;
+    }
+}
+
+uint32_t dram_read(uint32_t addr, uint64_t now){
+    HOSTPROF_ENTER(HP_DRAM);
+    if(dram->shared){
+        core_wait_turn();
+        pthread_mutex_lock(&dram->lock);
+    }
+
+    // A line still waiting in the write queue is returned from there
+    uint64_t done = 0;
+    uint32_t line = addr / D_BLOCK_SIZE;
+    for(int i=0; i<dram->wq_count; i++)
+        if(dram->wq[i].addr / D_BLOCK_SIZE == line)
+            done = now + DRAM_T_BURST;
+    if(done == 0)
+        done = transfer(addr, now);
+
+    uint32_t latency = done - now + DRAM_T_CTRL;
+    dram->reads++;
+    dram->read_latency += latency;
+
+    if(dram->shared)
+        pthread_mutex_unlock(&dram->lock);
+    HOSTPROF_LEAVE();
+    return latency;
+}
+
+void dram_write(uint32_t addr, uint64_t now){
+    HOSTPROF_ENTER(HP_DRAM);
+    if(dram->shared){
+        core_wait_turn();
+        pthread_mutex_lock(&dram->lock);
+    }
+
+    dram->wq[dram->wq_count++] = (dram_request){ addr, now };
+    dram->writes++;
+    if(dram->wq_count == dram_cfg.write_queue)
+        drain(now);
+
+    if(dram->shared)
+        pthread_mutex_unlock(&dram->lock);
+    HOSTPROF_LEAVE();
+}
+
+void dram_print_stats(FILE* out){
+    uint64_t rows = dram->row_hits + dram->row_empty + dram->row_conflicts;
+    double total = rows ? (double)rows : 1.0;
+
+    fprintf(out, "DRAM (%d channel%s x %d banks, %u B rows, %s page):\n", dram_cfg.channels,
+            dram_cfg.channels > 1 ? "s" : "", dram_cfg.banks, dram_cfg.row_size,
+            dram_cfg.open_page ? "open" : "closed");
+    fprintf(out, "  reads %" PRIu64 " (avg latency %.1f cycles), writes %" PRIu64
+            " (%" PRIu64 " queue drains)\n", dram->reads,
+            dram->reads ? (double)dram->read_latency / dram->reads : 0.0,
+            dram->writes, dram->drains);
+    fprintf(out, "  row hits %.1f%%, empty %.1f%%, conflicts %.1f%%\n",
+            100.0 * dram->row_hits / total, 100.0 * dram->row_empty / total,
+            100.0 * dram->row_conflicts / total);
+}
@@ -0,0 +1,74 @@
+/************************************/
+/*                                  */
+/*        DRAM Controller           */
+/*                                  */
+/************************************/
+
+#ifndef _DRAM_H
+#define _DRAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "shell.h"
+
+// With --memory dram, cache misses are served by this model instead of
+// costing MISS_PENALTY. Lines are interleaved across channels; within a
+// channel, consecutive lines fill a row of one bank before moving to the
+// next bank. A read pays for the state of its bank's row buffer and waits
+// for the bank and the channel's data bus. Write-backs wait in a write
+// queue and are drained in a batch once it fills, row hits first.
+
+// Timing in CPU cycles
+#define DRAM_T_CTRL   10    // controller and on-chip network, request + reply
+#define DRAM_T_RCD    15    // activate a row
+#define DRAM_T_CAS    15    // column access on an open row
+#define DRAM_T_RP     15    // precharge (close) a row
+#define DRAM_T_BURST  8     // one cache line on the data bus
+
+typedef struct{
+    bool enabled;
+    int channels;
+    int banks;              // per channel
+    uint32_t row_size;      // bytes per row of one bank
+    bool open_page;         // keep rows open after an access
+    int write_queue;        // write-backs buffered before a drain
+} dram_config;
+
+extern dram_config dram_cfg;
+
+typedef struct{
+    int64_t open_row;       // -1: precharged
+    uint64_t ready;         // cycle the bank takes its next command
+} dram_bank;
+
+typedef struct{
+    uint32_t addr;
+    uint64_t arrival;
+} dram_request;
+
+typedef struct{
+    dram_bank* bank;        // [channel * banks + bank]
+    uint64_t* bus_free;     // per channel: data bus busy until
+    dram_request* wq;       // write queue
+    int wq_count;
+    bool shared;            // used by several cores: take 'lock'
+    pthread_mutex_t lock;
+
+    // Statistics
+    uint64_t reads, writes, drains;
+    uint64_t row_hits, row_empty, row_conflicts;
+    uint64_t read_latency;  // summed over reads
+} dram_t;
+
+// The controller the calling core's caches use (NULL: flat penalty)
+extern CORE_LOCAL dram_t* dram;
+
+void dram_init();                   // per core, from pipe_init()
+void dram_reset_timing();           // forget bank and bus times, keep open rows
+uint32_t dram_read(uint32_t addr, uint64_t now);   // returns the latency
+void dram_write(uint32_t addr, uint64_t now);
+void dram_print_stats(FILE*);
+
+#endif
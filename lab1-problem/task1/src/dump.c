@@ -0,0 +1,419 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dump.h"
+#include "shell.h"
+#include "pipe.h"
+#include "cache.h"
+#include "core.h"
+
+#define DIFF_SHOWN 16       // differing words listed per memory range
+
+static void put32(uint8_t* p, uint32_t v){
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static uint32_t get32(const uint8_t* p){
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Start a section at 'p'; returns where its contents go
+static uint8_t* begin_section(uint8_t* p, uint32_t type, uint64_t size){
+    dump_section s = { type, 0, size };
+    memcpy(p, &s, sizeof(s));
+    return p + sizeof(s);
+}
+
+static uint32_t block_address(cache_unit* cache, uint32_t idx, uint32_t tag){
+    uint32_t sets = cache->mdata.sets;
+    uint32_t block_size = cache->mdata.block_size;
+    return (tag<<(clog2(sets)+clog2(block_size))) | (idx<<clog2(block_size));
+}
+
+// Copy the words of a block (cache_block.value is indexed by byte offset)
+// that fall into out[0..len), which holds memory from 'start' on
+static void overlay(uint8_t* out, uint32_t start, uint64_t len, uint32_t addr,
+                    const uint32_t* value, uint32_t block_size){
+    for(uint32_t off=0; off<block_size; off+=4){
+        uint64_t at = (uint64_t)addr + off;
+        if(at >= start && at + 4 <= start + len)
+            put32(out + (at - start), value[off]);
+    }
+}
+
+// Memory as the program sees it: the backing store, then the dirty blocks
+// that have not been written back yet
+static void read_memory(uint8_t* out, uint32_t start, uint64_t len){
+    uint64_t end = start + len;
+
+    memset(out, 0, len);
+    for(int r=0; r<MEM_NREGIONS; r++){
+        uint64_t lo = mem_regions[r].start, hi = lo + mem_regions[r].size;
+        if(lo < start) lo = start;
+        if(hi > end) hi = end;
+        if(lo < hi)
+            memcpy(out + (lo - start), mem_regions[r].mem + (lo - mem_regions[r].start), hi - lo);
+    }
+
+    for(int c=0; c<ncores; c++){
+        cache_unit* cache = *cores[c].dcache;
+        uint32_t block_size = cache->mdata.block_size;
+        for(uint32_t i=0; i<cache->mdata.sets; i++)
+            for(uint32_t w=0; w<cache->mdata.ways; w++){
+                cache_block* b = &cache->set[i].way[w];
+                if(b->valid && b->dirty)
+                    overlay(out, start, len, block_address(cache, i, b->tag), b->value, block_size);
+            }
+        victim_cache* vc = cache->victim;
+        for(uint32_t v=0; vc && v<vc->entries; v++)
+            if(vc->entry[v].valid && vc->entry[v].dirty)
+                overlay(out, start, len, vc->entry[v].addr, vc->entry[v].value, block_size);
+    }
+}
+
+static uint64_t cache_section_size(cache_unit* cache, uint32_t blocks){
+    return 16 + (uint64_t)blocks * (8 + cache->mdata.block_size);
+}
+
+static uint8_t* put_block(uint8_t* p, uint32_t addr, const cache_block* b, uint32_t block_size){
+    put32(p, addr);
+    put32(p + 4, (b->dirty ? DUMP_DIRTY : 0) | (b->shared ? DUMP_SHARED : 0));
+    p += 8;
+    for(uint32_t off=0; off<block_size; off+=4, p+=4)
+        put32(p, b->value[off]);
+    return p;
+}
+
+static uint8_t* put_cache(uint8_t* p, cache_unit* cache, uint32_t which){
+    uint32_t block_size = cache->mdata.block_size;
+    uint32_t blocks = 0;
+    for(uint32_t i=0; i<cache->mdata.sets; i++)
+        for(uint32_t w=0; w<cache->mdata.ways; w++)
+            blocks += cache->set[i].way[w].valid;
+
+    p = begin_section(p, DUMP_CACHE, cache_section_size(cache, blocks));
+    put32(p, which);
+    put32(p + 4, block_size);
+    put32(p + 8, blocks);
+    put32(p + 12, 0);
+    p += 16;
+    for(uint32_t i=0; i<cache->mdata.sets; i++)
+        for(uint32_t w=0; w<cache->mdata.ways; w++){
+            cache_block* b = &cache->set[i].way[w];
+            if(b->valid)
+                p = put_block(p, block_address(cache, i, b->tag), b, block_size);
+        }
+    return p;
+}
+
+static uint8_t* put_victim(uint8_t* p, cache_unit* cache){
+    victim_cache* vc = cache->victim;
+    uint32_t block_size = cache->mdata.block_size;
+    uint32_t blocks = 0;
+    for(uint32_t v=0; v<vc->entries; v++)
+        blocks += vc->entry[v].valid;
+
+    p = begin_section(p, DUMP_CACHE, cache_section_size(cache, blocks));
+    put32(p, DUMP_VICTIM);
+    put32(p + 4, block_size);
+    put32(p + 8, blocks);
+    put32(p + 12, 0);
+    p += 16;
+    for(uint32_t v=0; v<vc->entries; v++)
+        if(vc->entry[v].valid)
+            p = put_block(p, vc->entry[v].addr, &vc->entry[v], block_size);
+    return p;
+}
+
+bool dump_export(const char* filename, const dump_range* ranges, int nranges){
+    // Every section fits in one buffer sized for full caches
+    uint64_t size = sizeof(dump_header) + sizeof(dump_section) + sizeof(dump_regs);
+    for(int r=0; r<nranges; r++)
+        size += sizeof(dump_section) + 16 + ((uint64_t)(ranges[r].high | 3) - (ranges[r].low & ~3u) + 1);
+    size += 2 * sizeof(dump_section) + cache_section_size(icache, icache->mdata.sets * icache->mdata.ways)
+          + cache_section_size(dcache, dcache->mdata.sets * dcache->mdata.ways);
+    if(dcache->victim)
+        size += sizeof(dump_section) + cache_section_size(dcache, dcache->victim->entries);
+
+    uint8_t* buf = malloc(size);
+    if(buf == NULL){
+        fprintf(stderr, "Error: Can't hold a %llu-byte dump\n", (unsigned long long)size);
+        return false;
+    }
+
+    dump_header h = { DUMP_MAGIC, DUMP_VERSION, 3 + nranges + (dcache->victim != NULL), 0 };
+    memcpy(buf, &h, sizeof(h));
+    uint8_t* p = buf + sizeof(h);
+
+    dump_regs regs;
+    memset(&regs, 0, sizeof(regs));
+    regs.pc = pipe.PC;
+    memcpy(regs.regs, pipe.REGS, sizeof(regs.regs));
+    regs.hi = pipe.HI;
+    regs.lo = pipe.LO;
+    regs.cycles = stat_cycles;
+    regs.retired = stat_inst_retire;
+    p = begin_section(p, DUMP_REGS, sizeof(regs));
+    memcpy(p, &regs, sizeof(regs));
+    p += sizeof(regs);
+
+    for(int r=0; r<nranges; r++){
+        uint32_t start = ranges[r].low & ~3u;
+        uint64_t len = (uint64_t)(ranges[r].high | 3) - start + 1;
+        p = begin_section(p, DUMP_MEM, 16 + len);
+        put32(p, start);
+        put32(p + 4, 0);
+        memcpy(p + 8, &len, 8);
+        read_memory(p + 16, start, len);
+        p += 16 + len;
+    }
+
+    p = put_cache(p, icache, DUMP_ICACHE);
+    p = put_cache(p, dcache, DUMP_DCACHE);
+    if(dcache->victim)
+        p = put_victim(p, dcache);
+
+    FILE* f = fopen(filename, "wb");
+    bool ok = f && fwrite(buf, 1, p - buf, f) == (size_t)(p - buf);
+    if(f && fclose(f) != 0)
+        ok = false;
+    if(!ok)
+        fprintf(stderr, "Error: Can't write dump %s\n", filename);
+    free(buf);
+    return ok;
+}
+
+// A dump read back, with its sections found
+typedef struct{
+    const char* name;
+    uint8_t* data;
+    bool has_regs;
+    dump_regs regs;
+    const uint8_t* mem[DUMP_MAX_RANGES];
+    int nmem;
+    const uint8_t* cache[3];        // by DUMP_CACHE which
+} dump_file;
+
+static bool load(const char* name, dump_file* d){
+    memset(d, 0, sizeof(*d));
+    d->name = name;
+
+    FILE* f = fopen(name, "rb");
+    if(f == NULL){
+        fprintf(stderr, "Error: Can't open dump %s\n", name);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    d->data = malloc(size > 0 ? size : 1);
+    bool ok = size >= (long)sizeof(dump_header) && fread(d->data, 1, size, f) == (size_t)size;
+    fclose(f);
+
+    dump_header h;
+    if(ok){
+        memcpy(&h, d->data, sizeof(h));
+        ok = h.magic == DUMP_MAGIC && h.version == DUMP_VERSION;
+    }
+
+    uint64_t at = sizeof(dump_header);
+    for(uint32_t s=0; ok && s<h.nsections; s++){
+        dump_section sec;
+        if(at + sizeof(sec) > (uint64_t)size){
+            ok = false;
+            break;
+        }
+        memcpy(&sec, d->data + at, sizeof(sec));
+        at += sizeof(sec);
+        if(at + sec.size > (uint64_t)size){
+            ok = false;
+            break;
+        }
+        const uint8_t* body = d->data + at;
+        if(sec.type == DUMP_REGS && sec.size == sizeof(dump_regs)){
+            memcpy(&d->regs, body, sizeof(dump_regs));
+            d->has_regs = true;
+        }
+        else if(sec.type == DUMP_MEM && d->nmem < DUMP_MAX_RANGES){
+            // The length must be what the section holds, or the diff
+            // would read past it
+            uint64_t len;
+            if(sec.size < 16){
+                ok = false;
+                break;
+            }
+            memcpy(&len, body + 8, 8);
+            if(len != sec.size - 16){
+                ok = false;
+                break;
+            }
+            d->mem[d->nmem++] = body;
+        }
+        else if(sec.type == DUMP_CACHE){
+            if(sec.size < 16 || get32(body) >= 3 ||
+               (uint64_t)get32(body + 8) * (8 + (uint64_t)get32(body + 4)) > sec.size - 16){
+                ok = false;
+                break;
+            }
+            d->cache[get32(body)] = body;
+        }
+        at += sec.size;
+    }
+
+    if(!ok || !d->has_regs){
+        fprintf(stderr, "Error: %s is not a version %d dump\n", name, DUMP_VERSION);
+        free(d->data);
+        return false;
+    }
+    return true;
+}
+
+static int diff_regs(const dump_regs* a, const dump_regs* b, FILE* out){
+    int n = 0;
+    if(a->pc != b->pc){
+        fprintf(out, "PC 0x%08x 0x%08x\n", a->pc, b->pc);
+        n++;
+    }
+    for(int i=0; i<32; i++)
+        if(a->regs[i] != b->regs[i]){
+            fprintf(out, "R%d 0x%08x 0x%08x\n", i, a->regs[i], b->regs[i]);
+            n++;
+        }
+    if(a->hi != b->hi){
+        fprintf(out, "HI 0x%08x 0x%08x\n", a->hi, b->hi);
+        n++;
+    }
+    if(a->lo != b->lo){
+        fprintf(out, "LO 0x%08x 0x%08x\n", a->lo, b->lo);
+        n++;
+    }
+    return n;
+}
+
+// Count the words that differ, listing the first few; equal pages are
+// skipped with one memcmp each
+static int diff_mem(const uint8_t* a, const uint8_t* b, FILE* out){
+    uint32_t start = get32(a), start_b = get32(b);
+    uint64_t len, len_b;
+    memcpy(&len, a + 8, 8);
+    memcpy(&len_b, b + 8, 8);
+    if(start != start_b || len != len_b){
+        fprintf(out, "memory 0x%08x+%llu vs 0x%08x+%llu: different ranges\n",
+                start, (unsigned long long)len, start_b, (unsigned long long)len_b);
+        return 1;
+    }
+
+    const uint8_t *pa = a + 16, *pb = b + 16;
+    uint64_t words = 0;
+    for(uint64_t off=0; off<len; off+=4096){
+        uint64_t n = len - off < 4096 ? len - off : 4096;
+        if(memcmp(pa + off, pb + off, n) == 0)
+            continue;
+        for(uint64_t k=off; k<off+n; k+=4){
+            uint32_t va = get32(pa + k), vb = get32(pb + k);
+            if(va == vb)
+                continue;
+            if(words < DIFF_SHOWN)
+                fprintf(out, "  0x%08llx: 0x%08x 0x%08x\n", (unsigned long long)(start + k), va, vb);
+            words++;
+        }
+    }
+    if(words)
+        fprintf(out, "memory 0x%08x..0x%08llx: %llu words differ%s\n", start,
+                (unsigned long long)(start + len - 1), (unsigned long long)words,
+                words > DIFF_SHOWN ? " (first ones above)" : "");
+    return words > 0x7fffffff ? 0x7fffffff : (int)words;
+}
+
+static const char* cache_names[3] = { "icache", "dcache", "victim cache" };
+
+static int cmp_block(const void* x, const void* y){
+    uint32_t a = get32(*(const uint8_t* const*)x), b = get32(*(const uint8_t* const*)y);
+    return a < b ? -1 : a > b;
+}
+
+static const uint8_t** sorted_blocks(const uint8_t* c, uint32_t* count, uint32_t* entry){
+    *count = get32(c + 8);
+    *entry = 8 + get32(c + 4);
+    const uint8_t** blocks = malloc((*count ? *count : 1) * sizeof(uint8_t*));
+    for(uint32_t i=0; i<*count; i++)
+        blocks[i] = c + 16 + (uint64_t)i * *entry;
+    qsort(blocks, *count, sizeof(uint8_t*), cmp_block);
+    return blocks;
+}
+
+// Blocks held by only one side, and blocks held by both with other data
+// or state. Like the cycle count, this is reported but not a difference:
+// other cache policies or core models end with other contents for the
+// same results.
+static void diff_cache(int which, const uint8_t* a, const uint8_t* b, FILE* out){
+    if(a == NULL || b == NULL){
+        if(a || b)
+            fprintf(out, "(%s only in one dump)\n", cache_names[which]);
+        return;
+    }
+
+    uint32_t na, nb, ea, eb;
+    const uint8_t** ba = sorted_blocks(a, &na, &ea);
+    const uint8_t** bb = sorted_blocks(b, &nb, &eb);
+    uint32_t only_a = 0, only_b = 0, changed = 0;
+    uint32_t i = 0, j = 0;
+    while(i < na || j < nb){
+        if(j == nb || (i < na && get32(ba[i]) < get32(bb[j]))){
+            only_a++;
+            i++;
+        }
+        else if(i == na || get32(bb[j]) < get32(ba[i])){
+            only_b++;
+            j++;
+        }
+        else{
+            if(ea != eb || memcmp(ba[i], bb[j], ea) != 0)
+                changed++;
+            i++;
+            j++;
+        }
+    }
+    free(ba);
+    free(bb);
+
+    if(only_a || only_b || changed)
+        fprintf(out, "(%s: %u blocks only in the first, %u only in the second, %u with other contents)\n",
+                cache_names[which], only_a, only_b, changed);
+}
+
+int dump_diff(const char* a, const char* b, FILE* out){
+    dump_file da, db;
+    if(!load(a, &da))
+        return -1;
+    if(!load(b, &db)){
+        free(da.data);
+        return -1;
+    }
+
+    int n = diff_regs(&da.regs, &db.regs, out);
+    if(da.nmem != db.nmem){
+        fprintf(out, "memory: %d ranges vs %d\n", da.nmem, db.nmem);
+        n++;
+    }
+    for(int r=0; r<da.nmem && r<db.nmem; r++)
+        n += diff_mem(da.mem[r], db.mem[r], out);
+
+    // Cache contents and timing are not results; only mention them
+    for(int c=0; c<3; c++)
+        diff_cache(c, da.cache[c], db.cache[c], out);
+    if(da.regs.cycles != db.regs.cycles || da.regs.retired != db.regs.retired)
+        fprintf(out, "(cycles %llu vs %llu, retired %llu vs %llu)\n",
+                (unsigned long long)da.regs.cycles, (unsigned long long)db.regs.cycles,
+                (unsigned long long)da.regs.retired, (unsigned long long)db.regs.retired);
+    fprintf(out, n ? "%d differences\n" : "dumps match\n", n);
+
+    free(da.data);
+    free(db.data);
+    return n;
+}
@@ -0,0 +1,80 @@
+/************************************/
+/*                                  */
+/*      Binary State Dumps          */
+/*                                  */
+/************************************/
+
+#ifndef _DUMP_H
+#define _DUMP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// A dump holds the registers, memory ranges and the contents of core 0's
+// caches, written to a file in one write (mdump prints a line per word).
+// Memory is what the program sees: dirty dcache and victim cache blocks
+// are laid over the backing memory. 'sim --diff a b' compares two dumps.
+//
+// Layout, little-endian: a dump_header, then 'nsections' sections, each a
+// dump_section followed by 'size' bytes:
+//   DUMP_REGS   a dump_regs
+//   DUMP_MEM    uint32 start, uint32 reserved, uint64 length, the bytes
+//   DUMP_CACHE  uint32 which (DUMP_ICACHE...), uint32 block_size,
+//               uint32 blocks, uint32 reserved, then per valid block:
+//               uint32 address, uint32 flags (DUMP_DIRTY...), the block
+
+#define DUMP_MAGIC   0x504d444d     // "MDMP"
+#define DUMP_VERSION 1
+
+// dump_section.type
+#define DUMP_REGS  1
+#define DUMP_MEM   2
+#define DUMP_CACHE 3
+
+// DUMP_CACHE which
+#define DUMP_ICACHE 0
+#define DUMP_DCACHE 1
+#define DUMP_VICTIM 2
+
+// DUMP_CACHE block flags
+#define DUMP_DIRTY  0x1
+#define DUMP_SHARED 0x2
+
+typedef struct{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nsections;
+    uint32_t reserved;
+} dump_header;
+
+typedef struct{
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t size;
+} dump_section;
+
+typedef struct{
+    uint32_t pc;
+    uint32_t regs[32];
+    uint32_t hi, lo;
+    uint32_t reserved;
+    uint64_t cycles, retired;
+} dump_regs;
+
+// Bytes low..high, both included; dumps round them out to whole words
+typedef struct{
+    uint32_t low, high;
+} dump_range;
+
+#define DUMP_MAX_RANGES 64
+
+// False (with a message on stderr) if the file can't be written
+bool dump_export(const char* filename, const dump_range* ranges, int nranges);
+
+// Print how dumps 'a' and 'b' differ; returns the number of differences
+// in registers and memory, or -1 if either can't be read. Cache contents
+// and cycle counts are printed but not counted.
+int dump_diff(const char* a, const char* b, FILE* out);
+
+#endif
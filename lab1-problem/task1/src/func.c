@@ -0,0 +1,47 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "func.h"
+#include "pipe.h"
+#include "shell.h"
+#include "mips.h"
+
+void func_init(func_state* s){
+    memset(s, 0, sizeof(func_state));
+    s->PC = MEM_TEXT_START;
+}
+
+void func_decode(Pipe_Op* op, uint32_t pc){
+    memset(op, 0, sizeof(Pipe_Op));
+    op->reg_src1 = op->reg_src2 = op->reg_dst = -1;
+    op->pc = pc;
+    op->instruction = mem_read_32(pc);
+    pipe_decode_op(op);
+}
+
+void func_execute(Pipe_Op* op, uint32_t* hi, uint32_t* lo){
+    pipe_alu(op, hi, lo);
+
+    if(op->is_mem){
+        uint32_t addr = op->mem_addr & ~3;
+        uint32_t word = mem_read_32(addr);
+        if(op->mem_write)
+            mem_write_32(addr, pipe_store_word(op, word));
+        else
+            op->reg_dst_value = pipe_load_value(op, word);
+    }
+}
+
+void func_step(func_state* s, Pipe_Op* op){
+    func_decode(op, s->PC);
+    if(op->reg_src1 > 0) op->reg_src1_value = s->REGS[op->reg_src1];
+    if(op->reg_src2 > 0) op->reg_src2_value = s->REGS[op->reg_src2];
+    func_execute(op, &s->HI, &s->LO);
+
+    if(op->reg_dst > 0)
+        s->REGS[op->reg_dst] = op->reg_dst_value;
+
+    s->PC = func_next_pc(op);
+    if(func_halts(op))
+        s->halted = true;
+}
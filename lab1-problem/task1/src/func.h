@@ -0,0 +1,49 @@
+/************************************/
+/*                                  */
+/*      Functional Simulation       */
+/*                                  */
+/************************************/
+
+#ifndef _FUNC_H
+#define _FUNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pipe.h"
+#include "mips.h"
+
+// Architectural state of a program run without timing
+typedef struct{
+    uint32_t PC;
+    uint32_t REGS[32];
+    uint32_t HI, LO;
+    bool halted;
+} func_state;
+
+// Start of a program (the state pipe_init gives the timing models)
+void func_init(func_state*);
+
+// Execute one instruction straight against memory, with the same decode
+// and ALU code as the pipeline. 'op' is filled in with what the
+// instruction did (registers, memory address, branch outcome).
+void func_step(func_state*, Pipe_Op* op);
+
+// The parts of func_step(), for models that keep the registers their own
+// way (lockstep.c). func_decode() fetches and decodes the instruction at
+// 'pc'; with the source values then filled in, func_execute() computes
+// the result and does the memory access.
+void func_decode(Pipe_Op* op, uint32_t pc);
+void func_execute(Pipe_Op* op, uint32_t* hi, uint32_t* lo);
+
+// Where an executed instruction goes next; like the pipeline, a halted
+// program's PC points past the syscall
+static inline uint32_t func_next_pc(const Pipe_Op* op){
+    return op->branch_taken ? op->branch_dest : op->pc + 4;
+}
+
+// Whether it was the exit syscall
+static inline bool func_halts(const Pipe_Op* op){
+    return op->opcode == OP_SPECIAL && op->subop == SUBOP_SYSCALL && op->reg_src1_value == 0xA;
+}
+
+#endif
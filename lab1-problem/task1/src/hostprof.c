@@ -0,0 +1,76 @@
+#include "hostprof.h"
+
+#ifdef HOST_PROFILE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+static const char* names[HP_NCOMPONENTS] = {
+    "fetch", "decode", "execute", "mem", "wb",
+    "ooo_commit", "ooo_issue", "ooo_dispatch", "ooo_fetch",
+    "cache_read", "cache_write", "fill_block", "evict_block",
+    "memory", "dram", "tlb"
+};
+
+CORE_LOCAL hostprof_table* hostprof = NULL;
+
+// Every thread's table, for the report (interval runs start a thread
+// per host CPU)
+#define MAX_TABLES 1024
+static hostprof_table* tables[MAX_TABLES];
+static int ntables = 0;
+static pthread_mutex_t tables_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t started;
+
+hostprof_table* hostprof_register(){
+    hostprof = calloc(1, sizeof(hostprof_table));
+    pthread_mutex_lock(&tables_lock);
+    if(ntables < MAX_TABLES)
+        tables[ntables++] = hostprof;
+    pthread_mutex_unlock(&tables_lock);
+    return hostprof;
+}
+
+static void hostprof_print(){
+    uint64_t elapsed = hostprof_now() - started;
+    uint64_t self[HP_NCOMPONENTS] = { 0 }, calls[HP_NCOMPONENTS] = { 0 };
+    uint64_t probed = 0;
+
+    pthread_mutex_lock(&tables_lock);
+    for(int t=0; t<ntables; t++){
+        for(int c=0; c<HP_NCOMPONENTS; c++){
+            self[c] += tables[t]->self[c];
+            calls[c] += tables[t]->calls[c];
+            probed += tables[t]->self[c];
+        }
+    }
+    int threads = ntables;
+    pthread_mutex_unlock(&tables_lock);
+
+    // With one thread the rest of the run (the cycle loop, the shell,
+    // loading) is the elapsed time the probes did not see
+    uint64_t total = probed;
+    if(threads <= 1 && elapsed > probed)
+        total = elapsed;
+
+    fprintf(stderr, "Host time by component (%d thread%s, exclusive host cycles):\n",
+            threads, threads == 1 ? "" : "s");
+    for(int c=0; c<HP_NCOMPONENTS; c++){
+        if(calls[c] == 0)
+            continue;
+        fprintf(stderr, "  %-13s %14" PRIu64 " %5.1f%% %12" PRIu64 " calls %8.1f/call\n", names[c],
+                self[c], total ? 100.0 * self[c] / total : 0.0, calls[c], (double)self[c] / calls[c]);
+    }
+    if(total > probed)
+        fprintf(stderr, "  %-13s %14" PRIu64 " %5.1f%%\n", "other", total - probed,
+                100.0 * (total - probed) / total);
+}
+
+void hostprof_start(){
+    started = hostprof_now();
+    atexit(hostprof_print);
+}
+
+#endif
@@ -0,0 +1,92 @@
+/************************************/
+/*                                  */
+/*      Host-Time Profiling         */
+/*                                  */
+/************************************/
+
+#ifndef _HOSTPROF_H
+#define _HOSTPROF_H
+
+#include <stdint.h>
+#include "shell.h"
+
+// Built with -DHOST_PROFILE (make sim-hostprof), the simulator reads the
+// host cycle counter around its components and prints at exit where the
+// host time went. Time is exclusive: a miss's fill_block() counts toward
+// fill_block, not toward the cache_read() or pipeline stage around it.
+// Without HOST_PROFILE the probes compile to nothing.
+
+enum{
+    HP_FETCH, HP_DECODE, HP_EXECUTE, HP_MEM, HP_WB,                 // in-order stages
+    HP_OOO_COMMIT, HP_OOO_ISSUE, HP_OOO_DISPATCH, HP_OOO_FETCH,     // ooo stages
+    HP_CACHE_READ, HP_CACHE_WRITE, HP_FILL, HP_EVICT,
+    HP_MEMORY,      // mem_read_32() / mem_write_32()
+    HP_DRAM,
+    HP_TLB,
+    HP_NCOMPONENTS
+};
+
+#ifdef HOST_PROFILE
+
+#define HOSTPROF_DEPTH 32
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t hostprof_now(){ return __rdtsc(); }
+#else
+#include <time.h>
+static inline uint64_t hostprof_now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+// One per thread, kept after the thread exits
+typedef struct{
+    uint64_t self[HP_NCOMPONENTS];      // host cycles, nested components excluded
+    uint64_t calls[HP_NCOMPONENTS];
+    int depth;
+    int stack[HOSTPROF_DEPTH];
+    uint64_t start[HOSTPROF_DEPTH];
+    uint64_t nested[HOSTPROF_DEPTH];    // cycles of components inside this one
+} hostprof_table;
+
+extern CORE_LOCAL hostprof_table* hostprof;
+
+hostprof_table* hostprof_register();    // the calling thread's first probe
+void hostprof_start();                  // from main(); prints the breakdown at exit
+
+static inline void hostprof_enter(int component){
+    hostprof_table* t = hostprof ? hostprof : hostprof_register();
+    int d = t->depth++;
+    t->stack[d] = component;
+    t->nested[d] = 0;
+    t->start[d] = hostprof_now();
+}
+
+static inline void hostprof_leave(){
+    uint64_t now = hostprof_now();
+    hostprof_table* t = hostprof;
+    int d = --t->depth;
+    uint64_t total = now - t->start[d];
+
+    t->self[t->stack[d]] += total - t->nested[d];
+    t->calls[t->stack[d]]++;
+    if(d > 0)
+        t->nested[d - 1] += total;
+}
+
+#define HOSTPROF_ENTER(c) hostprof_enter(c)
+#define HOSTPROF_LEAVE()  hostprof_leave()
+#define HOSTPROF_START()  hostprof_start()
+
+#else
+
+#define HOSTPROF_ENTER(c)
+#define HOSTPROF_LEAVE()
+#define HOSTPROF_START()
+
+#endif
+
+#endif
@@ -0,0 +1,385 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/sysinfo.h>
+#include "interval.h"
+#include "func.h"
+#include "pipe.h"
+#include "shell.h"
+#include "stats.h"
+#include "simpoint.h"
+#include "dram.h"
+#include "tlb.h"
+
+uint64_t interval_length = 0;
+uint64_t interval_warmup = 100000;
+int interval_threads = 0;
+
+// The end of the warm-up runs in detail to fill the pipeline; before that,
+// instructions run functionally and only their cache accesses are modeled
+#define DETAILED_WARMUP 1000
+
+#define PAGE_BITS MEM_PAGE_BITS
+#define PAGE_SIZE (1u << PAGE_BITS)
+
+// A page of memory as it was when a checkpoint was taken
+typedef struct{
+    int region;
+    uint32_t page;
+    uint8_t* data;
+} page_copy;
+
+typedef struct{
+    func_state state;       // architectural state where simulation starts
+    uint64_t warmup;        // instructions before the interval proper
+    uint64_t length;        // instructions in the interval (UINT64_MAX: to the end)
+
+    // Pages written since the previous checkpoint: the initial memory plus
+    // the pages of checkpoints 0..i give the memory of checkpoint i
+    page_copy* pages;
+    int npages;
+
+    // Detailed results
+    uint64_t cycles, retired, fetched, squash;
+    uint64_t cpi[CPI_NCAUSES];
+} checkpoint;
+
+static checkpoint* ckpts;
+static int nckpts;
+static uint8_t* initial[MEM_NREGIONS];     // memory before the program ran
+static uint8_t* dirty[MEM_NREGIONS];       // one flag per page
+static uint8_t* used[MEM_NREGIONS];        // page nonzero at some point of the run
+
+// The checkpoints simulated in detail (all of them, or the SimPoints) in
+// program order, and the share of the program each one stands for
+static int* sel;
+static double* sel_weight;
+static int nsel;
+
+static pthread_mutex_t next_lock = PTHREAD_MUTEX_INITIALIZER;
+static int next_sel;
+
+static double now_seconds(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void mark_dirty(uint32_t addr){
+    for(int r=0; r<MEM_NREGIONS; r++){
+        if(addr >= MEM_REGIONS[r].start && addr < MEM_REGIONS[r].start + MEM_REGIONS[r].size){
+            uint32_t p = (addr - MEM_REGIONS[r].start) >> PAGE_BITS;
+            dirty[r][p] = used[r][p] = 1;
+            return;
+        }
+    }
+}
+
+// Regions can be large and mostly untouched: copying only the pages the
+// program uses keeps the rest of the destination unallocated
+static void copy_used(uint8_t* dst, const uint8_t* src, int r){
+    for(uint32_t p=0; p < MEM_REGIONS[r].size >> PAGE_BITS; p++)
+        if(used[r][p])
+            memcpy(dst + (p << PAGE_BITS), src + (p << PAGE_BITS), PAGE_SIZE);
+}
+
+static void take_checkpoint(func_state* s, uint64_t warmup){
+    ckpts = realloc(ckpts, (nckpts + 1) * sizeof(checkpoint));
+    checkpoint* c = &ckpts[nckpts++];
+    memset(c, 0, sizeof(checkpoint));
+    c->state = *s;
+    c->warmup = warmup;
+    c->length = interval_length;
+
+    for(int r=0; r<MEM_NREGIONS; r++){
+        for(uint32_t p=0; p < MEM_REGIONS[r].size >> PAGE_BITS; p++){
+            if(!dirty[r][p])
+                continue;
+            dirty[r][p] = 0;
+            c->pages = realloc(c->pages, (c->npages + 1) * sizeof(page_copy));
+            page_copy* pc = &c->pages[c->npages++];
+            pc->region = r;
+            pc->page = p;
+            pc->data = malloc(PAGE_SIZE);
+            memcpy(pc->data, MEM_REGIONS[r].mem + (p << PAGE_BITS), PAGE_SIZE);
+        }
+    }
+}
+
+// Functional pass over the whole program. Interval i starts at instruction
+// i*K; its checkpoint is taken 'warmup' instructions earlier.
+static uint64_t functional_pass(func_state* s){
+    uint64_t n = 0;
+    uint64_t next = 0;      // first instruction of the next interval
+    Pipe_Op op;
+
+    func_init(s);
+    if(simpoint_k)
+        bbv_start();
+    while(!s->halted){
+        while(next - (next < interval_warmup ? next : interval_warmup) == n){
+            take_checkpoint(s, next < interval_warmup ? next : interval_warmup);
+            next += interval_length;
+        }
+        if(simpoint_k && n && n % interval_length == 0)
+            bbv_end_interval();
+        func_step(s, &op);
+        if(op.is_mem && op.mem_write)
+            mark_dirty(op.mem_addr);
+        if(simpoint_k)
+            bbv_step(&op);
+        n++;
+    }
+    if(simpoint_k)
+        bbv_end_interval();
+
+    // Drop checkpoints for intervals the program did not reach; the last
+    // interval runs to the end
+    while(nckpts > 1 && (nckpts - 1) * interval_length >= n)
+        nckpts--;
+    ckpts[nckpts - 1].length = UINT64_MAX;
+    return n;
+}
+
+static void simulate(checkpoint* c){
+    func_state s = c->state;
+    uint64_t functional = c->warmup > DETAILED_WARMUP ? c->warmup - DETAILED_WARMUP : 0;
+    Pipe_Op op;
+
+    pipe_init();
+    for(uint64_t n=0; n<functional; n++){
+        if(itlb) tlb_translate(itlb, s.PC);
+        cache_read(icache, s.PC);
+        func_step(&s, &op);
+        if(op.is_mem){
+            // Memory already holds the stored word; keep the cached copy equal
+            uint32_t addr = op.mem_addr & ~3;
+            if(dtlb) tlb_translate(dtlb, addr);
+            if(op.mem_write)
+                cache_write(dcache, addr, mem_read_32(addr), BYTES_ALL);
+            else
+                cache_read(dcache, addr);
+        }
+    }
+
+    // The warm-up left the DRAM rows open, not its banks busy
+    dram_reset_timing();
+    RUN_BIT = TRUE;
+    stat_cycles = stat_inst_retire = stat_inst_fetch = stat_squash = 0;
+    pipe.PC = s.PC;
+    memcpy(pipe.REGS, s.REGS, sizeof(pipe.REGS));
+    pipe.HI = s.HI;
+    pipe.LO = s.LO;
+
+    while(RUN_BIT && stat_inst_retire < c->warmup - functional)
+        cycle_skip(UINT64_MAX);
+
+    uint64_t cycles = stat_cycles, retired = stat_inst_retire;
+    uint64_t fetched = stat_inst_fetch, squash = stat_squash;
+    uint64_t cpi[CPI_NCAUSES];
+    memcpy(cpi, cpi_stack, sizeof(cpi));
+
+    while(RUN_BIT && stat_inst_retire - retired < c->length)
+        cycle_skip(UINT64_MAX);
+
+    c->cycles = stat_cycles - cycles;
+    c->retired = stat_inst_retire - retired;
+    c->fetched = stat_inst_fetch - fetched;
+    c->squash = stat_squash - squash;
+    for(int k=0; k<CPI_NCAUSES; k++)
+        c->cpi[k] = cpi_stack[k] - cpi[k];
+}
+
+// Each worker keeps its own memory: 'base' follows the checkpoints forward
+// and every interval runs on a fresh copy of it, since detailed simulation
+// writes memory past the end of its interval.
+static void* interval_worker(void* arg){
+    mem_region_t base[MEM_NREGIONS], work[MEM_NREGIONS];
+    int at = -1;
+
+    for(int r=0; r<MEM_NREGIONS; r++){
+        base[r] = work[r] = MEM_REGIONS[r];
+        base[r].mem = mem_alloc(MEM_REGIONS[r].size);
+        work[r].mem = mem_alloc(MEM_REGIONS[r].size);
+        copy_used(base[r].mem, initial[r], r);
+    }
+    mem_regions = work;
+
+    for(;;){
+        pthread_mutex_lock(&next_lock);
+        int next = next_sel++;
+        pthread_mutex_unlock(&next_lock);
+        if(next >= nsel)
+            break;
+        int i = sel[next];
+
+        for(at++; at <= i; at++)
+            for(int k=0; k<ckpts[at].npages; k++){
+                page_copy* pc = &ckpts[at].pages[k];
+                memcpy(base[pc->region].mem + (pc->page << PAGE_BITS), pc->data, PAGE_SIZE);
+            }
+        at = i;
+
+        for(int r=0; r<MEM_NREGIONS; r++)
+            copy_used(work[r].mem, base[r].mem, r);
+        simulate(&ckpts[i]);
+    }
+
+    for(int r=0; r<MEM_NREGIONS; r++){
+        mem_free(base[r].mem, MEM_REGIONS[r].size);
+        mem_free(work[r].mem, MEM_REGIONS[r].size);
+    }
+    return NULL;
+}
+
+void interval_run(bool check){
+    int threads = interval_threads;
+    if(threads <= 0)
+        threads = get_nprocs();
+    if(threads <= 0)
+        threads = 1;
+
+    for(int r=0; r<MEM_NREGIONS; r++){
+        uint32_t npages = MEM_REGIONS[r].size >> PAGE_BITS;
+        initial[r] = mem_alloc(MEM_REGIONS[r].size);
+        dirty[r] = calloc(npages, 1);
+        used[r] = calloc(npages, 1);
+        mem_used_pages(MEM_REGIONS[r].mem, MEM_REGIONS[r].size, used[r]);
+        copy_used(initial[r], MEM_REGIONS[r].mem, r);
+    }
+
+    double t0 = now_seconds();
+    func_state final;
+    uint64_t insts = functional_pass(&final);
+    double t1 = now_seconds();
+
+    sel = malloc(nckpts * sizeof(int));
+    sel_weight = malloc(nckpts * sizeof(double));
+    if(simpoint_k)
+        nsel = simpoint_pick(sel, sel_weight);
+    else{
+        for(int i=0; i<nckpts; i++)
+            sel[i] = i;
+        nsel = nckpts;
+    }
+
+    next_sel = 0;
+    pthread_t* pool = malloc(threads * sizeof(pthread_t));
+    for(int t=0; t<threads; t++)
+        pthread_create(&pool[t], NULL, interval_worker, NULL);
+    for(int t=0; t<threads; t++)
+        pthread_join(pool[t], NULL);
+    free(pool);
+    double t2 = now_seconds();
+
+    // Stitch the intervals together. SimPoints are scaled up by weight:
+    // each per-instruction rate is weighted and applied to the whole run.
+    uint64_t cycles = 0, retired = 0, fetched = 0, squash = 0;
+    uint64_t cpi[CPI_NCAUSES] = { 0 };
+    int pages = 0;
+    for(int i=0; i<nckpts; i++)
+        pages += ckpts[i].npages;
+    if(simpoint_k){
+        double c = 0, f = 0, q = 0, stack[CPI_NCAUSES] = { 0 };
+        for(int p=0; p<nsel; p++){
+            checkpoint* ck = &ckpts[sel[p]];
+            double w = sel_weight[p] / ck->retired;
+            c += w * ck->cycles;
+            f += w * ck->fetched;
+            q += w * ck->squash;
+            for(int k=0; k<CPI_NCAUSES; k++)
+                stack[k] += w * ck->cpi[k];
+        }
+        cycles = c * insts + 0.5;
+        retired = insts;
+        fetched = f * insts + 0.5;
+        squash = q * insts + 0.5;
+        for(int k=0; k<CPI_NCAUSES; k++)
+            cpi[k] = stack[k] * insts + 0.5;
+    }
+    else{
+        for(int i=0; i<nckpts; i++){
+            cycles += ckpts[i].cycles;
+            retired += ckpts[i].retired;
+            fetched += ckpts[i].fetched;
+            squash += ckpts[i].squash;
+            for(int k=0; k<CPI_NCAUSES; k++)
+                cpi[k] += ckpts[i].cpi[k];
+        }
+    }
+
+    bool report = !QUIET || check;
+    if(report){
+        printf("Interval simulation: %d intervals of %" PRIu64 " instructions, %" PRIu64
+               " warm-up, %d threads\n", nckpts, interval_length, interval_warmup, threads);
+        printf("  functional pass: %" PRIu64 " instructions in %.3f s, %d pages checkpointed\n",
+               insts, t1 - t0, pages);
+        if(simpoint_k){
+            printf("  simpoints:       %d of %d intervals (interval/weight):", nsel, nckpts);
+            for(int p=0; p<nsel; p++)
+                printf(" %d/%.3f", sel[p], sel_weight[p]);
+            printf("\n");
+        }
+        printf("  detailed pass:   %" PRIu64 " cycles in %.3f s\n", cycles, t2 - t1);
+        if(retired != insts)
+            printf("  warning: intervals retired %" PRIu64 " instructions\n", retired);
+    }
+
+    // Full detailed run from the initial memory for comparison
+    if(check){
+        for(int r=0; r<MEM_NREGIONS; r++)
+            copy_used(MEM_REGIONS[r].mem, initial[r], r);
+        pipe_init();
+        RUN_BIT = TRUE;
+        stat_cycles = stat_inst_retire = stat_inst_fetch = stat_squash = 0;
+        while(RUN_BIT)
+            cycle_skip(UINT64_MAX);
+        double t3 = now_seconds();
+
+        double error = 100.0 * ((double)cycles - (double)stat_cycles) / stat_cycles;
+        printf("  full run:        %" PRIu64 " cycles in %.3f s\n", stat_cycles, t3 - t2);
+        printf("  error:           %+.3f%% cycles, %.2fx faster\n", error,
+               (t3 - t2) / (t2 - t0));
+        printf("    %-10s %12s %12s\n", "cpi", "estimate", "full");
+        for(int k=0; k<CPI_NCAUSES; k++)
+            printf("    %-10s %12" PRIu64 " %12" PRIu64 "\n", cpi_names[k], cpi[k], cpi_stack[k]);
+    }
+    if(report)
+        printf("\n");
+
+    // Leave the final state and the estimate where rdump and the JSON
+    // statistics look for them
+    pipe.PC = final.PC;
+    memcpy(pipe.REGS, final.REGS, sizeof(pipe.REGS));
+    pipe.HI = final.HI;
+    pipe.LO = final.LO;
+    RUN_BIT = FALSE;
+    stat_cycles = cycles;
+    stat_inst_retire = retired;
+    stat_inst_fetch = fetched;
+    stat_squash = squash;
+    memcpy(cpi_stack, cpi, sizeof(cpi));
+
+    for(int i=0; i<nckpts; i++){
+        for(int k=0; k<ckpts[i].npages; k++)
+            free(ckpts[i].pages[k].data);
+        free(ckpts[i].pages);
+    }
+    free(ckpts);
+    ckpts = NULL;
+    nckpts = 0;
+    free(sel);
+    free(sel_weight);
+    if(simpoint_k)
+        bbv_free();
+    for(int r=0; r<MEM_NREGIONS; r++){
+        mem_free(initial[r], MEM_REGIONS[r].size);
+        free(dirty[r]);
+        free(used[r]);
+    }
+}
@@ -0,0 +1,26 @@
+/************************************/
+/*                                  */
+/*      Interval Simulation         */
+/*                                  */
+/************************************/
+
+#ifndef _INTERVAL_H
+#define _INTERVAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Sampled-parallel simulation of one program: a functional run drops a
+// checkpoint every 'interval_length' instructions, then a pool of threads
+// simulates the intervals in detail, each after 'interval_warmup'
+// instructions of warm-up, and the per-interval statistics are summed.
+extern uint64_t interval_length;    // 0: off
+extern uint64_t interval_warmup;
+extern int interval_threads;
+
+// Run the loaded program this way. Leaves the final architectural state
+// and the summed statistics in core 0. With 'check', also run the whole
+// program in detail and report the error of the estimate.
+void interval_run(bool check);
+
+#endif
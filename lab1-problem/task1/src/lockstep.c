@@ -0,0 +1,249 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include "lockstep.h"
+#include "func.h"
+#include "pipe.h"
+#include "shell.h"
+#include "mips.h"
+
+#define L LOCKSTEP_LANES
+
+// ALU functions computed for all lanes at once; ALU_NONE marks a lane
+// whose op runs on its own
+#define ALU_NONE 0
+#define ALU_ADD  1
+#define ALU_SUB  2
+#define ALU_AND  3
+#define ALU_OR   4
+#define ALU_XOR  5
+#define ALU_NOR  6
+#define ALU_SLT  7
+#define ALU_SLTU 8
+#define ALU_SLL  9
+#define ALU_SRL  10
+#define ALU_SRA  11
+
+// The lanes, as arrays indexed by lane
+typedef struct{
+    int program[L];             // running, or -1: idle
+    uint32_t pc[L];
+    uint32_t regs[32][L];       // regs[r] holds register r of every lane
+    uint32_t hi[L], lo[L];
+    uint64_t retired[L];
+    bool halted[L];
+
+    // The step's ops: decoded, and the plain ALU ones as operands
+    Pipe_Op op[L];
+    uint32_t fn[L], a[L], b[L], result[L];
+
+    mem_region_t mem[L][MEM_NREGIONS];
+} lanes;
+
+// A program's final state
+typedef struct{
+    func_state state;
+    uint64_t retired;
+} outcome;
+
+// Whether 'op' is a plain ALU op, and its operands if so
+static uint32_t alu_function(Pipe_Op* op, uint32_t* a, uint32_t* b){
+    uint32_t s1 = op->reg_src1_value, s2 = op->reg_src2_value;
+
+    switch(op->opcode){
+    case OP_SPECIAL:
+        *a = s1;
+        *b = s2;
+        switch(op->subop){
+        case SUBOP_ADD: case SUBOP_ADDU: return ALU_ADD;
+        case SUBOP_SUB: case SUBOP_SUBU: return ALU_SUB;
+        case SUBOP_AND: return ALU_AND;
+        case SUBOP_OR:  return ALU_OR;
+        case SUBOP_XOR: return ALU_XOR;
+        case SUBOP_NOR: return ALU_NOR;
+        case SUBOP_SLT: return ALU_SLT;
+        case SUBOP_SLTU: return ALU_SLTU;
+        }
+        // Shifts move rt by shamt, or by rs for the V forms (bit 2 set)
+        *a = s2;
+        *b = (op->subop & 4 ? s1 : op->shamt) & 31;
+        switch(op->subop){
+        case SUBOP_SLL: case SUBOP_SLLV: return ALU_SLL;
+        case SUBOP_SRL: case SUBOP_SRLV: return ALU_SRL;
+        case SUBOP_SRA: case SUBOP_SRAV: return ALU_SRA;
+        }
+        return ALU_NONE;
+    case OP_ADDI: case OP_ADDIU: *a = s1; *b = op->se_imm16; return ALU_ADD;
+    case OP_SLTI:  *a = s1; *b = op->se_imm16; return ALU_SLT;
+    case OP_SLTIU: *a = s1; *b = op->se_imm16; return ALU_SLTU;
+    case OP_ANDI:  *a = s1; *b = op->imm16; return ALU_AND;
+    case OP_ORI:   *a = s1; *b = op->imm16; return ALU_OR;
+    case OP_XORI:  *a = s1; *b = op->imm16; return ALU_XOR;
+    case OP_LUI:   *a = op->imm16 << 16; *b = 0; return ALU_OR;
+    }
+    return ALU_NONE;
+}
+
+// Every function is computed and the lane's one kept, without branches,
+// so the loop runs on vectors. The variable shifts are a separate loop:
+// vectors only shift every lane by its own amount with AVX2.
+#define SELECT(f, k, e) ((e) & -(uint32_t)((f) == (k)))
+
+static void alu_lanes(lanes* ln){
+    for(int l=0; l<L; l++){
+        uint32_t f = ln->fn[l], a = ln->a[l], b = ln->b[l];
+        ln->result[l] = SELECT(f, ALU_ADD, a + b) | SELECT(f, ALU_SUB, a - b) |
+                        SELECT(f, ALU_AND, a & b) | SELECT(f, ALU_OR, a | b) |
+                        SELECT(f, ALU_XOR, a ^ b) | SELECT(f, ALU_NOR, ~(a | b)) |
+                        SELECT(f, ALU_SLT, (uint32_t)((int32_t)a < (int32_t)b)) |
+                        SELECT(f, ALU_SLTU, (uint32_t)(a < b));
+    }
+    for(int l=0; l<L; l++){
+        uint32_t f = ln->fn[l], a = ln->a[l], b = ln->b[l];
+        ln->result[l] |= SELECT(f, ALU_SLL, a << b) | SELECT(f, ALU_SRL, a >> b) |
+                         SELECT(f, ALU_SRA, (uint32_t)((int32_t)a >> b));
+    }
+}
+
+// Execute one instruction in every running lane; returns the lanes that
+// halted or reached the instruction limit, as a bit mask
+static uint32_t step(lanes* ln){
+    uint32_t done = 0;
+
+    // Fetch, decode and read the sources
+    for(int l=0; l<L; l++){
+        Pipe_Op* op = &ln->op[l];
+        ln->fn[l] = ALU_NONE;
+        if(ln->program[l] < 0)
+            continue;
+
+        mem_regions = ln->mem[l];
+        func_decode(op, ln->pc[l]);
+        if(op->reg_src1 > 0) op->reg_src1_value = ln->regs[op->reg_src1][l];
+        if(op->reg_src2 > 0) op->reg_src2_value = ln->regs[op->reg_src2][l];
+        ln->fn[l] = alu_function(op, &ln->a[l], &ln->b[l]);
+    }
+
+    alu_lanes(ln);
+
+    // The rest, the way func_step() runs it, and the write-back
+    for(int l=0; l<L; l++){
+        Pipe_Op* op = &ln->op[l];
+        if(ln->program[l] < 0)
+            continue;
+
+        if(ln->fn[l] != ALU_NONE)
+            op->reg_dst_value = ln->result[l];
+        else{
+            mem_regions = ln->mem[l];
+            func_execute(op, &ln->hi[l], &ln->lo[l]);
+        }
+        if(op->reg_dst > 0)
+            ln->regs[op->reg_dst][l] = op->reg_dst_value;
+
+        ln->pc[l] = func_next_pc(op);
+        ln->retired[l]++;
+        if(func_halts(op))
+            ln->halted[l] = true;
+        if(ln->halted[l] || ln->retired[l] >= MAX_INSTS)
+            done |= 1u << l;
+    }
+    return done;
+}
+
+// Start program 'p' in lane 'l', on emptied memory
+static void start_lane(lanes* ln, int l, int p, char* filename){
+    for(int r=0; r<MEM_NREGIONS; r++)
+        madvise(ln->mem[l][r].mem, ln->mem[l][r].size, MADV_DONTNEED);
+    mem_regions = ln->mem[l];
+    load_program(filename);
+
+    ln->program[l] = p;
+    ln->pc[l] = MEM_TEXT_START;
+    for(int r=0; r<32; r++)
+        ln->regs[r][l] = 0;
+    ln->hi[l] = ln->lo[l] = 0;
+    ln->retired[l] = 0;
+    ln->halted[l] = false;
+}
+
+static void finish_lane(lanes* ln, int l, outcome* results){
+    outcome* out = &results[ln->program[l]];
+    out->state.PC = ln->pc[l];
+    for(int r=0; r<32; r++)
+        out->state.REGS[r] = ln->regs[r][l];
+    out->state.HI = ln->hi[l];
+    out->state.LO = ln->lo[l];
+    out->state.halted = ln->halted[l];
+    out->retired = ln->retired[l];
+    ln->program[l] = -1;
+}
+
+static void print_outcome(const char* program, const outcome* out){
+    printf("Program: %s\n", program);
+    printf("PC: 0x%08x\n", out->state.PC);
+    for(int r=0; r<32; r++)
+        printf("R%d: 0x%08x\n", r, out->state.REGS[r]);
+    printf("HI: 0x%08x\n", out->state.HI);
+    printf("LO: 0x%08x\n", out->state.LO);
+    printf("RetiredInstr: %" PRIu64 "\n", out->retired);
+    if(!out->state.halted)
+        printf("Instruction limit reached\n");
+    printf("\n");
+}
+
+int lockstep_run(char** programs, int n){
+    lanes* ln = calloc(1, sizeof(lanes));
+    outcome* results = calloc(n, sizeof(outcome));
+    int next = 0, running = 0, status = 0;
+    int quiet = QUIET;
+
+    // load_program() reports every program it reads otherwise
+    QUIET = TRUE;
+    for(int l=0; l<L; l++){
+        memcpy(ln->mem[l], MEM_REGIONS, sizeof(MEM_REGIONS));
+        for(int r=0; r<MEM_NREGIONS; r++)
+            ln->mem[l][r].mem = mem_alloc(MEM_REGIONS[r].size);
+        ln->program[l] = -1;
+        if(next < n){
+            start_lane(ln, l, next, programs[next]);
+            next++;
+            running++;
+        }
+    }
+
+    // A lane that finishes takes the next program right away
+    while(running){
+        uint32_t done = step(ln);
+        for(int l=0; l<L; l++){
+            if(!(done & (1u << l)))
+                continue;
+            finish_lane(ln, l, results);
+            running--;
+            if(next < n){
+                start_lane(ln, l, next, programs[next]);
+                next++;
+                running++;
+            }
+        }
+    }
+    QUIET = quiet;
+
+    for(int p=0; p<n; p++){
+        print_outcome(programs[p], &results[p]);
+        if(!results[p].state.halted)
+            status = 2;
+    }
+
+    for(int l=0; l<L; l++)
+        for(int r=0; r<MEM_NREGIONS; r++)
+            mem_free(ln->mem[l][r].mem, ln->mem[l][r].size);
+    mem_regions = MEM_REGIONS;
+    free(results);
+    free(ln);
+    return status;
+}
@@ -0,0 +1,33 @@
+/************************************/
+/*                                  */
+/*      Lockstep Batch Simulation   */
+/*                                  */
+/************************************/
+
+#ifndef _LOCKSTEP_H
+#define _LOCKSTEP_H
+
+// With --lockstep, every program file on the command line is a separate
+// program, run functionally (no timing) side by side with the others in
+// one host thread: a throughput mode for regressions of many short
+// programs. LOCKSTEP_LANES programs run at once, each with its own
+// registers and memory; a lane that halts takes the next program.
+//
+// Every step executes one instruction in every lane. The lanes' register
+// files and the step's decoded ops are kept as arrays indexed by lane, so
+// the plain ALU operations of all lanes are computed in one loop the
+// compiler vectorizes (the variable shifts only with AVX2, -mavx2).
+// Multiplies, divides, HI/LO moves, branches, loads and stores run lane
+// by lane through the functional model's own steps (func_execute()).
+//
+// At the end, each program's final registers are printed in order, as
+// rdump prints them, after a "Program:" line. --max-insts applies to
+// each program.
+
+#define LOCKSTEP_LANES 16
+
+// Run 'n' programs; returns the exit status: 0 if all halted, 2 if any
+// stopped at --max-insts
+int lockstep_run(char** programs, int n);
+
+#endif
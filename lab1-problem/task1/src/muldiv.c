@@ -0,0 +1,72 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "muldiv.h"
+#include "mips.h"
+
+muldiv_config muldiv_cfg = { 4, 1, 32, false };
+CORE_LOCAL muldiv_stats muldiv;
+
+void muldiv_init(){
+    memset(&muldiv, 0, sizeof(muldiv));
+}
+
+int muldiv_kind(Pipe_Op* op){
+    if(op->opcode != OP_SPECIAL)
+        return MD_NONE;
+    switch(op->subop){
+    case SUBOP_MULT: case SUBOP_MULTU:
+        return MD_MUL;
+    case SUBOP_DIV: case SUBOP_DIVU:
+        return MD_DIV;
+    case SUBOP_MFHI: case SUBOP_MFLO: case SUBOP_MTHI: case SUBOP_MTLO:
+        return MD_MOVE;
+    }
+    return MD_NONE;
+}
+
+static int significant_bits(uint32_t x){
+    return x ? 32 - __builtin_clz(x) : 0;
+}
+
+static uint32_t magnitude(uint32_t x, bool is_signed){
+    return is_signed && (int32_t)x < 0 ? -x : x;
+}
+
+int muldiv_latency(Pipe_Op* op){
+    if(muldiv_kind(op) == MD_MUL)
+        return muldiv_cfg.mul_latency;
+    if(!muldiv_cfg.div_early)
+        return muldiv_cfg.div_latency;
+
+    // One quotient bit for every bit the dividend is wider than the
+    // divisor, plus one; a divide by zero stops right away
+    bool is_signed = op->subop == SUBOP_DIV;
+    uint32_t a = magnitude(op->reg_src1_value, is_signed);
+    uint32_t b = magnitude(op->reg_src2_value, is_signed);
+    int bits = b ? significant_bits(a) - significant_bits(b) + 1 : 0;
+    if(bits < 0)
+        bits = 0;
+    return DIV_EARLY_MIN + (bits * (muldiv_cfg.div_latency - DIV_EARLY_MIN) + 31) / 32;
+}
+
+void muldiv_start(Pipe_Op* op, int latency){
+    if(muldiv_kind(op) == MD_MUL)
+        muldiv.muls++;
+    else{
+        muldiv.divs++;
+        muldiv.div_cycles += latency;
+    }
+}
+
+void muldiv_print_stats(FILE* out){
+    fprintf(out, "Mul/div unit (multiply %d cycles, one every %d; divide %s%d cycles):\n",
+            muldiv_cfg.mul_latency, muldiv_cfg.mul_interval,
+            muldiv_cfg.div_early ? "up to " : "", muldiv_cfg.div_latency);
+    fprintf(out, "  %" PRIu64 " multiplies, %" PRIu64 " divides (avg %.1f cycles)\n",
+            muldiv.muls, muldiv.divs, muldiv.divs ? (double)muldiv.div_cycles / muldiv.divs : 0.0);
+    fprintf(out, "  waited %" PRIu64 " cycles for HI/LO, %" PRIu64 " for the busy unit\n",
+            muldiv.hilo_wait, muldiv.unit_wait);
+}
@@ -0,0 +1,59 @@
+/************************************/
+/*                                  */
+/*      Multiply/Divide Unit        */
+/*                                  */
+/************************************/
+
+#ifndef _MULDIV_H
+#define _MULDIV_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "pipe.h"
+
+// One unit executes MULT/MULTU/DIV/DIVU and writes HI/LO. Multiplies are
+// pipelined: a new one can start every 'mul_interval' cycles (set it to
+// 'mul_latency' for an unpipelined multiplier). A divide needs the whole
+// unit: it waits for the multiplies in flight, and nothing starts behind
+// it until it finishes. With 'div_early', a divide stops once it has
+// produced the quotient's significant bits, so it takes between
+// DIV_EARLY_MIN and 'div_latency' cycles depending on the operands'
+// magnitudes. MFHI/MFLO/MTHI/MTLO wait for the result in flight.
+
+#define DIV_EARLY_MIN 2     // cycles of an early-terminating divide with no quotient bits
+
+typedef struct{
+    int mul_latency;        // cycles until a multiply's HI/LO are ready
+    int mul_interval;       // cycles between multiplies started back to back
+    int div_latency;        // cycles of a divide (the most, with div_early)
+    bool div_early;
+} muldiv_config;
+
+// --mul-latency, --mul-interval, --div-latency, --div-early
+extern muldiv_config muldiv_cfg;
+
+// What an op asks of the unit
+#define MD_NONE 0
+#define MD_MUL  1           // MULT, MULTU
+#define MD_DIV  2           // DIV, DIVU
+#define MD_MOVE 3           // MFHI, MFLO, MTHI, MTLO
+
+typedef struct{
+    uint64_t muls, divs;
+    uint64_t div_cycles;    // summed divide latency
+    // Cycles ops were held up, summed over the ops (the ooo core can have
+    // several waiting at once)
+    uint64_t hilo_wait;     // a HI/LO move waiting for a result
+    uint64_t unit_wait;     // a multiply/divide waiting for the unit
+} muldiv_stats;
+
+extern CORE_LOCAL muldiv_stats muldiv;
+
+void muldiv_init();                     // per core, from pipe_init()
+int muldiv_kind(Pipe_Op*);
+int muldiv_latency(Pipe_Op*);           // of a multiply/divide, from its source values
+void muldiv_start(Pipe_Op*, int latency);   // count a multiply/divide the core started
+void muldiv_print_stats(FILE*);
+
+#endif
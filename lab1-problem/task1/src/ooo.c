@@ -0,0 +1,500 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ooo.h"
+#include "pipe.h"
+#include "shell.h"
+#include "mips.h"
+#include "cache.h"
+#include "profile.h"
+#include "check.h"
+#include "tlb.h"
+#include "hostprof.h"
+#include "ptrace.h"
+#include "muldiv.h"
+
+ooo_config ooo_cfg = { 4, 64, 32, 32 };
+CORE_LOCAL ooo_state ooo;
+
+// ROB index helpers (the ROB is a circular buffer)
+#define ROB_NEXT(i) (((i) + 1) % ooo_cfg.rob_size)
+#define ROB_AGE(i) ((((i) - ooo.head) + ooo_cfg.rob_size) % ooo_cfg.rob_size)
+
+static bool is_muldiv(Pipe_Op* op){
+    return op->opcode == OP_SPECIAL &&
+        (op->subop == SUBOP_MULT || op->subop == SUBOP_MULTU ||
+         op->subop == SUBOP_DIV || op->subop == SUBOP_DIVU);
+}
+
+static bool is_hilo_move(Pipe_Op* op){
+    return op->opcode == OP_SPECIAL &&
+        (op->subop == SUBOP_MFHI || op->subop == SUBOP_MFLO ||
+         op->subop == SUBOP_MTHI || op->subop == SUBOP_MTLO);
+}
+
+static bool is_load(Pipe_Op* op){
+    return op->is_mem && !op->mem_write;
+}
+
+static bool is_store(Pipe_Op* op){
+    return op->is_mem && op->mem_write;
+}
+
+void ooo_init(){
+    // Started over (interval simulation): drop the ops still in flight
+    for(int i=0; ooo.rob && i<ooo_cfg.rob_size; i++)
+        free(ooo.rob[i].op);
+    for(int k=0; k<ooo.fq_count; k++)
+        free(ooo.fetchq[(ooo.fq_head + k) % (2 * ooo_cfg.width)]);
+    free(ooo.rob);
+    free(ooo.fetchq);
+    free(ooo.fetchq_ready);
+    memset(&ooo, 0, sizeof(ooo));
+
+    ooo.rob = calloc(ooo_cfg.rob_size, sizeof(ooo_entry));
+    ooo.fetchq = calloc(2 * ooo_cfg.width, sizeof(Pipe_Op*));
+    ooo.fetchq_ready = calloc(2 * ooo_cfg.width, sizeof(uint64_t));
+    for(int r=0; r<=OOO_HILO; r++)
+        ooo.rat[r] = -1;
+    ooo.frontend_cause = CPI_EMPTY;
+}
+
+// A source is ready once its producer's result is visible
+static bool src_ready(int tag, uint64_t now){
+    return tag == -1 || (ooo.rob[tag].done && ooo.rob[tag].ready_at <= now);
+}
+
+static uint32_t src_value(int tag, int reg){
+    if(reg <= 0) return 0;
+    return tag == -1 ? pipe.REGS[reg] : ooo.rob[tag].op->reg_dst_value;
+}
+
+// Rebuild the rename table from the entries still in the ROB
+static void rebuild_rat(){
+    for(int r=0; r<=OOO_HILO; r++)
+        ooo.rat[r] = -1;
+    ooo.iq_count = ooo.lsq_count = 0;
+    for(int i=ooo.head, n=0; n<ooo.count; i=ROB_NEXT(i), n++){
+        ooo_entry* e = &ooo.rob[i];
+        if(e->op->reg_dst > 0) ooo.rat[e->op->reg_dst] = i;
+        if(e->writes_hilo) ooo.rat[OOO_HILO] = i;
+        if(e->in_iq) ooo.iq_count++;
+        if(e->op->is_mem) ooo.lsq_count++;
+    }
+}
+
+// Squash everything younger than ROB entry 'keep' and refetch from 'dest'
+static void recover(int keep, uint32_t dest){
+    int n = ROB_AGE(keep) + 1;
+    for(int i=ROB_NEXT(keep); ooo.count > n; i=ROB_NEXT(i)){
+        if(ptrace_on) ptrace_end(ooo.rob[i].op, true);
+        free(ooo.rob[i].op);
+        memset(&ooo.rob[i], 0, sizeof(ooo_entry));
+        ooo.count--;
+    }
+    ooo.tail = ROB_NEXT(keep);
+    rebuild_rat();
+
+    for(int k=0; k<ooo.fq_count; k++){
+        Pipe_Op* op = ooo.fetchq[(ooo.fq_head + k) % (2 * ooo_cfg.width)];
+        if(ptrace_on) ptrace_end(op, true);
+        free(op);
+    }
+    ooo.fq_count = 0;
+    ooo.fetch_resume = 0;
+
+    pipe.PC = dest;
+    fetch_buffer_flush(&pipe.fetch_buf);
+    ooo.frontend_cause = CPI_BRANCH;
+    stat_squash++;
+    if(profile)
+        profile_flush(ooo.rob[keep].op->pc);
+}
+
+/* Translate 'addr' if the TLBs are on; returns the walk cycles */
+static uint32_t ooo_translate(tlb_unit* tlb, uint32_t addr){
+    if(tlb == NULL)
+        return 0;
+    tlb_translate(tlb, addr);
+    return tlb->penalty;
+}
+
+/* Commit: retire finished ops in order into the architectural state */
+static int ooo_commit(uint64_t now){
+    int retired = 0;
+
+    while(retired < ooo_cfg.width && ooo.count > 0 && now >= ooo.commit_resume){
+        ooo_entry* e = &ooo.rob[ooo.head];
+        Pipe_Op* op = e->op;
+        if(!e->done || e->ready_at > now)
+            break;
+
+        // Stores write the dcache at commit; a miss holds up later commits
+        if(is_store(op)){
+            uint32_t addr = op->mem_addr & ~3;
+            uint32_t walk = ooo_translate(dtlb, addr);
+            uint32_t val, bytes = pipe_store_bytes(op, &val);
+            cache_write(dcache, addr, val, bytes);
+            uint32_t penalty = walk + dcache->penalty;
+            if(walk) op->trace_flags |= PT_DTLB_MISS;
+            if(penalty > walk) op->trace_flags |= PT_DCACHE_MISS;
+            if(penalty){
+                ooo.commit_resume = now + penalty;
+                ooo.commit_cause = walk ? CPI_TLB : CPI_DCACHE;
+                if(profile && penalty > walk) profile_miss(op->pc, PROF_MEM, 0);
+            }
+        }
+
+        if(op->reg_dst > 0)
+            pipe.REGS[op->reg_dst] = op->reg_dst_value;
+        if(e->writes_hilo){
+            pipe.HI = e->hi;
+            pipe.LO = e->lo;
+        }
+
+        // Younger consumers now find this value in the register file
+        int self = ooo.head;
+        for(int r=0; r<=OOO_HILO; r++)
+            if(ooo.rat[r] == self) ooo.rat[r] = -1;
+        for(int i=ROB_NEXT(self), n=1; n<ooo.count; i=ROB_NEXT(i), n++)
+            for(int k=0; k<3; k++)
+                if(ooo.rob[i].src[k] == self) ooo.rob[i].src[k] = -1;
+
+        if(op->is_mem) ooo.lsq_count--;
+        if(profile) profile_retire(op->pc);
+        if(check_enabled) check_retire(op, pipe.HI, pipe.LO, true);
+        stat_inst_retire++;
+        retired++;
+
+        bool halt = op->opcode == OP_SPECIAL && op->subop == SUBOP_SYSCALL &&
+            op->reg_src1_value == 0xA;
+        if(halt){
+            pipe.PC = op->pc + 4;
+            RUN_BIT = 0;
+        }
+
+        if(ptrace_on){
+            PTRACE_STAGE(op, PROF_WB, now);
+            ptrace_end(op, false);
+        }
+        free(op);
+        memset(e, 0, sizeof(ooo_entry));
+        ooo.head = ROB_NEXT(ooo.head);
+        ooo.count--;
+
+        if(halt || now < ooo.commit_resume)
+            break;
+    }
+
+    return retired;
+}
+
+// A load may issue once every older store has its address. It takes its
+// value from the youngest older store to the same word when that store
+// writes the whole word; any other overlap waits for the store to commit.
+// Returns false if the load must wait.
+static bool ooo_load(ooo_entry* e, int idx, uint64_t now){
+    Pipe_Op* op = e->op;
+    uint32_t addr = op->mem_addr & ~3;
+
+    for(int i=idx; i!=ooo.head; ){
+        i = (i - 1 + ooo_cfg.rob_size) % ooo_cfg.rob_size;
+        ooo_entry* older = &ooo.rob[i];
+        if(!is_store(older->op))
+            continue;
+        if(!older->done)
+            return false;
+        if((older->op->mem_addr & ~3) != addr)
+            continue;
+        if(older->op->opcode != OP_SW)
+            return false;
+
+        op->reg_dst_value = pipe_load_value(op, older->op->mem_value);
+        uint32_t walk = ooo_translate(dtlb, addr);
+        e->ready_at = now + 1 + walk;
+        if(walk){
+            e->walk_until = e->ready_at;
+            op->trace_flags |= PT_DTLB_MISS;
+        }
+        return true;
+    }
+
+    uint32_t walk = ooo_translate(dtlb, addr);
+    if(walk){
+        e->walk_until = now + 1 + walk;
+        op->trace_flags |= PT_DTLB_MISS;
+    }
+    op->reg_dst_value = pipe_load_value(op, cache_read(dcache, addr));
+    e->ready_at = now + 1 + walk + dcache->penalty;
+    if(dcache->penalty){
+        e->dcache_miss = true;
+        op->trace_flags |= PT_DCACHE_MISS;
+        if(profile) profile_miss(op->pc, PROF_MEM, 0);
+    }
+    return true;
+}
+
+/* Issue: oldest-first select of ready ops, executed right away; results
+ * become visible after the op's latency */
+static int ooo_issue(uint64_t now){
+    int issued = 0;
+    int mispredict = -1;
+
+    ooo.hilo_blocked = ooo.unit_blocked = 0;
+    for(int i=ooo.head, n=0; n<ooo.count && issued<ooo_cfg.width; i=ROB_NEXT(i), n++){
+        ooo_entry* e = &ooo.rob[i];
+        Pipe_Op* op = e->op;
+        if(!e->in_iq)
+            continue;
+        if(e->reads_hilo && !src_ready(e->src[2], now) && is_muldiv(ooo.rob[e->src[2]].op))
+            ooo.hilo_blocked++;
+        if(!src_ready(e->src[0], now) || !src_ready(e->src[1], now) || !src_ready(e->src[2], now))
+            continue;
+        if(is_muldiv(op) && now < (muldiv_kind(op) == MD_MUL ? ooo.mul_free : ooo.muldiv_free)){
+            ooo.unit_blocked++;
+            continue;
+        }
+
+        op->reg_src1_value = src_value(e->src[0], op->reg_src1);
+        op->reg_src2_value = src_value(e->src[1], op->reg_src2);
+        uint32_t hi = e->src[2] == -1 ? pipe.HI : ooo.rob[e->src[2]].hi;
+        uint32_t lo = e->src[2] == -1 ? pipe.LO : ooo.rob[e->src[2]].lo;
+
+        int latency = pipe_alu(op, &hi, &lo);
+        e->hi = hi;
+        e->lo = lo;
+        e->ready_at = now + latency;
+        if(is_muldiv(op)){
+            ooo.muldiv_free = now + latency;
+            ooo.mul_free = now + (muldiv_kind(op) == MD_MUL ? muldiv_cfg.mul_interval : latency);
+            muldiv_start(op, latency);
+        }
+
+        if(is_load(op) && !ooo_load(e, i, now))
+            continue;
+
+        e->in_iq = false;
+        e->done = true;
+        ooo.iq_count--;
+        issued++;
+        PTRACE_STAGE(op, PROF_EXECUTE, now);
+        PTRACE_STAGE(op, PROF_MEM, e->ready_at);
+
+        // Fetch continues sequentially, so every taken branch mispredicts
+        // and nothing younger issues behind it
+        if(op->branch_taken){
+            mispredict = i;
+            break;
+        }
+    }
+    muldiv.hilo_wait += ooo.hilo_blocked;
+    muldiv.unit_wait += ooo.unit_blocked;
+
+    if(mispredict != -1)
+        recover(mispredict, ooo.rob[mispredict].op->branch_dest);
+    return issued;
+}
+
+/* Dispatch: decode, rename and allocate ROB/IQ/LSQ entries */
+static int ooo_dispatch(uint64_t now){
+    int fq_size = 2 * ooo_cfg.width;
+    int n;
+
+    for(n=0; n<ooo_cfg.width && ooo.fq_count > 0; n++){
+        if(ooo.fetchq_ready[ooo.fq_head] > now)
+            break;
+        if(ooo.count == ooo_cfg.rob_size || ooo.iq_count == ooo_cfg.iq_size)
+            break;
+
+        Pipe_Op* op = ooo.fetchq[ooo.fq_head];
+        pipe_decode_op(op);
+        if(op->is_mem && ooo.lsq_count == ooo_cfg.lsq_size)
+            break;
+
+        ooo.fq_head = (ooo.fq_head + 1) % fq_size;
+        ooo.fq_count--;
+
+        ooo_entry* e = &ooo.rob[ooo.tail];
+        memset(e, 0, sizeof(ooo_entry));
+        e->op = op;
+        PTRACE_STAGE(op, PROF_DECODE, now);
+        e->busy = true;
+        e->in_iq = true;
+        e->reads_hilo = is_hilo_move(op);
+        e->writes_hilo = is_muldiv(op) || (e->reads_hilo &&
+            (op->subop == SUBOP_MTHI || op->subop == SUBOP_MTLO));
+
+        e->src[0] = op->reg_src1 > 0 ? ooo.rat[op->reg_src1] : -1;
+        e->src[1] = op->reg_src2 > 0 ? ooo.rat[op->reg_src2] : -1;
+        e->src[2] = e->reads_hilo ? ooo.rat[OOO_HILO] : -1;
+        if(op->reg_dst > 0) ooo.rat[op->reg_dst] = ooo.tail;
+        if(e->writes_hilo) ooo.rat[OOO_HILO] = ooo.tail;
+
+        ooo.tail = ROB_NEXT(ooo.tail);
+        ooo.count++;
+        ooo.iq_count++;
+        if(op->is_mem) ooo.lsq_count++;
+    }
+    return n;
+}
+
+/* Fetch: sequential, 'width' instructions per cycle through the icache */
+static int ooo_fetch(uint64_t now){
+    int fq_size = 2 * ooo_cfg.width;
+    int n;
+
+    for(n=0; n<ooo_cfg.width && ooo.fq_count < fq_size && now >= ooo.fetch_resume; n++){
+        Pipe_Op* op = malloc(sizeof(Pipe_Op));
+        memset(op, 0, sizeof(Pipe_Op));
+        op->reg_src1 = op->reg_src2 = op->reg_dst = -1;
+        op->pc = pipe.PC;
+        if(ptrace_on) ptrace_fetch(op);
+        uint32_t walk = ooo_translate(itlb, pipe.PC);
+        op->instruction = fetch_buffer_read(&pipe.fetch_buf, icache, pipe.PC);
+        uint32_t penalty = walk + icache->penalty;
+        if(walk) op->trace_flags |= PT_ITLB_MISS;
+        if(icache->penalty) op->trace_flags |= PT_ICACHE_MISS;
+
+        int slot = (ooo.fq_head + ooo.fq_count) % fq_size;
+        ooo.fetchq[slot] = op;
+        ooo.fetchq_ready[slot] = now + 1 + penalty;
+        ooo.fq_count++;
+        pipe.PC += 4;
+        stat_inst_fetch++;
+
+        if(walk){
+            ooo.fetch_resume = now + 1 + penalty;
+            ooo.frontend_cause = CPI_TLB;
+        }
+        else if(icache->penalty){
+            ooo.fetch_resume = now + 1 + penalty;
+            ooo.frontend_cause = CPI_ICACHE;
+            if(profile) profile_miss(op->pc, PROF_FETCH, 0);
+        }
+    }
+    return n;
+}
+
+// Charge a cycle in which nothing committed to what holds up the ROB head.
+// A head that is not waiting on anything arrived late, so like an empty ROB
+// it is blamed on the last frontend disruption.
+static int stall_cause(uint64_t now){
+    if(now < ooo.commit_resume)
+        return ooo.commit_cause;
+    if(ooo.count == 0)
+        return ooo.frontend_cause;
+
+    ooo_entry* e = &ooo.rob[ooo.head];
+    if(e->done){
+        if(now < e->walk_until) return CPI_TLB;
+        if(e->dcache_miss) return CPI_DCACHE;
+        if(is_muldiv(e->op)) return CPI_MULDIV;
+        return ooo.frontend_cause;
+    }
+
+    // Waiting to issue: blame the producer it waits on
+    for(int k=0; k<3; k++){
+        if(src_ready(e->src[k], now))
+            continue;
+        ooo_entry* p = &ooo.rob[e->src[k]];
+        if(now < p->walk_until) return CPI_TLB;
+        if(p->dcache_miss) return CPI_DCACHE;
+        if(is_load(p->op)) return CPI_LOAD_USE;
+        if(is_muldiv(p->op) || k == 2) return CPI_MULDIV;
+    }
+    if(is_muldiv(e->op)) return CPI_MULDIV;
+    return ooo.frontend_cause;
+}
+
+void ooo_cycle(){
+    uint64_t now = stat_cycles;
+
+    ooo.stat_rob += ooo.count;
+    ooo.stat_iq += ooo.iq_count;
+    ooo.stat_lsq += ooo.lsq_count;
+
+    int cause = CPI_BASE;
+    uint32_t head_pc = ooo.count ? ooo.rob[ooo.head].op->pc : 0;
+    HOSTPROF_ENTER(HP_OOO_COMMIT);
+    int retired = ooo_commit(now);
+    HOSTPROF_LEAVE();
+    if(retired == 0){
+        cause = stall_cause(now);
+        if(profile && head_pc)
+            profile_charge(head_pc, 1);
+    }
+    CPI_CHARGE(cause, 1);
+
+    ooo.idle = false;
+    if(!RUN_BIT)
+        return;
+
+    HOSTPROF_ENTER(HP_OOO_ISSUE);
+    int moved = ooo_issue(now);
+    HOSTPROF_LEAVE();
+    HOSTPROF_ENTER(HP_OOO_DISPATCH);
+    moved += ooo_dispatch(now);
+    HOSTPROF_LEAVE();
+    HOSTPROF_ENTER(HP_OOO_FETCH);
+    moved += ooo_fetch(now);
+    HOSTPROF_LEAVE();
+    ooo.idle = retired == 0 && moved == 0;
+}
+
+// First cycle after 'now' at which a pending result, miss or busy unit
+// completes. Every decision a cycle makes compares one of these times
+// against the current cycle, so an idle cycle repeats unchanged until then.
+static uint64_t next_event(uint64_t now){
+    uint64_t next = UINT64_MAX;
+    uint64_t times[4] = { ooo.fetch_resume, ooo.commit_resume, ooo.muldiv_free, ooo.mul_free };
+
+    for(int k=0; k<4; k++)
+        if(times[k] > now && times[k] < next) next = times[k];
+    for(int i=ooo.head, n=0; n<ooo.count; i=ROB_NEXT(i), n++){
+        ooo_entry* e = &ooo.rob[i];
+        if(e->done && e->ready_at > now && e->ready_at < next)
+            next = e->ready_at;
+        // The stall cause changes when a walk ends
+        if(e->walk_until > now && e->walk_until < next)
+            next = e->walk_until;
+    }
+    for(int k=0; k<ooo.fq_count; k++){
+        uint64_t t = ooo.fetchq_ready[(ooo.fq_head + k) % (2 * ooo_cfg.width)];
+        if(t > now && t < next) next = t;
+    }
+    return next;
+}
+
+uint64_t ooo_skip(uint64_t max){
+    if(!ooo.idle)
+        return 0;
+
+    // The idle cycle was stat_cycles - 1; the ones up to the next event
+    // charge the same cause and occupancy
+    uint64_t now = stat_cycles;
+    uint64_t n = next_event(now - 1) - now;
+    if(n > max)
+        n = max;
+    if(n == 0)
+        return 0;
+
+    ooo.stat_rob += n * ooo.count;
+    ooo.stat_iq += n * ooo.iq_count;
+    ooo.stat_lsq += n * ooo.lsq_count;
+    muldiv.hilo_wait += n * ooo.hilo_blocked;
+    muldiv.unit_wait += n * ooo.unit_blocked;
+    CPI_CHARGE(stall_cause(now), n);
+    if(profile && ooo.count)
+        profile_charge(ooo.rob[ooo.head].op->pc, n);
+    return n;
+}
+
+void ooo_print_stats(FILE* out){
+    double cycles = stat_cycles ? (double)stat_cycles : 1.0;
+    fprintf(out, "Out-of-order core (width %d, ROB %d, IQ %d, LSQ %d):\n",
+            ooo_cfg.width, ooo_cfg.rob_size, ooo_cfg.iq_size, ooo_cfg.lsq_size);
+    fprintf(out, "  avg occupancy: ROB %.1f, IQ %.1f, LSQ %.1f\n",
+            ooo.stat_rob / cycles, ooo.stat_iq / cycles, ooo.stat_lsq / cycles);
+}
@@ -0,0 +1,72 @@
+/************************************/
+/*                                  */
+/*      Out-of-Order Core           */
+/*                                  */
+/************************************/
+
+#ifndef _OOO_H
+#define _OOO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "pipe.h"
+
+// Sizes of the out-of-order structures (set from the command line)
+typedef struct{
+    int width;      // fetch/dispatch/issue/commit per cycle
+    int rob_size;   // reorder buffer entries
+    int iq_size;    // issue queue entries (ops waiting to issue)
+    int lsq_size;   // load/store queue entries (loads and stores in flight)
+} ooo_config;
+
+extern ooo_config ooo_cfg;
+
+// Logical register used to rename HI/LO as one 64-bit value
+#define OOO_HILO 32
+
+// Reorder buffer entry. Registers are renamed onto ROB entries: a source
+// names the entry producing it, or -1 for the architectural register file.
+typedef struct{
+    Pipe_Op* op;
+    bool busy;
+    bool in_iq;         // waiting to issue
+    bool done;          // issued; result visible from ready_at on
+    bool dcache_miss;   // load that missed in the dcache
+    bool reads_hilo, writes_hilo;
+    uint64_t ready_at;
+    uint64_t walk_until;    // load: its D-TLB walk ends at this cycle (0: TLB hit)
+    int src[3];         // producers of reg_src1, reg_src2 and HI/LO
+    uint32_t hi, lo;    // HI/LO result
+} ooo_entry;
+
+typedef struct{
+    ooo_entry* rob;
+    int head, tail, count;
+    int iq_count, lsq_count;
+    int rat[OOO_HILO + 1];          // logical register -> producing entry
+
+    Pipe_Op** fetchq;               // fetched, not yet dispatched
+    uint64_t* fetchq_ready;         // cycle each fetched op arrives
+    int fq_head, fq_count;
+    uint64_t fetch_resume;          // icache miss: no fetch before this cycle
+    uint64_t commit_resume;         // store miss: no commit before this cycle
+    int commit_cause;               // CPI cause of commit_resume
+    uint64_t muldiv_free;           // multiply/divide unit done (a divide can start)
+    uint64_t mul_free;              // the unit takes another multiply (muldiv.h)
+    int hilo_blocked, unit_blocked; // ops the last issue left waiting on the unit
+    int frontend_cause;             // CPI cause of the last frontend disruption
+    bool idle;                      // last cycle committed, issued, dispatched and fetched nothing
+
+    // Occupancy statistics (summed every cycle)
+    uint64_t stat_rob, stat_iq, stat_lsq;
+} ooo_state;
+
+extern CORE_LOCAL ooo_state ooo;
+
+void ooo_init();
+void ooo_cycle();
+uint64_t ooo_skip(uint64_t max);     // see pipe_skip()
+void ooo_print_stats(FILE*);
+
+#endif
@@ -16,6 +16,14 @@
 
 // Adding the caches
 #include "cache.h"
+#include "profile.h"
+#include "ooo.h"
+#include "check.h"
+#include "dram.h"
+#include "tlb.h"
+#include "hostprof.h"
+#include "ptrace.h"
+#include "muldiv.h"
 
 // #define DEBUG
 
@@ -31,19 +39,51 @@ void print_op(Pipe_Op *op)
 }
 
 /* global pipeline state */
-Pipe_State pipe;
-cache_unit *icache, *dcache;
+CORE_LOCAL Pipe_State pipe;
+CORE_LOCAL cache_unit *icache, *dcache;
+int pipe_model = CORE_INORDER;
 
 void pipe_init()
 {
+    /* a thread may start over (interval simulation): drop the old state */
+    free(pipe.decode_op);
+    free(pipe.execute_op);
+    free(pipe.mem_op);
+    free(pipe.wb_op);
+    if (icache) free_cache(icache);
+    if (dcache) free_cache(dcache);
+
     memset(&pipe, 0, sizeof(Pipe_State));
     pipe.PC = 0x00400000;
+    pipe.decode_bubble.cause = pipe.execute_bubble.cause = CPI_EMPTY;
+    pipe.mem_bubble.cause = pipe.wb_bubble.cause = CPI_EMPTY;
+    cpi_reset();
     icache = init_cache(I_BLOCK_SIZE, I_WAYS, I_SETS);
     dcache = init_cache(D_BLOCK_SIZE, D_WAYS, D_SETS);
+    cache_configure(dcache, &dcache_cfg);
+    dram_init();
+    tlb_init();
+    muldiv_init();
+
+    if (pipe_model == CORE_OOO)
+        ooo_init();
+}
+
+/* drop an op squashed by a branch recovery */
+static void pipe_flush_op(Pipe_Op *op)
+{
+    if (op && ptrace_on)
+        ptrace_end(op, true);
+    free(op);
 }
 
 void pipe_cycle()
 {
+    if (pipe_model == CORE_OOO) {
+        ooo_cycle();
+        return;
+    }
+
 #ifdef DEBUG
     printf("\n\n----\n\nPIPELINE:\n");
     printf("DCODE: "); print_op(pipe.decode_op);
@@ -53,11 +93,24 @@ void pipe_cycle()
     printf("\n");
 #endif
 
+    if (profile)
+        profile_occupancy(1);
+
+    HOSTPROF_ENTER(HP_WB);
     pipe_stage_wb();
+    HOSTPROF_LEAVE();
+    HOSTPROF_ENTER(HP_MEM);
     pipe_stage_mem();
+    HOSTPROF_LEAVE();
+    HOSTPROF_ENTER(HP_EXECUTE);
     pipe_stage_execute();
+    HOSTPROF_LEAVE();
+    HOSTPROF_ENTER(HP_DECODE);
     pipe_stage_decode();
+    HOSTPROF_LEAVE();
+    HOSTPROF_ENTER(HP_FETCH);
     pipe_stage_fetch();
+    HOSTPROF_LEAVE();
 
     /* handle branch recoveries */
     if (pipe.branch_recover) {
@@ -66,27 +119,35 @@ void pipe_cycle()
 #endif
 
         pipe.PC = pipe.branch_dest;
+        fetch_buffer_flush(&pipe.fetch_buf);
 
         if (pipe.branch_flush >= 2) {
-            if (pipe.decode_op) free(pipe.decode_op);
+            pipe_flush_op(pipe.decode_op);
             pipe.decode_op = NULL;
+            pipe.decode_bubble = (Pipe_Bubble){ CPI_BRANCH, pipe.branch_pc };
         }
 
         if (pipe.branch_flush >= 3) {
-            if (pipe.execute_op) free(pipe.execute_op);
+            pipe_flush_op(pipe.execute_op);
             pipe.execute_op = NULL;
+            pipe.execute_bubble = (Pipe_Bubble){ CPI_BRANCH, pipe.branch_pc };
         }
 
         if (pipe.branch_flush >= 4) {
-            if (pipe.mem_op) free(pipe.mem_op);
+            pipe_flush_op(pipe.mem_op);
             pipe.mem_op = NULL;
+            pipe.mem_bubble = (Pipe_Bubble){ CPI_BRANCH, pipe.branch_pc };
         }
 
         if (pipe.branch_flush >= 5) {
-            if (pipe.wb_op) free(pipe.wb_op);
+            pipe_flush_op(pipe.wb_op);
             pipe.wb_op = NULL;
+            pipe.wb_bubble = (Pipe_Bubble){ CPI_BRANCH, pipe.branch_pc };
         }
 
+        if (profile)
+            profile_flush(pipe.branch_pc);
+
         pipe.branch_recover = 0;
         pipe.branch_dest = 0;
         pipe.branch_flush = 0;
@@ -95,6 +156,59 @@ void pipe_cycle()
     }
 }
 
+/* cycles 'op' still has to wait in execute for the multiply/divide unit: a
+ * HI/LO move or a divide until the unit is done, a multiply until the unit
+ * takes another one */
+static int muldiv_wait(Pipe_Op *op)
+{
+    switch (muldiv_kind(op)) {
+        case MD_MUL:
+            return pipe.multiplier_accept;
+        case MD_DIV:
+        case MD_MOVE:
+            return pipe.multiplier_stall;
+    }
+    return 0;
+}
+
+/* The in-order pipe only idles on the multiplier: an op waits in execute
+ * for the multiply/divide unit (see muldiv_wait), the stages behind it are
+ * full and the bubble it leaves has already reached writeback. Every cycle
+ * then charges that bubble and counts the unit down, until the cycle in
+ * which the op can go. */
+uint64_t pipe_skip(uint64_t max)
+{
+    if (pipe_model == CORE_OOO)
+        return ooo_skip(max);
+
+    Pipe_Op *op = pipe.execute_op;
+    if (!op || !pipe.decode_op || pipe.mem_op || pipe.wb_op || pipe.branch_recover)
+        return 0;
+    int wait = muldiv_wait(op);
+    if (wait <= 1)
+        return 0;
+    if (pipe.mem_bubble.cause != CPI_MULDIV || pipe.mem_bubble.pc != op->pc ||
+        pipe.wb_bubble.cause != CPI_MULDIV || pipe.wb_bubble.pc != op->pc)
+        return 0;
+
+    uint64_t n = wait - 1;
+    if (n > max)
+        n = max;
+
+    pipe.multiplier_stall -= n;
+    pipe.multiplier_accept = pipe.multiplier_accept > n ? pipe.multiplier_accept - n : 0;
+    if (muldiv_kind(op) == MD_MOVE)
+        muldiv.hilo_wait += n;
+    else
+        muldiv.unit_wait += n;
+    CPI_CHARGE(CPI_MULDIV, n);
+    if (profile) {
+        profile_occupancy(n);
+        profile_charge(op->pc, n);
+    }
+    return n;
+}
+
 void pipe_recover(int flush, uint32_t dest)
 {
     /* if there is already a recovery scheduled, it must have come from a later
@@ -108,15 +222,51 @@ void pipe_recover(int flush, uint32_t dest)
     pipe.branch_dest = dest;
 }
 
+/* charge the miss penalty (if any) of the last access to 'cache' */
+static void charge_cache_penalty(cache_unit *cache, int cause, uint32_t pc)
+{
+    if (cache->penalty == 0)
+        return;
+
+    stat_cycles += cache->penalty;
+    CPI_CHARGE(cause, cache->penalty);
+    if (profile)
+        profile_miss(pc, cause == CPI_ICACHE ? PROF_FETCH : PROF_MEM, cache->penalty);
+}
+
+/* translate 'addr' through 'tlb' (if the TLBs are on) and charge the walk */
+static uint32_t pipe_translate(tlb_unit *tlb, uint32_t addr, uint32_t pc)
+{
+    if (tlb == NULL)
+        return 0;
+
+    tlb_translate(tlb, addr);
+    if (tlb->penalty == 0)
+        return 0;
+
+    stat_cycles += tlb->penalty;
+    CPI_CHARGE(CPI_TLB, tlb->penalty);
+    if (profile)
+        profile_charge(pc, tlb->penalty);
+    return tlb->penalty;
+}
+
+
 void pipe_stage_wb()
 {
-    /* if there is no instruction in this pipeline stage, we are done */
-    if (!pipe.wb_op)
+    /* if there is no instruction in this pipeline stage, nothing retires this
+     * cycle: charge it to whatever left the bubble */
+    if (!pipe.wb_op) {
+        CPI_CHARGE(pipe.wb_bubble.cause, 1);
+        if (profile && pipe.wb_bubble.cause != CPI_EMPTY)
+            profile_charge(pipe.wb_bubble.pc, 1);
         return;
+    }
 
     /* grab the op out of our input slot */
     Pipe_Op *op = pipe.wb_op;
     pipe.wb_op = NULL;
+    PTRACE_STAGE(op, PROF_WB, stat_cycles);
 
     /* if this instruction writes a register, do so now */
     if (op->reg_dst != -1 && op->reg_dst != 0) {
@@ -134,176 +284,145 @@ void pipe_stage_wb()
         }
     }
 
+    if (profile)
+        profile_retire(op->pc);
+
+    /* HI/LO were written in execute, so they hold this op's result unless
+     * the op behind it has written them since */
+    if (check_enabled)
+        check_retire(op, pipe.HI, pipe.LO,
+                     !(pipe.mem_op && pipe_writes_hilo(pipe.mem_op)));
+
     /* free the op */
+    if (ptrace_on)
+        ptrace_end(op, false);
     free(op);
 
     stat_inst_retire++;
+    CPI_CHARGE(CPI_BASE, 1);
 }
 
-void pipe_stage_mem()
+/* extract a load's result from the aligned memory word holding it */
+uint32_t pipe_load_value(Pipe_Op *op, uint32_t val)
 {
-    /* if there is no instruction in this pipeline stage, we are done */
-    if (!pipe.mem_op)
-        return;
-
-    /* grab the op out of our input slot */
-    Pipe_Op *op = pipe.mem_op;
-
-    uint32_t val = 0;
-    if (op->is_mem){
-        // val = mem_read_32(op->mem_addr & ~3);
-        // stat_cycles+=50;
+    if (op->opcode == OP_LH || op->opcode == OP_LHU) {
+        if (op->mem_addr & 2)
+            val = (val >> 16) & 0xFFFF;
+        else
+            val = val & 0xFFFF;
 
-        uint32_t addr = op->mem_addr & ~3;
-        val = cache_read(dcache, addr);
+        if (op->opcode == OP_LH)
+            val |= (val & 0x8000) ? 0xFFFF8000 : 0;
     }
+    else if (op->opcode == OP_LB || op->opcode == OP_LBU) {
+        switch (op->mem_addr & 3) {
+            case 0:
+                val = val & 0xFF;
+                break;
+            case 1:
+                val = (val >> 8) & 0xFF;
+                break;
+            case 2:
+                val = (val >> 16) & 0xFF;
+                break;
+            case 3:
+                val = (val >> 24) & 0xFF;
+                break;
+        }
 
-    switch (op->opcode) {
-        case OP_LW:
-        case OP_LH:
-        case OP_LHU:
-        case OP_LB:
-        case OP_LBU:
-            {
-                /* extract needed value */
-                op->reg_dst_value_ready = 1;
-                if (op->opcode == OP_LW) {
-                    op->reg_dst_value = val;
-                }
-                else if (op->opcode == OP_LH || op->opcode == OP_LHU) {
-                    if (op->mem_addr & 2)
-                        val = (val >> 16) & 0xFFFF;
-                    else
-                        val = val & 0xFFFF;
-
-                    if (op->opcode == OP_LH)
-                        val |= (val & 0x8000) ? 0xFFFF8000 : 0;
-
-                    op->reg_dst_value = val;
-                }
-                else if (op->opcode == OP_LB || op->opcode == OP_LBU) {
-                    switch (op->mem_addr & 3) {
-                        case 0:
-                            val = val & 0xFF;
-                            break;
-                        case 1:
-                            val = (val >> 8) & 0xFF;
-                            break;
-                        case 2:
-                            val = (val >> 16) & 0xFF;
-                            break;
-                        case 3:
-                            val = (val >> 24) & 0xFF;
-                            break;
-                    }
+        if (op->opcode == OP_LB)
+            val |= (val & 0x80) ? 0xFFFFFF80 : 0;
+    }
 
-                    if (op->opcode == OP_LB)
-                        val |= (val & 0x80) ? 0xFFFFFF80 : 0;
+    return val;
+}
 
-                    op->reg_dst_value = val;
-                }
-            }
-            break;
+/* does the op write HI/LO (multiply, divide, MTHI/MTLO)? */
+int pipe_writes_hilo(Pipe_Op *op)
+{
+    return op->opcode == OP_SPECIAL &&
+        (op->subop == SUBOP_MULT || op->subop == SUBOP_MULTU ||
+         op->subop == SUBOP_DIV || op->subop == SUBOP_DIVU ||
+         op->subop == SUBOP_MTHI || op->subop == SUBOP_MTLO);
+}
 
+/* the bytes of the aligned memory word a store writes: returns their byte
+ * enables (cache.h) and puts the data, shifted into place, in *val */
+uint32_t pipe_store_bytes(Pipe_Op *op, uint32_t *val)
+{
+    switch (op->opcode) {
         case OP_SB:
-            switch (op->mem_addr & 3) {
-                case 0: val = (val & 0xFFFFFF00) | ((op->mem_value & 0xFF) << 0); break;
-                case 1: val = (val & 0xFFFF00FF) | ((op->mem_value & 0xFF) << 8); break;
-                case 2: val = (val & 0xFF00FFFF) | ((op->mem_value & 0xFF) << 16); break;
-                case 3: val = (val & 0x00FFFFFF) | ((op->mem_value & 0xFF) << 24); break;
-            }
-
-            // mem_write_32(op->mem_addr & ~3, val);
-            // stat_cycles += 50;
-            cache_write(dcache, op->mem_addr & ~3, val);
-            break;
+            *val = (op->mem_value & 0xFF) << (8 * (op->mem_addr & 3));
+            return 1 << (op->mem_addr & 3);
 
         case OP_SH:
 #ifdef DEBUG
-            printf("SH: addr %08x val %04x old word %08x\n", op->mem_addr, op->mem_value & 0xFFFF, val);
-#endif
-            if (op->mem_addr & 2)
-                val = (val & 0x0000FFFF) | (op->mem_value) << 16;
-            else
-                val = (val & 0xFFFF0000) | (op->mem_value & 0xFFFF);
-#ifdef DEBUG
-            printf("new word %08x\n", val);
+            printf("SH: addr %08x val %04x\n", op->mem_addr, op->mem_value & 0xFFFF);
 #endif
+            *val = (op->mem_value & 0xFFFF) << (8 * (op->mem_addr & 2));
+            return 3 << (op->mem_addr & 2);
 
-            // mem_write_32(op->mem_addr & ~3, val);
-            // stat_cycles += 50;
-            cache_write(dcache, op->mem_addr & ~3, val);
-            break;
-
-        case OP_SW:
-            val = op->mem_value;
-            // mem_write_32(op->mem_addr & ~3, val);
-            // stat_cycles += 50;
-            cache_write(dcache, op->mem_addr & ~3, val);
-            break;
+        default:
+            *val = op->mem_value;
+            return BYTES_ALL;
     }
-
-    /* clear stage input and transfer to next stage */
-    pipe.mem_op = NULL;
-    pipe.wb_op = op;
 }
 
-void pipe_stage_execute()
+/* merge a store's data into the old contents of the aligned memory word */
+uint32_t pipe_store_word(Pipe_Op *op, uint32_t old_word)
 {
-    /* if a multiply/divide is in progress, decrement cycles until value is ready */
-    if (pipe.multiplier_stall > 0)
-        pipe.multiplier_stall--;
-
-    /* if downstream stall, return (and leave any input we had) */
-    if (pipe.mem_op != NULL)
-        return;
+    uint32_t val, mask = byte_mask(pipe_store_bytes(op, &val));
+    return (old_word & ~mask) | (val & mask);
+}
 
-    /* if no op to execute, return */
-    if (pipe.execute_op == NULL)
+void pipe_stage_mem()
+{
+    /* if there is no instruction in this pipeline stage, pass the bubble on */
+    if (!pipe.mem_op) {
+        pipe.wb_bubble = pipe.mem_bubble;
         return;
+    }
 
-    /* grab op and read sources */
-    Pipe_Op *op = pipe.execute_op;
+    /* grab the op out of our input slot */
+    Pipe_Op *op = pipe.mem_op;
+    PTRACE_STAGE(op, PROF_MEM, stat_cycles);
 
-    /* read register values, and check for bypass; stall if necessary */
-    int stall = 0;
-    if (op->reg_src1 != -1) {
-        if (op->reg_src1 == 0)
-            op->reg_src1_value = 0;
-        else if (pipe.mem_op && pipe.mem_op->reg_dst == op->reg_src1) {
-            if (!pipe.mem_op->reg_dst_value_ready)
-                stall = 1;
-            else
-                op->reg_src1_value = pipe.mem_op->reg_dst_value;
-        }
-        else if (pipe.wb_op && pipe.wb_op->reg_dst == op->reg_src1) {
-            op->reg_src1_value = pipe.wb_op->reg_dst_value;
+    if (op->is_mem) {
+        uint32_t addr = op->mem_addr & ~3;
+        if (pipe_translate(dtlb, addr, op->pc))
+            op->trace_flags |= PT_DTLB_MISS;
+        uint32_t val;
+
+        /* a store writes only its bytes, in the same single access */
+        if (op->mem_write) {
+            uint32_t bytes = pipe_store_bytes(op, &val);
+            cache_write(dcache, addr, val, bytes);
         }
         else
-            op->reg_src1_value = pipe.REGS[op->reg_src1];
-    }
-    if (op->reg_src2 != -1) {
-        if (op->reg_src2 == 0)
-            op->reg_src2_value = 0;
-        else if (pipe.mem_op && pipe.mem_op->reg_dst == op->reg_src2) {
-            if (!pipe.mem_op->reg_dst_value_ready)
-                stall = 1;
-            else
-                op->reg_src2_value = pipe.mem_op->reg_dst_value;
-        }
-        else if (pipe.wb_op && pipe.wb_op->reg_dst == op->reg_src2) {
-            op->reg_src2_value = pipe.wb_op->reg_dst_value;
+            val = cache_read(dcache, addr);
+        if (dcache->penalty)
+            op->trace_flags |= PT_DCACHE_MISS;
+        charge_cache_penalty(dcache, CPI_DCACHE, op->pc);
+
+        if (!op->mem_write) {
+            op->reg_dst_value_ready = 1;
+            op->reg_dst_value = pipe_load_value(op, val);
         }
-        else
-            op->reg_src2_value = pipe.REGS[op->reg_src2];
     }
 
-    /* if bypassing requires a stall (e.g. use immediately after load),
-     * return without clearing stage input */
-    if (stall) 
-        return;
+    /* clear stage input and transfer to next stage */
+    pipe.mem_op = NULL;
+    pipe.wb_op = op;
+}
+
+/* compute an op's results from its source values: destination value, branch
+ * outcome, or memory address and store value. HI/LO are read and written
+ * through 'hi' and 'lo'. Returns the latency of the operation (the
+ * multiplier and divider take longer than one cycle). */
+int pipe_alu(Pipe_Op *op, uint32_t *hi, uint32_t *lo)
+{
+    int latency = 1;
 
-    /* execute the op */
     switch (op->opcode) {
         case OP_SPECIAL:
             op->reg_dst_value_ready = 1;
@@ -344,21 +463,21 @@ void pipe_stage_execute()
                          */
                         int64_t val = (int64_t)((int32_t)op->reg_src1_value) * (int64_t)((int32_t)op->reg_src2_value);
                         uint64_t uval = (uint64_t)val;
-                        pipe.HI = (uval >> 32) & 0xFFFFFFFF;
-                        pipe.LO = (uval >>  0) & 0xFFFFFFFF;
+                        *hi = (uval >> 32) & 0xFFFFFFFF;
+                        *lo = (uval >>  0) & 0xFFFFFFFF;
 
-                        /* four-cycle multiplier latency */
-                        pipe.multiplier_stall = 4;
+                        /* multiplier latency (muldiv.h) */
+                        latency = muldiv_latency(op);
                     }
                     break;
                 case SUBOP_MULTU:
                     {
                         uint64_t val = (uint64_t)op->reg_src1_value * (uint64_t)op->reg_src2_value;
-                        pipe.HI = (val >> 32) & 0xFFFFFFFF;
-                        pipe.LO = (val >>  0) & 0xFFFFFFFF;
+                        *hi = (val >> 32) & 0xFFFFFFFF;
+                        *lo = (val >>  0) & 0xFFFFFFFF;
 
-                        /* four-cycle multiplier latency */
-                        pipe.multiplier_stall = 4;
+                        /* multiplier latency (muldiv.h) */
+                        latency = muldiv_latency(op);
                     }
                     break;
 
@@ -372,58 +491,42 @@ void pipe_stage_execute()
                         div = val1 / val2;
                         mod = val1 % val2;
 
-                        pipe.LO = div;
-                        pipe.HI = mod;
+                        *lo = div;
+                        *hi = mod;
                     } else {
                         // really this would be a div-by-0 exception
-                        pipe.HI = pipe.LO = 0;
+                        *hi = *lo = 0;
                     }
 
-                    /* 32-cycle divider latency */
-                    pipe.multiplier_stall = 32;
+                    /* divider latency, possibly operand-dependent (muldiv.h) */
+                    latency = muldiv_latency(op);
                     break;
 
                 case SUBOP_DIVU:
                     if (op->reg_src2_value != 0) {
-                        pipe.HI = (uint32_t)op->reg_src1_value % (uint32_t)op->reg_src2_value;
-                        pipe.LO = (uint32_t)op->reg_src1_value / (uint32_t)op->reg_src2_value;
+                        *hi = (uint32_t)op->reg_src1_value % (uint32_t)op->reg_src2_value;
+                        *lo = (uint32_t)op->reg_src1_value / (uint32_t)op->reg_src2_value;
                     } else {
                         /* really this would be a div-by-0 exception */
-                        pipe.HI = pipe.LO = 0;
+                        *hi = *lo = 0;
                     }
 
-                    /* 32-cycle divider latency */
-                    pipe.multiplier_stall = 32;
+                    /* divider latency, possibly operand-dependent (muldiv.h) */
+                    latency = muldiv_latency(op);
                     break;
 
                 case SUBOP_MFHI:
-                    /* stall until value is ready */
-                    if (pipe.multiplier_stall > 0)
-                        return;
-
-                    op->reg_dst_value = pipe.HI;
+                    op->reg_dst_value = *hi;
                     break;
                 case SUBOP_MTHI:
-                    /* stall to respect WAW dependence */
-                    if (pipe.multiplier_stall > 0)
-                        return;
-
-                    pipe.HI = op->reg_src1_value;
+                    *hi = op->reg_src1_value;
                     break;
 
                 case SUBOP_MFLO:
-                    /* stall until value is ready */
-                    if (pipe.multiplier_stall > 0)
-                        return;
-
-                    op->reg_dst_value = pipe.LO;
+                    op->reg_dst_value = *lo;
                     break;
                 case SUBOP_MTLO:
-                    /* stall to respect WAW dependence */
-                    if (pipe.multiplier_stall > 0)
-                        return;
-
-                    pipe.LO = op->reg_src1_value;
+                    *lo = op->reg_src1_value;
                     break;
 
                 case SUBOP_ADD:
@@ -532,29 +635,110 @@ void pipe_stage_execute()
             break;
     }
 
-    /* handle branch recoveries at this point */
-    if (op->branch_taken)
-        pipe_recover(3, op->branch_dest);
 
-    /* remove from upstream stage and place in downstream stage */
-    pipe.execute_op = NULL;
-    pipe.mem_op = op;
+    return latency;
 }
 
-void pipe_stage_decode()
+void pipe_stage_execute()
 {
+    /* if a multiply/divide is in progress, decrement cycles until value is ready */
+    if (pipe.multiplier_stall > 0)
+        pipe.multiplier_stall--;
+    if (pipe.multiplier_accept > 0)
+        pipe.multiplier_accept--;
+
+    if (pipe.execute_op)
+        PTRACE_STAGE(pipe.execute_op, PROF_EXECUTE, stat_cycles);
+
     /* if downstream stall, return (and leave any input we had) */
-    if (pipe.execute_op != NULL)
+    if (pipe.mem_op != NULL)
         return;
 
-    /* if no op to decode, return */
-    if (pipe.decode_op == NULL)
+    /* if no op to execute, pass the bubble on */
+    if (pipe.execute_op == NULL) {
+        pipe.mem_bubble = pipe.execute_bubble;
         return;
+    }
 
-    /* grab op and remove from stage input */
-    Pipe_Op *op = pipe.decode_op;
-    pipe.decode_op = NULL;
+    /* grab op and read sources */
+    Pipe_Op *op = pipe.execute_op;
 
+    /* read register values, and check for bypass; stall if necessary */
+    int stall = 0;
+    if (op->reg_src1 != -1) {
+        if (op->reg_src1 == 0)
+            op->reg_src1_value = 0;
+        else if (pipe.mem_op && pipe.mem_op->reg_dst == op->reg_src1) {
+            if (!pipe.mem_op->reg_dst_value_ready)
+                stall = 1;
+            else
+                op->reg_src1_value = pipe.mem_op->reg_dst_value;
+        }
+        else if (pipe.wb_op && pipe.wb_op->reg_dst == op->reg_src1) {
+            op->reg_src1_value = pipe.wb_op->reg_dst_value;
+        }
+        else
+            op->reg_src1_value = pipe.REGS[op->reg_src1];
+    }
+    if (op->reg_src2 != -1) {
+        if (op->reg_src2 == 0)
+            op->reg_src2_value = 0;
+        else if (pipe.mem_op && pipe.mem_op->reg_dst == op->reg_src2) {
+            if (!pipe.mem_op->reg_dst_value_ready)
+                stall = 1;
+            else
+                op->reg_src2_value = pipe.mem_op->reg_dst_value;
+        }
+        else if (pipe.wb_op && pipe.wb_op->reg_dst == op->reg_src2) {
+            op->reg_src2_value = pipe.wb_op->reg_dst_value;
+        }
+        else
+            op->reg_src2_value = pipe.REGS[op->reg_src2];
+    }
+
+    /* if bypassing requires a stall (e.g. use immediately after load),
+     * return without clearing stage input */
+    if (stall) {
+        pipe.mem_bubble = (Pipe_Bubble){ CPI_LOAD_USE, op->pc };
+        return;
+    }
+
+    /* MFHI/MFLO wait for a multiply/divide in flight; MTHI/MTLO also wait,
+     * to respect the WAW dependence. A multiply/divide waits until the
+     * unit can take it. */
+    if (muldiv_wait(op)) {
+        if (muldiv_kind(op) == MD_MOVE)
+            muldiv.hilo_wait++;
+        else
+            muldiv.unit_wait++;
+        pipe.mem_bubble = (Pipe_Bubble){ CPI_MULDIV, op->pc };
+        return;
+    }
+
+    /* execute the op; a new multiply/divide re-sets the stall cycle count */
+    int latency = pipe_alu(op, &pipe.HI, &pipe.LO);
+    int kind = muldiv_kind(op);
+    if (kind == MD_MUL || kind == MD_DIV) {
+        pipe.multiplier_stall = latency;
+        pipe.multiplier_accept = kind == MD_MUL ? muldiv_cfg.mul_interval : latency;
+        muldiv_start(op, latency);
+    }
+
+    /* handle branch recoveries at this point */
+    if (op->branch_taken) {
+        pipe_recover(3, op->branch_dest);
+        pipe.branch_pc = op->pc;
+    }
+
+    /* remove from upstream stage and place in downstream stage */
+    pipe.execute_op = NULL;
+    pipe.mem_op = op;
+}
+
+/* fill in an op's decoded fields (source/dest regs, immediate, jump dest)
+ * from its raw instruction */
+void pipe_decode_op(Pipe_Op *op)
+{
     /* set up info fields (source/dest regs, immediate, jump dest) as necessary */
     uint32_t opcode = (op->instruction >> 26) & 0x3F;
     uint32_t rs = (op->instruction >> 21) & 0x1F;
@@ -674,6 +858,28 @@ void pipe_stage_decode()
             }
             break;
     }
+}
+
+void pipe_stage_decode()
+{
+    if (pipe.decode_op)
+        PTRACE_STAGE(pipe.decode_op, PROF_DECODE, stat_cycles);
+
+    /* if downstream stall, return (and leave any input we had) */
+    if (pipe.execute_op != NULL)
+        return;
+
+    /* if no op to decode, pass the bubble on */
+    if (pipe.decode_op == NULL) {
+        pipe.execute_bubble = pipe.decode_bubble;
+        return;
+    }
+
+    /* grab op and remove from stage input */
+    Pipe_Op *op = pipe.decode_op;
+    pipe.decode_op = NULL;
+
+    pipe_decode_op(op);
 
     /* we will handle reg-read together with bypass in the execute stage */
 
@@ -691,11 +897,18 @@ void pipe_stage_fetch()
     Pipe_Op *op = malloc(sizeof(Pipe_Op));
     memset(op, 0, sizeof(Pipe_Op));
     op->reg_src1 = op->reg_src2 = op->reg_dst = -1;
+    if (ptrace_on)
+        ptrace_fetch(op);
 
     // op->instruction = mem_read_32(pipe.PC);
     // stat_cycles+=50;
     
-    op->instruction = cache_read(icache, pipe.PC);
+    if (pipe_translate(itlb, pipe.PC, pipe.PC))
+        op->trace_flags |= PT_ITLB_MISS;
+    op->instruction = fetch_buffer_read(&pipe.fetch_buf, icache, pipe.PC);
+    if (icache->penalty)
+        op->trace_flags |= PT_ICACHE_MISS;
+    charge_cache_penalty(icache, CPI_ICACHE, pipe.PC);
       
     op->pc = pipe.PC;
     pipe.decode_op = op;
@@ -11,6 +11,8 @@
 
 #include "shell.h"
 #include "cache.h"
+#include "stats.h"
+#include "profile.h"
 
 /* Pipeline ops (instances of this structure) are high-level representations of
  * the instructions that actually flow through the pipeline. This struct does
@@ -57,8 +59,22 @@ typedef struct Pipe_Op {
     int is_link;          /* jump-and-link or branch-and-link inst? */
     int link_reg;         /* register to place link into? */
 
+    /* lifecycle for --trace (ptrace.h) */
+    uint64_t trace_seq;
+    uint64_t trace_cycle[PROF_NSTAGES]; /* cycle the op first reached each stage */
+    uint8_t trace_stages;                /* bit PROF_*: trace_cycle[] entry is set */
+    uint8_t trace_flags;                 /* PT_*_MISS */
+
 } Pipe_Op;
 
+/* An empty stage input (bubble) remembers why it is empty and which
+ * instruction caused it, so the cycle in which it reaches writeback can be
+ * charged to that cause (CPI_* in stats.h) and PC. */
+typedef struct Pipe_Bubble {
+    int cause;
+    uint32_t pc;
+} Pipe_Bubble;
+
 /* The pipe state represents the current state of the pipeline. It holds a
  * pointer to the op that is currently at the input of each stage. As stages
  * execute, they remove the op from their input (set the pointer to NULL) and
@@ -71,6 +87,10 @@ typedef struct Pipe_State {
     /* pipe op currently at the input of the given stage (NULL for none) */
     Pipe_Op *decode_op, *execute_op, *mem_op, *wb_op;
 
+    /* when a stage input is empty, what left the bubble there. Bubbles
+     * travel down the pipe just like ops. */
+    Pipe_Bubble decode_bubble, execute_bubble, mem_bubble, wb_bubble;
+
     /* register file state */
     uint32_t REGS[32];
     uint32_t HI, LO;
@@ -84,12 +104,17 @@ typedef struct Pipe_State {
     int branch_recover; /* set to '1' to load a new PC */
     uint32_t branch_dest; /* next fetch will be from this PC */
     int branch_flush; /* how many stages to flush during recover? (1 = fetch, 2 = fetch/decode, ...) */
+    uint32_t branch_pc; /* PC of the instruction that requested the recovery */
 
     /* multiplier stall info */
     int multiplier_stall; /* number of remaining cycles until HI/LO are ready */
+    int multiplier_accept; /* cycles until the unit takes another multiply (muldiv.h) */
 
     /* place other information here as necessary */
 
+    /* icache block being fetched from */
+    fetch_buffer fetch_buf;
+
     /* memory-access stall*/
     int icache_stall;
     int dcache_stall;
@@ -97,7 +122,12 @@ typedef struct Pipe_State {
 } Pipe_State;
 
 /* global variable -- pipeline state */
-extern Pipe_State pipe;
+extern CORE_LOCAL Pipe_State pipe;
+
+/* timing model run by pipe_cycle(); both keep the architectural state
+ * (REGS, HI/LO, PC) in 'pipe' */
+enum { CORE_INORDER, CORE_OOO };
+extern int pipe_model;
 
 /* called during simulator startup */
 void pipe_init();
@@ -105,6 +135,11 @@ void pipe_init();
 /* this function calls the others */
 void pipe_cycle();
 
+/* right after pipe_cycle(): skip up to 'max' following cycles in which no
+ * op can move, accounting for them as pipe_cycle() would. Returns the
+ * number of cycles skipped; the caller adds them to stat_cycles. */
+uint64_t pipe_skip(uint64_t max);
+
 /* helper: pipe stages can call this to schedule a branch recovery */
 /* flushes 'flush' stages (1 = execute only, 2 = fetch/decode, ...) and then
  * sets the fetch PC to the given destination. */
@@ -117,4 +152,12 @@ void pipe_stage_execute();
 void pipe_stage_mem();
 void pipe_stage_wb();
 
+/* stage logic shared with other core models (ooo.c) */
+void pipe_decode_op(Pipe_Op *op);
+int pipe_alu(Pipe_Op *op, uint32_t *hi, uint32_t *lo);
+uint32_t pipe_load_value(Pipe_Op *op, uint32_t word);
+uint32_t pipe_store_bytes(Pipe_Op *op, uint32_t *val);
+uint32_t pipe_store_word(Pipe_Op *op, uint32_t old_word);
+int pipe_writes_hilo(Pipe_Op *op);
+
 #endif
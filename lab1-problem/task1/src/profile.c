@@ -0,0 +1,203 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "profile.h"
+#include "shell.h"
+#include "pipe.h"
+#include "asm.h"
+
+#define PROFILE_ENTRIES (MEM_REGIONS[MEM_TEXT].size / 4)
+
+CORE_LOCAL profile_entry* profile = NULL;
+
+static char program_file[256];
+
+static profile_entry* entry(uint32_t pc){
+    uint32_t i = (pc - MEM_TEXT_START) >> 2;    // wraps for pc < MEM_TEXT_START
+    return i < PROFILE_ENTRIES ? &profile[i] : NULL;
+}
+
+void profile_enable(){
+    // Restarting the profile clears it
+    profile_disable();
+    profile = calloc(PROFILE_ENTRIES, sizeof(profile_entry));
+}
+
+void profile_disable(){
+    free(profile);
+    profile = NULL;
+}
+
+void profile_set_program(const char* filename){
+    strncpy(program_file, filename, sizeof(program_file) - 1);
+}
+
+void profile_occupancy(uint32_t cycles){
+    profile_entry* e;
+
+    // The fetch stage holds pipe.PC whether it fetches or stalls
+    if((e = entry(pipe.PC))) e->stage[PROF_FETCH] += cycles;
+    if(pipe.decode_op && (e = entry(pipe.decode_op->pc))) e->stage[PROF_DECODE] += cycles;
+    if(pipe.execute_op && (e = entry(pipe.execute_op->pc))) e->stage[PROF_EXECUTE] += cycles;
+    if(pipe.mem_op && (e = entry(pipe.mem_op->pc))) e->stage[PROF_MEM] += cycles;
+    if(pipe.wb_op && (e = entry(pipe.wb_op->pc))) e->stage[PROF_WB] += cycles;
+}
+
+void profile_retire(uint32_t pc){
+    profile_entry* e = entry(pc);
+    if(e){
+        e->count++;
+        e->cost++;
+    }
+}
+
+void profile_charge(uint32_t pc, uint32_t cycles){
+    profile_entry* e = entry(pc);
+    if(e) e->cost += cycles;
+}
+
+void profile_miss(uint32_t pc, int stage, uint32_t penalty){
+    profile_entry* e = entry(pc);
+    if(e == NULL)
+        return;
+
+    e->cost += penalty;
+    e->stage[stage] += penalty;
+    if(stage == PROF_FETCH) e->icache_miss++;
+    else e->dcache_miss++;
+}
+
+void profile_flush(uint32_t pc){
+    profile_entry* e = entry(pc);
+    if(e) e->flushes++;
+}
+
+/* Source mapping */
+
+// Map each text word to the .s line it came from, as the assembler
+// (asm.h) placed it. Returns the number of words mapped; lines[i] is a
+// malloc'd copy of the statement.
+static int load_source(const char* path, char*** lines_out, int** lineno_out){
+    asm_image image;
+    if(!asm_file(path, &image))
+        return 0;
+    FILE* src = fopen(path, "r");
+    if(src == NULL){
+        asm_free(&image);
+        return 0;
+    }
+
+    // The statement on each line, labels and comment cut
+    int cap = 1024, nsrc = 1;
+    char** statement = malloc(cap * sizeof(char*));
+    char buf[1024];
+    statement[0] = NULL;
+    while(fgets(buf, sizeof(buf), src)){
+        char* s = buf;
+        char* hash = strchr(s, '#');
+        if(hash) *hash = '\0';
+
+        // Skip leading labels
+        while(1){
+            while(isspace((unsigned char)*s)) s++;
+            char* p = s;
+            while(isalnum((unsigned char)*p) || *p == '_' || *p == '.') p++;
+            if(p != s && *p == ':') s = p + 1;
+            else break;
+        }
+
+        char* end = s + strlen(s);
+        while(end > s && isspace((unsigned char)end[-1])) *--end = '\0';
+        if(nsrc == cap){
+            cap *= 2;
+            statement = realloc(statement, cap * sizeof(char*));
+        }
+        statement[nsrc++] = strdup(s);
+    }
+    fclose(src);
+
+    int n = image.text_size / 4;
+    char** lines = malloc((n ? n : 1) * sizeof(char*));
+    int* linenos = malloc((n ? n : 1) * sizeof(int));
+    for(int i=0; i<n; i++){
+        uint32_t line = image.text_line[i];
+        lines[i] = strdup(line > 0 && line < nsrc ? statement[line] : "");
+        linenos[i] = line;
+    }
+    for(int i=1; i<nsrc; i++)
+        free(statement[i]);
+    free(statement);
+    asm_free(&image);
+
+    *lines_out = lines;
+    *lineno_out = linenos;
+    return n;
+}
+
+static int cmp_cost(const void* a, const void* b){
+    const profile_entry* x = &profile[*(const uint32_t*)a];
+    const profile_entry* y = &profile[*(const uint32_t*)b];
+    if(x->cost != y->cost) return x->cost < y->cost ? 1 : -1;
+    return *(const uint32_t*)a < *(const uint32_t*)b ? -1 : 1;
+}
+
+void profile_dump(FILE* out, int n){
+    if(profile == NULL){
+        fprintf(out, "Profiling is off (use 'profile on' before running)\n");
+        return;
+    }
+
+    uint32_t* order = malloc(PROFILE_ENTRIES * sizeof(uint32_t));
+    uint32_t used = 0;
+    uint64_t total = 0;
+    for(uint32_t i=0; i<PROFILE_ENTRIES; i++){
+        if(profile[i].cost || profile[i].stage[PROF_FETCH]){
+            order[used++] = i;
+            total += profile[i].cost;
+        }
+    }
+    qsort(order, used, sizeof(uint32_t), cmp_cost);
+
+    // The program itself, or the .s next to a .x
+    char path[sizeof(program_file) + 2];
+    char** lines = NULL;
+    int* linenos = NULL;
+    int nlines = 0;
+    strcpy(path, program_file);
+    char* dot = strrchr(path, '.');
+    if(dot && strcmp(dot, ".x") == 0)
+        strcpy(dot, ".s");
+    if(asm_is_source(path))
+        nlines = load_source(path, &lines, &linenos);
+
+    if(n <= 0 || n > used) n = used;
+    fprintf(out, "Per-PC profile: top %d of %u instructions, %lu cycles charged\n",
+            n, used, (unsigned long)total);
+    fprintf(out, "  %-10s %10s %10s %6s %8s %8s %8s %8s %8s %6s %6s %6s  %s\n",
+            "pc", "count", "cost", "share", "fetch", "decode", "execute", "mem", "wb",
+            "imiss", "dmiss", "flush", "source");
+    for(int k=0; k<n; k++){
+        uint32_t i = order[k];
+        profile_entry* e = &profile[i];
+        fprintf(out, "  0x%08x %10lu %10lu %5.1f%% %8lu %8lu %8lu %8lu %8lu %6u %6u %6u  ",
+                MEM_TEXT_START + 4 * i, (unsigned long)e->count, (unsigned long)e->cost,
+                total ? 100.0 * e->cost / total : 0.0,
+                (unsigned long)e->stage[PROF_FETCH], (unsigned long)e->stage[PROF_DECODE],
+                (unsigned long)e->stage[PROF_EXECUTE], (unsigned long)e->stage[PROF_MEM],
+                (unsigned long)e->stage[PROF_WB],
+                e->icache_miss, e->dcache_miss, e->flushes);
+        if(i < nlines)
+            fprintf(out, "%d: %s\n", linenos[i], lines[i]);
+        else
+            fprintf(out, "\n");
+    }
+
+    for(int i=0; i<nlines; i++)
+        free(lines[i]);
+    free(lines);
+    free(linenos);
+    free(order);
+}
@@ -0,0 +1,46 @@
+/************************************/
+/*                                  */
+/*      Per-PC Profile              */
+/*                                  */
+/************************************/
+
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "shell.h"
+
+enum{ PROF_FETCH, PROF_DECODE, PROF_EXECUTE, PROF_MEM, PROF_WB, PROF_NSTAGES };
+
+// One entry per static instruction in the text segment
+typedef struct{
+    uint64_t count;                 // dynamic executions (retired)
+    uint64_t cost;                  // retire cycles + bubbles caused + miss penalties
+    uint64_t stage[PROF_NSTAGES];   // cycles resident in each stage
+    uint32_t icache_miss;
+    uint32_t dcache_miss;
+    uint32_t flushes;               // taken branches that flushed the pipe
+} profile_entry;
+
+// Flat table indexed by (pc - MEM_TEXT_START)/4; NULL while profiling is off.
+// Only core 0 is profiled: the table stays NULL on every other core.
+extern CORE_LOCAL profile_entry* profile;
+
+void profile_enable();
+void profile_disable();
+void profile_set_program(const char* filename);
+
+// Hooks called by the pipeline (only when profile != NULL)
+void profile_occupancy(uint32_t cycles);
+void profile_retire(uint32_t pc);
+void profile_charge(uint32_t pc, uint32_t cycles);
+void profile_miss(uint32_t pc, int stage, uint32_t penalty);
+void profile_flush(uint32_t pc);
+
+// Print the 'n' most expensive instructions, annotated with the source
+// lines the assembler (asm.h) put them at: the program's own, or those of
+// the .s next to a .x
+void profile_dump(FILE*, int n);
+
+#endif
@@ -0,0 +1,60 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "ptrace.h"
+#include "bufwriter.h"
+#include "pipe.h"
+
+ptrace_window ptrace_win = { 0, UINT64_MAX, 0, UINT32_MAX };
+CORE_LOCAL bool ptrace_on = false;
+
+static bufwriter* out;
+static uint64_t seq;
+
+bool ptrace_open(const char* filename){
+    out = bufwriter_open(filename);
+    if(out == NULL)
+        return false;
+
+    ptrace_header h = { PTRACE_MAGIC, PTRACE_VERSION, sizeof(ptrace_record), 0 };
+    bufwriter_write(out, &h, sizeof(h));
+    seq = 0;
+    ptrace_on = true;
+    return true;
+}
+
+void ptrace_close(){
+    if(!ptrace_on)
+        return;
+    ptrace_on = false;
+    bufwriter_close(out);
+    out = NULL;
+}
+
+void ptrace_fetch(Pipe_Op* op){
+    op->trace_seq = seq++;
+    op->trace_stages = 0;
+    PTRACE_STAGE(op, PROF_FETCH, stat_cycles);
+}
+
+void ptrace_end(Pipe_Op* op, bool flushed){
+    uint64_t fetched = op->trace_cycle[PROF_FETCH];
+    if(!(op->trace_stages & (1 << PROF_FETCH)))
+        return;
+    if(fetched < ptrace_win.cycle_lo || fetched > ptrace_win.cycle_hi)
+        return;
+    if(op->pc < ptrace_win.pc_lo || op->pc > ptrace_win.pc_hi)
+        return;
+
+    ptrace_record r;
+    memset(&r, 0, sizeof(r));
+    r.seq = op->trace_seq;
+    memcpy(r.cycle, op->trace_cycle, sizeof(r.cycle));
+    r.end = stat_cycles;
+    r.pc = op->pc;
+    r.instruction = op->instruction;
+    r.stages = op->trace_stages;
+    r.flags = op->trace_flags | (flushed ? PT_FLUSHED : 0) | (pipe_model == CORE_OOO ? PT_OOO : 0);
+    bufwriter_write(out, &r, sizeof(r));
+}
@@ -0,0 +1,80 @@
+/************************************/
+/*                                  */
+/*      Pipeline Trace              */
+/*                                  */
+/************************************/
+
+#ifndef _PTRACE_H
+#define _PTRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "shell.h"
+#include "profile.h"
+
+// With --trace, every instruction core 0 fetches leaves one fixed-size
+// binary record when it retires or is flushed: the cycle it entered each
+// stage, how it ended and what it missed in. Records are copied into a
+// buffer that a writer thread empties (and, for a .gz file, compresses)
+// while the simulation goes on. ptrace2kanata.py turns a trace into the
+// Kanata log the Konata pipeline viewer reads.
+//
+// On the ooo core the stages are fetch, dispatch, issue and commit;
+// PROF_MEM holds the cycle the result was ready.
+
+#define PTRACE_MAGIC   0x43525450   // "PTRC"
+#define PTRACE_VERSION 1
+
+// ptrace_record.flags
+#define PT_FLUSHED      0x01    // squashed by a branch recovery instead of retiring
+#define PT_ICACHE_MISS  0x02
+#define PT_DCACHE_MISS  0x04
+#define PT_ITLB_MISS    0x08
+#define PT_DTLB_MISS    0x10
+#define PT_OOO          0x20    // from the ooo core (see above for its stages)
+
+typedef struct{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t reserved;
+} ptrace_header;
+
+typedef struct{
+    uint64_t seq;                   // fetch order
+    uint64_t cycle[PROF_NSTAGES];   // valid where 'stages' has bit PROF_*
+    uint64_t end;                   // cycle it retired or was flushed
+    uint32_t pc;
+    uint32_t instruction;
+    uint8_t stages;
+    uint8_t flags;
+    uint8_t pad[6];
+} ptrace_record;
+
+// Only ops fetched in [cycle_lo, cycle_hi] from [pc_lo, pc_hi] are written
+typedef struct{
+    uint64_t cycle_lo, cycle_hi;
+    uint32_t pc_lo, pc_hi;
+} ptrace_window;
+
+extern ptrace_window ptrace_win;
+
+// Set on core 0 while a trace is open
+extern CORE_LOCAL bool ptrace_on;
+
+bool ptrace_open(const char* filename);     // false if it can't be written
+void ptrace_close();
+
+struct Pipe_Op;
+void ptrace_fetch(struct Pipe_Op*);         // numbers the op, records its fetch
+void ptrace_end(struct Pipe_Op*, bool flushed);
+
+// Record the cycle 'op' first reached 'stage'
+#define PTRACE_STAGE(op, stage, at) do{ \
+    if(ptrace_on && !((op)->trace_stages & (1 << (stage)))){ \
+        (op)->trace_cycle[stage] = (at); \
+        (op)->trace_stages |= 1 << (stage); \
+    } \
+}while(0)
+
+#endif
@@ -0,0 +1,207 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "server.h"
+#include "shell.h"
+#include "dump.h"
+
+#define MAX_LINE 4096
+#define MAX_ARGS 64
+#define MAX_MDUMP_WORDS (1 << 20)
+
+static FILE* reply;             // the original stdout
+static char program[256];       // for the JSON
+static bool loaded;
+
+static void respond(bool ok, const char* data, size_t n){
+    fprintf(reply, "%s %zu\n", ok ? "ok" : "error", n);
+    fwrite(data, 1, n, reply);
+    fflush(reply);
+}
+
+static void fail(const char* message){
+    char line[256];
+    int n = snprintf(line, sizeof(line), "%s\n", message);
+    respond(false, line, n);
+}
+
+// A 32-bit value, given signed or unsigned in any base strtoll takes
+static bool parse_word(const char* arg, uint32_t* value){
+    char* end;
+    long long v = strtoll(arg, &end, 0);
+    if(*arg == '\0' || *end != '\0' || v < INT32_MIN || v > UINT32_MAX)
+        return false;
+    *value = (uint32_t)v;
+    return true;
+}
+
+static void send_json(){
+    char* buf = NULL;
+    size_t len = 0;
+    FILE* out = open_memstream(&buf, &len);
+    stats_json(out, program);
+    fclose(out);
+    respond(true, buf, len);
+    free(buf);
+}
+
+static void send_rdump(){
+    char* buf = NULL;
+    size_t len = 0;
+    FILE* out = open_memstream(&buf, &len);
+    rdump_to(out);
+    fclose(out);
+    respond(true, buf, len);
+    free(buf);
+}
+
+static void send_mdump(uint32_t low, uint32_t high){
+    char* buf = NULL;
+    size_t len = 0;
+    FILE* out = open_memstream(&buf, &len);
+    fprintf(out, "[");
+    for(uint64_t a = low & ~3u; a <= high; a += 4)
+        fprintf(out, "%s%u", a == (low & ~3u) ? "" : ", ", mem_read_32(a));
+    fprintf(out, "]\n");
+    fclose(out);
+    respond(true, buf, len);
+    free(buf);
+}
+
+// export <file> [<low> <high>]...: the data segment if no ranges are given
+static void export_state(int argc, char** argv){
+    dump_range ranges[DUMP_MAX_RANGES];
+    int nranges = 0;
+
+    if(argc < 2 || argc % 2 != 0 || (argc - 2) / 2 > DUMP_MAX_RANGES){
+        fail("export: expected a file and low high pairs");
+        return;
+    }
+    for(int i=2; i<argc; i+=2, nranges++)
+        if(!parse_word(argv[i], &ranges[nranges].low) || !parse_word(argv[i+1], &ranges[nranges].high) ||
+           ranges[nranges].high < ranges[nranges].low){
+            fail("export: expected low <= high");
+            return;
+        }
+    if(nranges == 0){
+        ranges[0].low = MEM_REGIONS[MEM_DATA].start;
+        ranges[0].high = MEM_REGIONS[MEM_DATA].start + MEM_REGIONS[MEM_DATA].size - 1;
+        nranges = 1;
+    }
+
+    if(dump_export(argv[1], ranges, nranges))
+        respond(true, "", 0);
+    else
+        fail("export: can't write the dump");
+}
+
+static void handle(int argc, char** argv){
+    const char* cmd = argv[0];
+    uint32_t a, b;
+
+    if(strcmp(cmd, "load") == 0){
+        if(argc < 2)
+            fail("load: no program");
+        else if(!reload(argv + 1, argc - 1))
+            fail("load: can't read a program");
+        else{
+            snprintf(program, sizeof(program), "%s", argv[1]);
+            loaded = true;
+            respond(true, "", 0);
+        }
+        return;
+    }
+    if(!loaded){
+        fail("no program loaded");
+        return;
+    }
+
+    if(strcmp(cmd, "input") == 0 || strcmp(cmd, "i") == 0){
+        if(argc != 3 || !parse_word(argv[1], &a) || a >= 32 || !parse_word(argv[2], &b))
+            fail("input: expected a register 0..31 and a value");
+        else{
+            set_register(a, b);
+            respond(true, "", 0);
+        }
+    }
+    else if(strcmp(cmd, "high") == 0 || strcmp(cmd, "h") == 0 ||
+            strcmp(cmd, "low") == 0 || strcmp(cmd, "l") == 0){
+        if(argc != 2 || !parse_word(argv[1], &b))
+            fail("high/low: expected a value");
+        else{
+            set_register(cmd[0] == 'h' ? REG_HI : REG_LO, b);
+            respond(true, "", 0);
+        }
+    }
+    else if(strcmp(cmd, "go") == 0){
+        if(RUN_BIT)
+            go();
+        send_json();
+    }
+    else if(strcmp(cmd, "run") == 0){
+        if(argc != 2 || !parse_word(argv[1], &a))
+            fail("run: expected a cycle count");
+        else{
+            for(uint32_t i=0; i<a && RUN_BIT; i++)
+                cycle();
+            send_json();
+        }
+    }
+    else if(strcmp(cmd, "rdump") == 0)
+        send_rdump();
+    else if(strcmp(cmd, "dump") == 0)
+        send_json();
+    else if(strcmp(cmd, "mdump") == 0){
+        if(argc != 3 || !parse_word(argv[1], &a) || !parse_word(argv[2], &b) || b < a)
+            fail("mdump: expected low <= high");
+        else if((b - a) / 4 >= MAX_MDUMP_WORDS)
+            fail("mdump: range too large");
+        else
+            send_mdump(a, b);
+    }
+    else if(strcmp(cmd, "export") == 0)
+        export_state(argc, argv);
+    else
+        fail("unknown command");
+}
+
+void server_run(const char* loaded_program){
+    if(loaded_program){
+        snprintf(program, sizeof(program), "%s", loaded_program);
+        loaded = true;
+    }
+
+    // Replies keep the real stdout; whatever else the simulator prints
+    // lands on stderr
+    fflush(stdout);
+    reply = fdopen(dup(STDOUT_FILENO), "w");
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+
+    char line[MAX_LINE];
+    while(fgets(line, sizeof(line), stdin)){
+        if(strchr(line, '\n') == NULL && !feof(stdin)){
+            int c;
+            while((c = getchar()) != EOF && c != '\n')
+                ;
+            fail("request too long");
+            continue;
+        }
+
+        char* argv[MAX_ARGS];
+        int argc = 0;
+        for(char* tok = strtok(line, " \t\r\n"); tok && argc < MAX_ARGS; tok = strtok(NULL, " \t\r\n"))
+            argv[argc++] = tok;
+        if(argc == 0 || argv[0][0] == '#')
+            continue;
+
+        if(strcmp(argv[0], "quit") == 0){
+            respond(true, "", 0);
+            break;
+        }
+        handle(argc, argv);
+    }
+    fclose(reply);
+}
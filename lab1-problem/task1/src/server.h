@@ -0,0 +1,37 @@
+/************************************/
+/*                                  */
+/*      Resident Request Server     */
+/*                                  */
+/************************************/
+
+#ifndef _SERVER_H
+#define _SERVER_H
+
+// With --server, the simulator stays up and runs one program after another
+// on request, so a test harness pays for process startup and memory setup
+// once rather than per test. Requests are lines on stdin:
+//
+//   load <file.x> ...      start over with these programs
+//   input <reg> <value>    set a register (also "i"; "high"/"h", "low"/"l")
+//   go                     run until halted or --max-cycles/--max-insts
+//   run <n>                run n cycles
+//   rdump                  the shell's register and statistics dump
+//   dump                   state and statistics as JSON (as --stats-json)
+//   mdump <low> <high>     memory words low..high as a JSON array
+//   export <file> [<low> <high>]...
+//                          write a binary dump (see dump.h), by default of
+//                          the data segment
+//   quit
+//
+// Blank lines and lines starting with '#' are skipped.
+//
+// Every request gets one reply on stdout: a line "ok <n>" or "error <n>",
+// then n bytes of payload (go and run reply with the JSON of dump). The
+// simulator's own output, such as a --check mismatch report, goes to
+// stderr instead.
+
+// Serve requests until quit or the end of stdin. 'program' names what the
+// command line already loaded, NULL if nothing.
+void server_run(const char* program);
+
+#endif
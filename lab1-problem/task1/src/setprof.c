@@ -0,0 +1,243 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "setprof.h"
+#include "shell.h"
+
+#define HEATMAP_ROW 64      // sets per heatmap line
+
+bool setprof_enabled = false;
+
+static const char shades[] = " .:-=+*#%@";
+static const char* class_names[MISS_NCLASSES] = { "compulsory", "capacity", "conflict", "coherence" };
+
+static uint32_t log2_of(uint32_t x){
+    uint32_t n = 0;
+    while(x >>= 1)
+        n++;
+    return n;
+}
+
+set_profile* setprof_new(uint32_t sets, uint32_t ways, uint32_t block_size){
+    set_profile* p = calloc(1, sizeof(set_profile));
+    p->sets = sets;
+    p->ways = ways;
+    p->block_size = block_size;
+    p->set = calloc(sets, sizeof(set_stats));
+
+    // One bit for each block of the 4 GB address space; pages are only
+    // backed once a block in them is seen
+    p->seen_bytes = (uint32_t)((1ULL << 32) / block_size / 8);
+    p->seen = mem_alloc(p->seen_bytes);
+
+    p->capacity = sets * ways;
+    p->entry = calloc(p->capacity, sizeof(shadow_entry));
+    p->mru = p->lru = -1;
+    uint32_t buckets = 1;
+    while(buckets < 2 * p->capacity)
+        buckets <<= 1;
+    p->bucket = malloc(buckets * sizeof(int32_t));
+    for(uint32_t i=0; i<buckets; i++)
+        p->bucket[i] = -1;
+    p->bucket_mask = buckets - 1;
+    return p;
+}
+
+void setprof_free(set_profile* p){
+    if(p == NULL)
+        return;
+    mem_free(p->seen, p->seen_bytes);
+    free(p->set);
+    free(p->entry);
+    free(p->bucket);
+    free(p);
+}
+
+static uint32_t hash(const set_profile* p, uint32_t block){
+    return (block * 2654435761u) & p->bucket_mask;
+}
+
+static int32_t shadow_find(const set_profile* p, uint32_t block){
+    for(int32_t e = p->bucket[hash(p, block)]; e >= 0; e = p->entry[e].chain)
+        if(p->entry[e].block == block)
+            return e;
+    return -1;
+}
+
+static void list_unlink(set_profile* p, int32_t e){
+    shadow_entry* s = &p->entry[e];
+    if(s->prev >= 0) p->entry[s->prev].next = s->next; else p->mru = s->next;
+    if(s->next >= 0) p->entry[s->next].prev = s->prev; else p->lru = s->prev;
+}
+
+static void list_push_mru(set_profile* p, int32_t e){
+    shadow_entry* s = &p->entry[e];
+    s->prev = -1;
+    s->next = p->mru;
+    if(p->mru >= 0) p->entry[p->mru].prev = e; else p->lru = e;
+    p->mru = e;
+}
+
+static void chain_unlink(set_profile* p, int32_t e){
+    int32_t* link = &p->bucket[hash(p, p->entry[e].block)];
+    while(*link != e)
+        link = &p->entry[*link].chain;
+    *link = p->entry[e].chain;
+}
+
+// Bring 'block' in as the most recently used, pushing out the least
+// recently used block once the cache is full
+static void shadow_insert(set_profile* p, uint32_t block){
+    int32_t e;
+    if(p->used < p->capacity)
+        e = p->used++;
+    else{
+        e = p->lru;
+        list_unlink(p, e);
+        chain_unlink(p, e);
+    }
+
+    shadow_entry* s = &p->entry[e];
+    s->block = block;
+    s->invalidated = false;
+    uint32_t h = hash(p, block);
+    s->chain = p->bucket[h];
+    p->bucket[h] = e;
+    list_push_mru(p, e);
+}
+
+void setprof_access(set_profile* p, uint32_t addr, bool miss, bool evicted, bool allocate){
+    uint32_t block = addr >> log2_of(p->block_size);
+    set_stats* s = &p->set[block & (p->sets - 1)];
+
+    uint8_t bit = 1 << (block & 7);
+    bool seen = p->seen[block >> 3] & bit;
+    p->seen[block >> 3] |= bit;
+
+    int32_t e = shadow_find(p, block);
+
+    s->accesses++;
+    if(miss){
+        s->misses++;
+        if(!seen)
+            s->miss_class[MISS_COMPULSORY]++;
+        else if(e >= 0 && p->entry[e].invalidated)
+            s->miss_class[MISS_COHERENCE]++;
+        else if(e < 0)
+            s->miss_class[MISS_CAPACITY]++;
+        else
+            s->miss_class[MISS_CONFLICT]++;
+    }
+    if(evicted)
+        s->evictions++;
+
+    if(e >= 0){
+        p->entry[e].invalidated = false;
+        list_unlink(p, e);
+        list_push_mru(p, e);
+    }
+    else if(allocate)
+        shadow_insert(p, block);
+}
+
+void setprof_invalidate(set_profile* p, uint32_t addr){
+    int32_t e = shadow_find(p, addr >> log2_of(p->block_size));
+    if(e >= 0)
+        p->entry[e].invalidated = true;
+}
+
+void setprof_totals(const set_profile* p, set_stats* total){
+    memset(total, 0, sizeof(*total));
+    for(uint32_t i=0; i<p->sets; i++){
+        total->accesses += p->set[i].accesses;
+        total->misses += p->set[i].misses;
+        total->evictions += p->set[i].evictions;
+        for(int c=0; c<MISS_NCLASSES; c++)
+            total->miss_class[c] += p->set[i].miss_class[c];
+    }
+}
+
+void setprof_print_stats(const set_profile* p, const char* name, FILE* out){
+    set_stats total;
+    setprof_totals(p, &total);
+
+    fprintf(out, "%s misses by cause: %" PRIu64 " compulsory, %" PRIu64 " capacity, %" PRIu64 " conflict",
+            name, total.miss_class[MISS_COMPULSORY], total.miss_class[MISS_CAPACITY],
+            total.miss_class[MISS_CONFLICT]);
+    if(total.miss_class[MISS_COHERENCE])
+        fprintf(out, ", %" PRIu64 " coherence", total.miss_class[MISS_COHERENCE]);
+    fprintf(out, "\n");
+
+    // How unevenly the sets share the misses
+    uint32_t busiest = 0;
+    for(uint32_t i=1; i<p->sets; i++)
+        if(p->set[i].misses > p->set[busiest].misses)
+            busiest = i;
+    fprintf(out, "  misses per set: avg %.1f, most %" PRIu64 " (set %u)\n",
+            (double)total.misses / p->sets, p->set[busiest].misses, busiest);
+}
+
+void setprof_print_json(const set_profile* p, FILE* out){
+    set_stats total;
+    setprof_totals(p, &total);
+
+    fprintf(out, "{\"accesses\": %" PRIu64 ", \"misses\": %" PRIu64 ", \"evictions\": %" PRIu64,
+            total.accesses, total.misses, total.evictions);
+    for(int c=0; c<MISS_NCLASSES; c++)
+        fprintf(out, ", \"%s\": %" PRIu64, class_names[c], total.miss_class[c]);
+    fprintf(out, "}");
+}
+
+// One line of shades per HEATMAP_ROW sets, scaled to the largest count
+static void heatmap(const set_profile* p, const char* what, uint64_t (*count)(const set_stats*), FILE* out){
+    uint64_t max = 0;
+    for(uint32_t i=0; i<p->sets; i++)
+        if(count(&p->set[i]) > max)
+            max = count(&p->set[i]);
+
+    fprintf(out, "# %s per set: ' ' none, '%c' few, '%c' %" PRIu64 "\n", what, shades[1],
+            shades[sizeof(shades) - 2], max);
+    for(uint32_t i=0; i<p->sets; i++){
+        if(i % HEATMAP_ROW == 0)
+            fprintf(out, "# %5u |", i);
+        uint64_t n = count(&p->set[i]);
+        int level = n ? 1 + (int)(n * (sizeof(shades) - 3) / max) : 0;
+        fputc(shades[level], out);
+        if(i % HEATMAP_ROW == HEATMAP_ROW - 1 || i == p->sets - 1)
+            fprintf(out, "|\n");
+    }
+}
+
+static uint64_t count_accesses(const set_stats* s){ return s->accesses; }
+static uint64_t count_misses(const set_stats* s){ return s->misses; }
+static uint64_t count_conflicts(const set_stats* s){ return s->miss_class[MISS_CONFLICT]; }
+
+void setprof_write(const set_profile* p, const char* name, FILE* out){
+    set_stats total;
+    setprof_totals(p, &total);
+
+    fprintf(out, "# %s: %u sets x %u ways, %u-byte blocks\n", name, p->sets, p->ways, p->block_size);
+    fprintf(out, "# %" PRIu64 " accesses, %" PRIu64 " misses (", total.accesses, total.misses);
+    for(int c=0; c<MISS_NCLASSES; c++)
+        fprintf(out, "%s%" PRIu64 " %s", c ? ", " : "", total.miss_class[c], class_names[c]);
+    fprintf(out, "), %" PRIu64 " evictions\n", total.evictions);
+    heatmap(p, "accesses", count_accesses, out);
+    heatmap(p, "misses", count_misses, out);
+    heatmap(p, "conflict misses", count_conflicts, out);
+
+    fprintf(out, "# set accesses misses evictions");
+    for(int c=0; c<MISS_NCLASSES; c++)
+        fprintf(out, " %s", class_names[c]);
+    fprintf(out, "\n");
+    for(uint32_t i=0; i<p->sets; i++){
+        const set_stats* s = &p->set[i];
+        fprintf(out, "%u %" PRIu64 " %" PRIu64 " %" PRIu64, i, s->accesses, s->misses, s->evictions);
+        for(int c=0; c<MISS_NCLASSES; c++)
+            fprintf(out, " %" PRIu64, s->miss_class[c]);
+        fprintf(out, "\n");
+    }
+    fprintf(out, "\n");
+}
@@ -0,0 +1,82 @@
+/************************************/
+/*                                  */
+/*      Cache Set Profiles          */
+/*                                  */
+/************************************/
+
+#ifndef _SETPROF_H
+#define _SETPROF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// With --set-stats, every cache counts accesses, misses and evictions per
+// set and sorts each miss by cause (the 3Cs):
+//   compulsory  the block was never referenced before
+//   capacity    a fully associative LRU cache with as many blocks would
+//               have missed too
+//   conflict    the rest: the set was full while the cache was not
+//   coherence   (multi-core dcaches) another core's write invalidated it
+// Misses served by the victim cache still count: the sets missed. A
+// store that goes around the cache counts as a miss that allocates in
+// neither the cache nor the fully associative one.
+
+#define MISS_COMPULSORY 0
+#define MISS_CAPACITY   1
+#define MISS_CONFLICT   2
+#define MISS_COHERENCE  3
+#define MISS_NCLASSES   4
+
+typedef struct{
+    uint64_t accesses, misses, evictions;
+    uint64_t miss_class[MISS_NCLASSES];
+} set_stats;
+
+// A block of the fully associative cache; the entries form an LRU list
+// and hash chains by block number
+typedef struct{
+    uint32_t block;
+    bool invalidated;       // a snoop dropped it from the real cache
+    int32_t prev, next;     // toward the most/least recently used
+    int32_t chain;
+} shadow_entry;
+
+typedef struct{
+    uint32_t sets, ways, block_size;
+    set_stats* set;
+
+    uint8_t* seen;          // a bit per block number ever referenced
+    uint32_t seen_bytes;
+
+    shadow_entry* entry;
+    uint32_t capacity, used;
+    int32_t mru, lru;
+    int32_t* bucket;
+    uint32_t bucket_mask;
+} set_profile;
+
+extern bool setprof_enabled;        // --set-stats: init_cache() adds profiles
+
+set_profile* setprof_new(uint32_t sets, uint32_t ways, uint32_t block_size);
+void setprof_free(set_profile*);
+
+// An access to 'addr' that missed or not, and whether it evicted a block.
+// 'allocate' is false for a miss that does not fill the cache.
+void setprof_access(set_profile*, uint32_t addr, bool miss, bool evicted, bool allocate);
+
+// Another core's write invalidated the block at 'addr'
+void setprof_invalidate(set_profile*, uint32_t addr);
+
+// Summed over the sets
+void setprof_totals(const set_profile*, set_stats*);
+
+// A few lines for rdump, and a JSON object
+void setprof_print_stats(const set_profile*, const char* name, FILE*);
+void setprof_print_json(const set_profile*, FILE*);
+
+// Miss heatmaps (one character per set) and the per-set counters as a
+// table, for the --set-stats file
+void setprof_write(const set_profile*, const char* name, FILE*);
+
+#endif
@@ -6,48 +6,52 @@
 /*                                                             */
 /***************************************************************/
 
-/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!! */
-/*          DO NOT MODIFY THIS FILE!                            */
-/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!! */
+/* The shell: command-line options, the interactive and batch   */
+/* front ends, program loading and the statistics reports.      */
 
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/auxv.h>
 
 #include "shell.h"
 #include "pipe.h"
+#include "profile.h"
+#include "ooo.h"
+#include "core.h"
+#include "interval.h"
+#include "simpoint.h"
+#include "check.h"
+#include "dram.h"
+#include "tlb.h"
+#include "hostprof.h"
+#include "ptrace.h"
+#include "server.h"
+#include "muldiv.h"
+#include "dump.h"
+#include "setprof.h"
+#include "lockstep.h"
+#include "asm.h"
 
 /***************************************************************/
 /* Statistics.                                                 */
 /***************************************************************/
 
-uint32_t stat_cycles = 0, stat_inst_retire = 0, stat_inst_fetch = 0;
-uint32_t stat_squash = 0;
+/* 64-bit: long kernels overflow 32-bit cycle counts */
+CORE_LOCAL uint64_t stat_cycles = 0, stat_inst_retire = 0, stat_inst_fetch = 0;
+CORE_LOCAL uint64_t stat_squash = 0;
 
 /***************************************************************/
 /* Main memory.                                                */
 /***************************************************************/
 
-#define MEM_DATA_START  0x10000000
-#define MEM_DATA_SIZE   0x00100000
-#define MEM_TEXT_START  0x00400000
-#define MEM_TEXT_SIZE   0x00100000
-#define MEM_STACK_START 0x7ff00000
-#define MEM_STACK_SIZE  0x00100000
-#define MEM_KDATA_START 0x90000000
-#define MEM_KDATA_SIZE  0x00100000
-#define MEM_KTEXT_START 0x80000000
-#define MEM_KTEXT_SIZE  0x00100000
-
-typedef struct {
-    uint32_t start, size;
-    uint8_t *mem;
-} mem_region_t;
-
-/* memory will be dynamically allocated at initialization */
-mem_region_t MEM_REGIONS[] = {
+/* memory is reserved at initialization and filled in on demand */
+mem_region_t MEM_REGIONS[MEM_NREGIONS] = {
     { MEM_TEXT_START, MEM_TEXT_SIZE, NULL },
     { MEM_DATA_START, MEM_DATA_SIZE, NULL },
     { MEM_STACK_START, MEM_STACK_SIZE, NULL },
@@ -55,9 +59,36 @@ mem_region_t MEM_REGIONS[] = {
     { MEM_KTEXT_START, MEM_KTEXT_SIZE, NULL }
 };
 
-#define MEM_NREGIONS (sizeof(MEM_REGIONS)/sizeof(mem_region_t))
+/* the memory image this thread simulates: the shared MEM_REGIONS unless
+ * the thread works on a private copy (interval simulation) */
+CORE_LOCAL mem_region_t *mem_regions = MEM_REGIONS;
 
-int RUN_BIT = TRUE;
+CORE_LOCAL int RUN_BIT = TRUE;
+
+/* set once the program touches memory past the data segment */
+static int unmapped_warned = FALSE;
+
+/* batch-mode settings (see usage()) */
+int QUIET = FALSE, IDLE_SKIP = TRUE;
+uint64_t MAX_CYCLES = UINT64_MAX, MAX_INSTS = UINT64_MAX;
+
+/***************************************************************/
+/*                                                             */
+/* Procedure: unmapped_access                                  */
+/*                                                             */
+/* Purpose: Warn once when the program runs off the end of the */
+/*          data segment or the bottom of the stack            */
+/*                                                             */
+/***************************************************************/
+static void unmapped_access(uint32_t address)
+{
+    if (unmapped_warned ||
+            address < MEM_REGIONS[MEM_DATA].start || address >= MEM_REGIONS[MEM_STACK].start)
+        return;
+    unmapped_warned = TRUE;
+    fprintf(stderr, "Warning: 0x%08x is between the data and stack segments and reads "
+            "as zero (see --data-size, --stack-size)\n", address);
+}
 
 /***************************************************************/
 /*                                                             */
@@ -69,19 +100,24 @@ int RUN_BIT = TRUE;
 uint32_t mem_read_32(uint32_t address)
 {
     int i;
+    HOSTPROF_ENTER(HP_MEMORY);
     for (i = 0; i < MEM_NREGIONS; i++) {
-        if (address >= MEM_REGIONS[i].start &&
-                address < (MEM_REGIONS[i].start + MEM_REGIONS[i].size)) {
-            uint32_t offset = address - MEM_REGIONS[i].start;
-
-            return
-                (MEM_REGIONS[i].mem[offset+3] << 24) |
-                (MEM_REGIONS[i].mem[offset+2] << 16) |
-                (MEM_REGIONS[i].mem[offset+1] <<  8) |
-                (MEM_REGIONS[i].mem[offset+0] <<  0);
+        if (address >= mem_regions[i].start &&
+                address < (mem_regions[i].start + mem_regions[i].size)) {
+            uint32_t offset = address - mem_regions[i].start;
+            uint32_t value =
+                (mem_regions[i].mem[offset+3] << 24) |
+                (mem_regions[i].mem[offset+2] << 16) |
+                (mem_regions[i].mem[offset+1] <<  8) |
+                (mem_regions[i].mem[offset+0] <<  0);
+
+            HOSTPROF_LEAVE();
+            return value;
         }
     }
+    HOSTPROF_LEAVE();
 
+    unmapped_access(address);
     return 0;
 }
 
@@ -95,18 +131,23 @@ uint32_t mem_read_32(uint32_t address)
 void mem_write_32(uint32_t address, uint32_t value)
 {
     int i;
+    HOSTPROF_ENTER(HP_MEMORY);
     for (i = 0; i < MEM_NREGIONS; i++) {
-        if (address >= MEM_REGIONS[i].start &&
-                address < (MEM_REGIONS[i].start + MEM_REGIONS[i].size)) {
-            uint32_t offset = address - MEM_REGIONS[i].start;
-
-            MEM_REGIONS[i].mem[offset+3] = (value >> 24) & 0xFF;
-            MEM_REGIONS[i].mem[offset+2] = (value >> 16) & 0xFF;
-            MEM_REGIONS[i].mem[offset+1] = (value >>  8) & 0xFF;
-            MEM_REGIONS[i].mem[offset+0] = (value >>  0) & 0xFF;
+        if (address >= mem_regions[i].start &&
+                address < (mem_regions[i].start + mem_regions[i].size)) {
+            uint32_t offset = address - mem_regions[i].start;
+
+            mem_regions[i].mem[offset+3] = (value >> 24) & 0xFF;
+            mem_regions[i].mem[offset+2] = (value >> 16) & 0xFF;
+            mem_regions[i].mem[offset+1] = (value >>  8) & 0xFF;
+            mem_regions[i].mem[offset+0] = (value >>  0) & 0xFF;
+            HOSTPROF_LEAVE();
             return;
         }
     }
+    HOSTPROF_LEAVE();
+
+    unmapped_access(address);
 }
 
 /***************************************************************/
@@ -122,7 +163,11 @@ void help() {
   printf("run n                  -  execute program for n instructions\n");
   printf("rdump                  -  dump architectural registers      \n");
   printf("mdump low high         -  dump memory from low to high      \n");
+  printf("export file [lo hi]... -  binary dump of memory lo..hi (default: data)\n");
   printf("input reg_no reg_value - set GPR reg_no to reg_value  \n");
+  printf("cpi n file             -  write CPI stack every n cycles to file\n");
+  printf("profile on|off         -  start/stop the per-PC profile     \n");
+  printf("profile n              -  show the n most expensive PCs     \n");
   printf("?                      -  display this help menu            \n");
   printf("quit                   -  exit the program                  \n\n");
 }
@@ -135,9 +180,32 @@ void help() {
 /*                                                             */
 /***************************************************************/
 void cycle() {                                                
+  cycle_skip(0);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : cycle_skip                                      */
+/*                                                             */
+/* Purpose   : Execute a cycle, then jump over the cycles in   */
+/*             which the pipeline waits for a long-latency     */
+/*             unit, stopping at 'limit' or the next CPI row   */
+/*                                                             */
+/***************************************************************/
+void cycle_skip(uint64_t limit) {
   pipe_cycle();
 
   stat_cycles++;
+
+  if (IDLE_SKIP && RUN_BIT) {
+    if (limit > cpi_next)
+      limit = cpi_next;
+    if (stat_cycles < limit)
+      stat_cycles += pipe_skip(limit - stat_cycles);
+  }
+
+  if (stat_cycles >= cpi_next || RUN_BIT == FALSE)
+    cpi_interval_dump();
 }
 
 /***************************************************************/
@@ -150,12 +218,21 @@ void cycle() {
 void run(int num_cycles) {                                      
   int i;
 
-  if (RUN_BIT == FALSE) {
+  if (!core_running()) {
     printf("Can't simulate, Simulator is halted\n\n");
     return;
   }
 
   printf("Simulating for %d cycles...\n\n", num_cycles);
+  if (ncores > 1) {
+    uint64_t end = core_time + num_cycles;
+    while (core_running() && core_time < end)
+      core_step(end);
+    if (!core_running())
+      printf("Simulator halted\n\n");
+    return;
+  }
+
   for (i = 0; i < num_cycles; i++) {
     if (RUN_BIT == FALSE) {
 	    printf("Simulator halted\n\n");
@@ -173,40 +250,179 @@ void run(int num_cycles) {
 /*                                                             */
 /***************************************************************/
 void go() {                                                     
-  if (RUN_BIT == FALSE) {
+  if (!core_running()) {
     printf("Can't simulate, Simulator is halted\n\n");
     return;
   }
 
-  printf("Simulating...\n\n");
-  while (RUN_BIT)
-    cycle();
-  printf("Simulator halted\n\n");
+  if (!QUIET) printf("Simulating...\n\n");
+  if (ncores > 1) {
+    /* limits are checked between quanta */
+    while (core_running() && core_time < MAX_CYCLES && core_retired() < MAX_INSTS)
+      core_step(MAX_CYCLES);
+  }
+  else {
+    while (RUN_BIT && stat_cycles < MAX_CYCLES && stat_inst_retire < MAX_INSTS)
+      cycle_skip(MAX_CYCLES);
+  }
+  if (!QUIET) printf(core_running() ? "Simulation limit reached\n\n" : "Simulator halted\n\n");
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : dcache_policy_set                               */
+/*                                                             */
+/* Purpose   : Whether the dcache is not plain write-back and  */
+/*             write-allocate, which is when its write stats   */
+/*             are reported                                    */
+/*                                                             */
+/***************************************************************/
+static int dcache_policy_set() {
+  return dcache_cfg.write_through || !dcache_cfg.write_allocate || dcache_cfg.victim_entries;
 }
 
 /***************************************************************/ 
 /*                                                             */
-/* Procedure : rdump                                           */
+/* Procedure : rdump, rdump_to                                 */
 /*                                                             */
 /* Purpose   : Dump architectural registers and other stats    */
 /*                                                             */
 /***************************************************************/
 void rdump() {
+    rdump_to(stdout);
+}
+
+void rdump_to(FILE *out) {
     int i;
 
-    printf("PC: 0x%08x\n", pipe.PC);
+    fprintf(out, "PC: 0x%08x\n", pipe.PC);
 
     for (i = 0; i < 32; i++) {
-        printf("R%d: 0x%08x\n", i, pipe.REGS[i]);
+        fprintf(out, "R%d: 0x%08x\n", i, pipe.REGS[i]);
     }
 
-    printf("HI: 0x%08x\n", pipe.HI);
-    printf("LO: 0x%08x\n", pipe.LO);
-    printf("Cycles: %u\n", stat_cycles);
-    printf("FetchedInstr: %u\n", stat_inst_fetch);
-    printf("RetiredInstr: %u\n", stat_inst_retire);
-    printf("IPC: %0.3f\n", ((float) stat_inst_retire) / stat_cycles);
-    printf("Flushes: %u\n", stat_squash);
+    fprintf(out, "HI: 0x%08x\n", pipe.HI);
+    fprintf(out, "LO: 0x%08x\n", pipe.LO);
+    fprintf(out, "Cycles: %" PRIu64 "\n", stat_cycles);
+    fprintf(out, "FetchedInstr: %" PRIu64 "\n", stat_inst_fetch);
+    fprintf(out, "RetiredInstr: %" PRIu64 "\n", stat_inst_retire);
+    fprintf(out, "IPC: %0.3f\n", ((float) stat_inst_retire) / stat_cycles);
+    fprintf(out, "Flushes: %" PRIu64 "\n", stat_squash);
+    cpi_print(out);
+    if (pipe_model == CORE_OOO)
+      ooo_print_stats(out);
+    if (dram)
+      dram_print_stats(out);
+    /* interval runs keep their caches and TLBs in the worker threads */
+    if (!interval_length)
+      fprintf(out, "Fetch buffer: %" PRIu64 " hits (%.1f%% of fetches), %" PRIu64 " icache reads\n",
+              pipe.fetch_buf.stat_hits,
+              stat_inst_fetch ? 100.0 * pipe.fetch_buf.stat_hits / stat_inst_fetch : 0.0,
+              pipe.fetch_buf.stat_fills);
+    if (dcache_policy_set() && !interval_length)
+      cache_print_stats(dcache, "dcache", out);
+    if (icache->profile && !interval_length) {
+      setprof_print_stats(icache->profile, "icache", out);
+      setprof_print_stats(dcache->profile, "dcache", out);
+    }
+    if ((muldiv.muls || muldiv.divs) && !interval_length)
+      muldiv_print_stats(out);
+    if (itlb && itlb->accesses)
+      tlb_print_stats(out);
+    if (ncores > 1)
+      core_print_stats(out);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : json_string                                     */
+/*                                                             */
+/* Purpose   : Write a string as a quoted, escaped JSON string */
+/*                                                             */
+/***************************************************************/
+static void json_string(FILE *out, const char *s) {
+  fputc('"', out);
+  for (; *s; s++) {
+    unsigned char c = *s;
+    if (c == '"' || c == '\\')
+      fprintf(out, "\\%c", c);
+    else if (c < 0x20)
+      fprintf(out, "\\u%04x", c);
+    else
+      fputc(c, out);
+  }
+  fputc('"', out);
+}
+
+/***************************************************************/ 
+/*                                                             */
+/* Procedure : stats_json                                      */
+/*                                                             */
+/* Purpose   : Write final state and statistics as JSON        */
+/*                                                             */
+/***************************************************************/
+void stats_json(FILE *out, const char *program) {
+    int i;
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"program\": ");
+    json_string(out, program);
+    fprintf(out, ",\n");
+    fprintf(out, "  \"halted\": %s,\n", core_running() ? "false" : "true");
+    if (check_enabled)
+      fprintf(out, "  \"check_failed\": %s,\n", check_failed ? "true" : "false");
+    fprintf(out, "  \"pc\": %u,\n", pipe.PC);
+    fprintf(out, "  \"regs\": [");
+    for (i = 0; i < 32; i++)
+        fprintf(out, "%s%u", i ? ", " : "", pipe.REGS[i]);
+    fprintf(out, "],\n");
+    fprintf(out, "  \"hi\": %u,\n", pipe.HI);
+    fprintf(out, "  \"lo\": %u,\n", pipe.LO);
+    fprintf(out, "  \"cycles\": %" PRIu64 ",\n", stat_cycles);
+    fprintf(out, "  \"fetched\": %" PRIu64 ",\n", stat_inst_fetch);
+    fprintf(out, "  \"retired\": %" PRIu64 ",\n", stat_inst_retire);
+    fprintf(out, "  \"ipc\": %.6f,\n", stat_cycles ? (double) stat_inst_retire / stat_cycles : 0.0);
+    fprintf(out, "  \"flushes\": %" PRIu64 ",\n", stat_squash);
+    fprintf(out, "  \"cpi_stack\": ");
+    cpi_print_json(out);
+    if (dram)
+      fprintf(out, ",\n  \"dram\": {\"reads\": %" PRIu64 ", \"writes\": %" PRIu64 ", \"read_latency\": %" PRIu64
+              ", \"row_hits\": %" PRIu64 ", \"row_empty\": %" PRIu64 ", \"row_conflicts\": %" PRIu64 "}",
+              dram->reads, dram->writes, dram->read_latency, dram->row_hits, dram->row_empty,
+              dram->row_conflicts);
+    if (!interval_length)
+      fprintf(out, ",\n  \"fetch_buffer\": {\"hits\": %" PRIu64 ", \"fills\": %" PRIu64 "}",
+              pipe.fetch_buf.stat_hits, pipe.fetch_buf.stat_fills);
+    if (dcache_policy_set() && !interval_length)
+      fprintf(out, ",\n  \"dcache\": {\"victim_hits\": %" PRIu64 ", \"writebacks\": %" PRIu64
+              ", \"write_through\": %" PRIu64 ", \"write_around\": %" PRIu64 "}",
+              dcache->stat_victim_hits, dcache->stat_writebacks, dcache->stat_write_through,
+              dcache->stat_write_around);
+    if (icache->profile && !interval_length) {
+      fprintf(out, ",\n  \"set_stats\": {\"icache\": ");
+      setprof_print_json(icache->profile, out);
+      fprintf(out, ", \"dcache\": ");
+      setprof_print_json(dcache->profile, out);
+      fprintf(out, "}");
+    }
+    if ((muldiv.muls || muldiv.divs) && !interval_length)
+      fprintf(out, ",\n  \"muldiv\": {\"muls\": %" PRIu64 ", \"divs\": %" PRIu64 ", \"div_cycles\": %" PRIu64
+              ", \"hilo_wait\": %" PRIu64 ", \"unit_wait\": %" PRIu64 "}",
+              muldiv.muls, muldiv.divs, muldiv.div_cycles, muldiv.hilo_wait, muldiv.unit_wait);
+    if (itlb && itlb->accesses)
+      fprintf(out, ",\n  \"tlb\": {\"itlb_accesses\": %" PRIu64 ", \"itlb_misses\": %" PRIu64
+              ", \"dtlb_accesses\": %" PRIu64 ", \"dtlb_misses\": %" PRIu64 ", \"walk_cycles\": %" PRIu64 "}",
+              itlb->accesses, itlb->misses, dtlb->accesses, dtlb->misses,
+              itlb->walk_cycles + dtlb->walk_cycles);
+    if (ncores > 1) {
+      fprintf(out, ",\n  \"cores\": [");
+      for (i = 0; i < ncores; i++)
+        fprintf(out, "%s\n    {\"pc\": %u, \"cycles\": %" PRIu64 ", \"retired\": %" PRIu64 ", \"halted\": %s}",
+                i ? "," : "", cores[i].pipe->PC, *cores[i].cycles, *cores[i].retired,
+                *cores[i].run_bit ? "false" : "true");
+      fprintf(out, "\n  ]");
+    }
+    fprintf(out, "\n}\n");
 }
 
 /***************************************************************/ 
@@ -227,6 +443,70 @@ void mdump(int start, int stop) {
   printf("\n");
 }
 
+/***************************************************************/
+/*                                                             */
+/* Procedure : write_set_stats                                 */
+/*                                                             */
+/* Purpose   : Write the per-set cache heatmaps and counters   */
+/*             of every core to 'filename'                     */
+/*                                                             */
+/***************************************************************/
+static void write_set_stats(const char *filename) {
+  char name[32];
+  int i;
+  FILE *out = fopen(filename, "w");
+
+  if (out == NULL) {
+    fprintf(stderr, "Error: Can't open %s\n", filename);
+    exit(1);
+  }
+  for (i = 0; i < ncores; i++) {
+    snprintf(name, sizeof(name), ncores > 1 ? "core %d icache" : "icache", i);
+    setprof_write((*cores[i].icache)->profile, name, out);
+    snprintf(name, sizeof(name), ncores > 1 ? "core %d dcache" : "dcache", i);
+    setprof_write((*cores[i].dcache)->profile, name, out);
+  }
+  fclose(out);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : export_state                                    */
+/*                                                             */
+/* Purpose   : Write a binary dump of the ranges in 'args',    */
+/*             pairs of "low high"; the data segment if none   */
+/*                                                             */
+/***************************************************************/
+static void export_state(const char *filename, char *args) {
+  dump_range ranges[DUMP_MAX_RANGES];
+  int nranges = 0;
+  char *end;
+
+  while (1) {
+    unsigned long low = strtoul(args, &end, 0);
+    if (end == args)
+      break;
+    args = end;
+    unsigned long high = strtoul(args, &end, 0);
+    if (end == args || high < low || high > UINT32_MAX || nranges == DUMP_MAX_RANGES) {
+      printf("Invalid range\n");
+      return;
+    }
+    args = end;
+    ranges[nranges].low = low;
+    ranges[nranges].high = high;
+    nranges++;
+  }
+  if (nranges == 0) {
+    ranges[0].low = MEM_REGIONS[MEM_DATA].start;
+    ranges[0].high = MEM_REGIONS[MEM_DATA].start + MEM_REGIONS[MEM_DATA].size - 1;
+    nranges = 1;
+  }
+
+  if (dump_export(filename, ranges, nranges))
+    printf("Wrote %s\n", filename);
+}
+
 /***************************************************************/
 /*                                                             */
 /* Procedure : get_command                                     */
@@ -235,7 +515,7 @@ void mdump(int start, int stop) {
 /*                                                             */
 /***************************************************************/
 void get_command() {
-  char buffer[20];
+  char buffer[20], filename[256], line[256];
   int start, stop, cycles;
   int register_no, register_value;
 
@@ -260,6 +540,14 @@ void get_command() {
     mdump(start, stop);
     break;
 
+  case 'E':
+  case 'e':
+    if (scanf("%255s", filename) != 1 || fgets(line, sizeof(line), stdin) == NULL)
+        break;
+
+    export_state(filename, line);
+    break;
+
   case '?':
     help();
     break;
@@ -278,13 +566,34 @@ void get_command() {
     }
     break;
 
+  case 'C':
+  case 'c':
+    if (scanf("%i %255s", &cycles, filename) != 2)
+        break;
+
+    cpi_interval_open(cycles, filename);
+    break;
+
+  case 'P':
+  case 'p':
+    if (scanf("%255s", filename) != 1)
+        break;
+
+    if (strcmp(filename, "on") == 0)
+        profile_enable();
+    else if (strcmp(filename, "off") == 0)
+        profile_disable();
+    else
+        profile_dump(stdout, atoi(filename));
+    break;
+
   case 'I':
   case 'i':
    if (scanf("%i %i", &register_no, &register_value) != 2)
       break;
    
    printf("%i %i\n", register_no, register_value);
-   pipe.REGS[register_no] = register_value;
+   set_register(register_no, register_value);
    break;
    
   case 'H':
@@ -292,7 +601,7 @@ void get_command() {
    if (scanf("%i", &register_value) != 1)
       break;
 
-   pipe.HI = register_value; 
+   set_register(REG_HI, register_value);
    break;
   
   case 'L':
@@ -300,7 +609,7 @@ void get_command() {
    if (scanf("%i", &register_value) != 1)
       break;
 
-   pipe.LO = register_value; 
+   set_register(REG_LO, register_value);
    break;
 
   default:
@@ -309,6 +618,60 @@ void get_command() {
   }
 }
 
+/***************************************************************/
+/*                                                             */
+/* Procedure : mem_alloc, mem_free                             */
+/*                                                             */
+/* Purpose   : Reserve and release the backing of a region     */
+/*                                                             */
+/***************************************************************/
+uint8_t *mem_alloc(uint32_t size) {
+    /* anonymous pages read as zero and only take host memory once
+     * written, so reserving a large segment costs nothing up front */
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED) {
+        fprintf(stderr, "Error: Can't reserve %u bytes of simulated memory\n", size);
+        exit(1);
+    }
+    return mem;
+}
+
+void mem_free(uint8_t *mem, uint32_t size) {
+    if (mem != NULL)
+        munmap(mem, size);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : mem_used_pages                                  */
+/*                                                             */
+/* Purpose   : Find the pages of a region that hold data       */
+/*                                                             */
+/***************************************************************/
+void mem_used_pages(const uint8_t *mem, uint32_t size, uint8_t *used) {
+    /* a page never written (or dropped since) is not resident and reads
+     * as zero, so only resident ones are scanned: a region of gigabytes
+     * costs what the program touched. mincore() counts host pages. */
+    uint64_t host_page = getauxval(AT_PAGESZ);
+    uint32_t p, k, npages = size >> MEM_PAGE_BITS;
+    unsigned char *resident = malloc((size + host_page - 1) / host_page);
+    int known = mincore((void *)mem, size, resident) == 0;
+
+    for (p = 0; p < npages; p++) {
+        const uint8_t *page = mem + ((uint64_t)p << MEM_PAGE_BITS);
+        used[p] = 0;
+        if (known && !(resident[((uint64_t)p << MEM_PAGE_BITS) / host_page] & 1))
+            continue;
+        for (k = 0; k < 1u << MEM_PAGE_BITS; k++)
+            if (page[k]) {
+                used[p] = 1;
+                break;
+            }
+    }
+    free(resident);
+}
+
 /***************************************************************/
 /*                                                             */
 /* Procedure : init_memory                                     */
@@ -318,10 +681,137 @@ void get_command() {
 /***************************************************************/
 void init_memory() {                                           
     int i;
+    for (i = 0; i < MEM_NREGIONS; i++)
+        MEM_REGIONS[i].mem = mem_alloc(MEM_REGIONS[i].size);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : set_tlb_size                                    */
+/*                                                             */
+/* Purpose   : Parse "entries[:ways]" for a TLB and turn the   */
+/*             TLBs on; FALSE if it is not a valid geometry    */
+/*                                                             */
+/***************************************************************/
+static int set_tlb_size(const char *arg, int *entries, int *ways) {
+  int n, w = *ways;
+
+  if (sscanf(arg, "%d:%d", &n, &w) < 1)
+    return FALSE;
+  if (n < 1 || w < 1 || n % w != 0)
+    return FALSE;
+
+  *entries = n;
+  *ways = w;
+  tlb_cfg.enabled = true;
+  return TRUE;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : parse_range                                     */
+/*                                                             */
+/* Purpose   : Parse "lo:hi" (either may be left out) for the  */
+/*             trace window and export ranges; FALSE if it is  */
+/*             malformed                                       */
+/*                                                             */
+/***************************************************************/
+static int parse_range(const char *arg, uint64_t *lo, uint64_t *hi) {
+  const char *colon = strchr(arg, ':');
+  char *end;
+
+  if (colon == NULL)
+    return FALSE;
+  if (colon != arg) {
+    *lo = strtoull(arg, &end, 0);
+    if (end != colon)
+      return FALSE;
+  }
+  if (colon[1]) {
+    *hi = strtoull(colon + 1, &end, 0);
+    if (*end)
+      return FALSE;
+  }
+  return *lo <= *hi;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : set_region_size                                 */
+/*                                                             */
+/* Purpose   : Resize a region before memory is allocated;     */
+/*             FALSE if it would overlap another region        */
+/*                                                             */
+/***************************************************************/
+static int set_region_size(int region, const char *arg) {
+    char *end;
+    uint64_t size = strtoull(arg, &end, 0);
+    mem_region_t *r = &MEM_REGIONS[region];
+    int i;
+
+    switch (*end) {
+    case 'k': case 'K': size <<= 10; end++; break;
+    case 'm': case 'M': size <<= 20; end++; break;
+    case 'g': case 'G': size <<= 30; end++; break;
+    }
+    if (*end != '\0' || size == 0)
+        return FALSE;
+    size = (size + 0xFFF) & ~(uint64_t)0xFFF;     /* whole pages */
+
+    /* the stack keeps its top address and grows down */
+    uint64_t start = r->start, top = (uint64_t)r->start + r->size;
+    if (region == MEM_STACK) {
+        if (size > top)
+            return FALSE;
+        start = top - size;
+    }
+    if (start + size > UINT32_MAX + 1ULL)
+        return FALSE;
     for (i = 0; i < MEM_NREGIONS; i++) {
-        MEM_REGIONS[i].mem = malloc(MEM_REGIONS[i].size);
-        memset(MEM_REGIONS[i].mem, 0, MEM_REGIONS[i].size);
+        uint64_t s = MEM_REGIONS[i].start, e = s + MEM_REGIONS[i].size;
+        if (i != region && start < e && s < start + size)
+            return FALSE;
     }
+
+    r->start = start;
+    r->size = size;
+    return TRUE;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : load_assembly                                   */
+/*                                                             */
+/* Purpose   : Assemble a .s program into the text and data    */
+/*             segments                                        */
+/*                                                             */
+/***************************************************************/
+static void load_assembly(char *program_filename) {
+  asm_image image;
+  uint32_t i;
+
+  if (!asm_file(program_filename, &image)) {
+    printf("Error: Can't assemble program file %s\n", program_filename);
+    exit(-1);
+  }
+  if (image.text_size > mem_regions[MEM_TEXT].size || image.data_size > mem_regions[MEM_DATA].size) {
+    printf("Error: Program file %s does not fit its segments\n", program_filename);
+    exit(-1);
+  }
+
+  for (i = 0; i < image.text_size; i += 4)
+    mem_write_32(MEM_TEXT_START + i, image.text[i] | (image.text[i+1] << 8) |
+                 (image.text[i+2] << 16) | ((uint32_t)image.text[i+3] << 24));
+  /* the data segment is padded to whole words with zeros */
+  for (i = 0; i < image.data_size; i += 4) {
+    uint8_t word[4] = { 0, 0, 0, 0 };
+    memcpy(word, image.data + i, image.data_size - i < 4 ? image.data_size - i : 4);
+    mem_write_32(MEM_DATA_START + i, word[0] | (word[1] << 8) | (word[2] << 16) | ((uint32_t)word[3] << 24));
+  }
+  if (!QUIET) printf("Assembled %u words of text and %u bytes of data.\n\n",
+                     image.text_size / 4, image.data_size);
+  asm_free(&image);
+  profile_set_program(program_filename);
 }
 
 /**************************************************************/
@@ -335,6 +825,12 @@ void load_program(char *program_filename) {
   FILE * prog;
   int ii, word;
 
+  /* assembly source: assemble it (asm.h) */
+  if (asm_is_source(program_filename)) {
+    load_assembly(program_filename);
+    return;
+  }
+
   /* Open program file. */
   prog = fopen(program_filename, "r");
   if (prog == NULL) {
@@ -350,7 +846,10 @@ void load_program(char *program_filename) {
     ii += 4;
   }
 
-  printf("Read %d words from program into memory.\n\n", ii/4);
+  fclose(prog);
+  profile_set_program(program_filename);
+
+  if (!QUIET) printf("Read %d words from program into memory.\n\n", ii/4);
 }
 
 /************************************************************/
@@ -361,17 +860,80 @@ void load_program(char *program_filename) {
 /*             and set up initial state of the machine.     */
 /*                                                          */
 /************************************************************/
-void initialize(char *program_filename, int num_prog_files) { 
+void initialize(char **program_filenames, int num_prog_files) { 
   int i;
 
   init_memory();
-  pipe_init();
-  for ( i = 0; i < num_prog_files; i++ ) {
-    load_program(program_filename);
-    while(*program_filename++ != '\0');
+  core_init();
+  for ( i = 0; i < num_prog_files; i++ )
+    load_program(program_filenames[i]);
+
+  RUN_BIT = TRUE;
+}
+
+/************************************************************/
+/*                                                          */
+/* Procedure : reload                                       */
+/*                                                          */
+/* Purpose   : Start over with other programs without a new */
+/*             process: zero memory, rebuild the core and   */
+/*             clear the statistics, then load.             */
+/*                                                          */
+/************************************************************/
+int reload(char **program_filenames, int num_prog_files) {
+  FILE *prog;
+  int i;
+
+  /* load_program gives up on the whole process, so check first;
+   * assembly is assembled once more to see that it can be */
+  for (i = 0; i < num_prog_files; i++) {
+    if (asm_is_source(program_filenames[i])) {
+      asm_image image;
+      if (!asm_file(program_filenames[i], &image))
+        return FALSE;
+      asm_free(&image);
+      continue;
+    }
+    if ((prog = fopen(program_filenames[i], "r")) == NULL)
+      return FALSE;
+    fclose(prog);
   }
-    
+
+  /* dropped pages read as zero again and are only backed once written,
+   * so this costs what the last program touched, not the segment sizes */
+  for (i = 0; i < MEM_NREGIONS; i++)
+    madvise(MEM_REGIONS[i].mem, MEM_REGIONS[i].size, MADV_DONTNEED);
+  unmapped_warned = FALSE;
+
+  stat_cycles = stat_inst_retire = stat_inst_fetch = stat_squash = 0;
+  core_init();
+  for (i = 0; i < num_prog_files; i++)
+    load_program(program_filenames[i]);
+
   RUN_BIT = TRUE;
+  if (check_enabled)
+    check_init();
+  return TRUE;
+}
+
+/************************************************************/
+/*                                                          */
+/* Procedure : set_register                                 */
+/*                                                          */
+/* Purpose   : Set a GPR, HI (REG_HI) or LO (REG_LO)        */
+/*                                                          */
+/************************************************************/
+void set_register(int reg, uint32_t value) {
+  if (reg == REG_HI)
+    pipe.HI = value;
+  else if (reg == REG_LO)
+    pipe.LO = value;
+  else if (reg >= 0 && reg < 32)
+    pipe.REGS[reg] = value;
+  else
+    return;
+
+  if (check_enabled) check_sync();
 }
 
 /***************************************************************/
@@ -379,18 +941,343 @@ void initialize(char *program_filename, int num_prog_files) {
 /* Procedure : main                                            */
 /*                                                             */
 /***************************************************************/
+static void usage(char *prog) {
+  printf("Error: usage: %s [options] <program_file_1> <program_file_2> ...\n", prog);
+  printf("       %s --server [options] [<program_file_1> ...]\n", prog);
+  printf("       %s --diff <dump_a> <dump_b>\n", prog);
+  printf("       %s --lockstep [--max-insts n] <program_1> <program_2> ...\n", prog);
+  printf("  a program file is hex words, one per line, or MIPS assembly if it ends in .s\n");
+  printf("  --go               run to completion without the command prompt\n");
+  printf("  --max-cycles n     stop after n cycles\n");
+  printf("  --max-insts n      stop after n retired instructions\n");
+  printf("  --stats-json file  with --go, write final state and statistics as JSON\n");
+  printf("  --quiet            no banners; with --go, no register dump either\n");
+  printf("  --core inorder|ooo timing model (default inorder)\n");
+  printf("  --width n          ooo: fetch/dispatch/issue/commit width (default %d)\n", ooo_cfg.width);
+  printf("  --rob n            ooo: reorder buffer entries (default %d)\n", ooo_cfg.rob_size);
+  printf("  --iq n             ooo: issue queue entries (default %d)\n", ooo_cfg.iq_size);
+  printf("  --lsq n            ooo: load/store queue entries (default %d)\n", ooo_cfg.lsq_size);
+  printf("  --memory flat|dram miss timing: flat %d cycles (default) or the DRAM model\n", MISS_PENALTY);
+  printf("  --dram-channels n  dram: channels, lines interleaved across them (default %d)\n", dram_cfg.channels);
+  printf("  --dram-banks n     dram: banks per channel (default %d)\n", dram_cfg.banks);
+  printf("  --dram-page open|closed\n");
+  printf("                     dram: row buffer policy (default %s)\n", dram_cfg.open_page ? "open" : "closed");
+  printf("  --dcache-write back|through\n");
+  printf("                     dcache: write policy (default back)\n");
+  printf("  --dcache-alloc on|off\n");
+  printf("                     dcache: fill the block on a store miss (default on)\n");
+  printf("  --victim n         dcache: n-entry fully associative victim cache (default none)\n");
+  printf("  --mul-latency n    multiply latency in cycles (default %d)\n", muldiv_cfg.mul_latency);
+  printf("  --mul-interval n   cycles between back-to-back multiplies, 1 = pipelined,\n");
+  printf("                     the latency = unpipelined (default %d)\n", muldiv_cfg.mul_interval);
+  printf("  --div-latency n    divide latency in cycles; the most with --div-early (default %d)\n",
+         muldiv_cfg.div_latency);
+  printf("  --div-early        divides end early when the quotient has fewer significant bits\n");
+  printf("  --tlb              model I-TLB/D-TLB misses and page walks through the dcache\n");
+  printf("  --itlb n[:ways]    tlb: I-TLB entries and associativity (default %d:%d)\n",
+         tlb_cfg.itlb_entries, tlb_cfg.itlb_ways);
+  printf("  --dtlb n[:ways]    tlb: D-TLB entries and associativity (default %d:%d)\n",
+         tlb_cfg.dtlb_entries, tlb_cfg.dtlb_ways);
+  printf("  --large-pages      tlb: 4 MB pages, one-level walks (default 4 KB, two levels)\n");
+  printf("  --trace file       write a binary per-instruction pipeline trace of core 0\n");
+  printf("                     (gzip-compressed if file ends in .gz); see ptrace2kanata.py\n");
+  printf("  --trace-cycles a:b trace: only instructions fetched in cycles a..b\n");
+  printf("  --trace-pc a:b     trace: only instructions at PCs a..b\n");
+  printf("  --cores n          simulate n cores sharing memory (default 1, at most %d);\n", MAX_CORES);
+  printf("                     shared memory is accessed in cycle order, so runs repeat\n");
+  printf("  --quantum n        cycles the cores run between synchronizations; host speed\n");
+  printf("                     only, the results do not change (default %u)\n", core_quantum);
+  printf("  --intervals k      with --go, simulate k-instruction intervals in parallel\n");
+  printf("                     from checkpoints of a functional run\n");
+  printf("  --warmup n         instructions simulated before each interval (default %" PRIu64 ")\n", interval_warmup);
+  printf("  --threads n        threads for --intervals (default: one per host CPU)\n");
+  printf("  --interval-check   also simulate the whole program and report the error\n");
+  printf("  --simpoints k      with --intervals, cluster the intervals' basic-block vectors\n");
+  printf("                     and simulate only k representatives, weighted\n");
+  printf("  --bbv file         with --simpoints, write the basic-block vectors\n");
+  printf("  --simpoints-out f  with --simpoints, write the chosen intervals and weights\n");
+  printf("  --no-idle-skip     step every cycle, even while the pipeline waits on a\n");
+  printf("                     multiply/divide, or with --core ooo on a miss (same\n");
+  printf("                     statistics, slower)\n");
+  printf("  --check            run a functional model in lockstep and stop at the first\n");
+  printf("                     instruction whose result differs\n");
+  printf("  --text-size n      text segment size in bytes, k/M/G suffixes allowed (default 1M)\n");
+  printf("  --data-size n      data segment size (default 1M)\n");
+  printf("  --stack-size n     stack segment size, below 0x%08x (default 1M)\n",
+         (uint32_t)MEM_STACK_START + MEM_STACK_SIZE);
+  printf("  --set-stats file   with --go, count cache accesses, misses and evictions per\n");
+  printf("                     set, sort misses into compulsory/capacity/conflict, and\n");
+  printf("                     write per-set heatmaps and counters to file\n");
+  printf("  --export file      with --go, write a binary dump of the final state; compare\n");
+  printf("                     two with %s --diff a b (exit 0 if registers and memory\n", prog);
+  printf("                     match, 1 if not; cache contents are only reported)\n");
+  printf("  --export-range a:b --export: bytes a..b; repeatable (default: data segment)\n");
+  printf("  --lockstep         run each program file as its own program, without timing,\n");
+  printf("                     %d side by side; print each one's final registers\n", LOCKSTEP_LANES);
+  printf("  --server           stay resident and serve load/go/rdump/dump requests on\n");
+  printf("                     stdin, one framed reply each on stdout (see src/server.h)\n");
+  printf("Exit status with --go: 0 halted, 2 stopped at a limit, 3 --check mismatch\n");
+  exit(1);
+}
+
 int main(int argc, char *argv[]) {                              
+  static struct option options[] = {
+    { "go",         no_argument,       NULL, 'g' },
+    { "max-cycles", required_argument, NULL, 'c' },
+    { "max-insts",  required_argument, NULL, 'i' },
+    { "stats-json", required_argument, NULL, 'j' },
+    { "quiet",      no_argument,       NULL, 'q' },
+    { "core",       required_argument, NULL, 'm' },
+    { "width",      required_argument, NULL, 'w' },
+    { "rob",        required_argument, NULL, 'r' },
+    { "iq",         required_argument, NULL, 'Q' },
+    { "lsq",        required_argument, NULL, 'L' },
+    { "memory",     required_argument, NULL, 'y' },
+    { "dram-channels", required_argument, NULL, 'Y' },
+    { "dram-banks", required_argument, NULL, 'B' },
+    { "dram-page",  required_argument, NULL, 'P' },
+    { "dcache-write", required_argument, NULL, 'a' },
+    { "dcache-alloc", required_argument, NULL, 'l' },
+    { "victim",     required_argument, NULL, 'V' },
+    { "mul-latency", required_argument, NULL, 'M' },
+    { "mul-interval", required_argument, NULL, 'I' },
+    { "div-latency", required_argument, NULL, 'd' },
+    { "div-early",  no_argument,       NULL, 'e' },
+    { "tlb",        no_argument,       NULL, 'v' },
+    { "itlb",       required_argument, NULL, 'U' },
+    { "dtlb",       required_argument, NULL, 'E' },
+    { "large-pages", no_argument,      NULL, 'G' },
+    { "trace",      required_argument, NULL, 'R' },
+    { "trace-cycles", required_argument, NULL, 'C' },
+    { "trace-pc",   required_argument, NULL, 'p' },
+    { "cores",      required_argument, NULL, 'n' },
+    { "quantum",    required_argument, NULL, 'u' },
+    { "intervals",  required_argument, NULL, 'k' },
+    { "warmup",     required_argument, NULL, 'W' },
+    { "threads",    required_argument, NULL, 't' },
+    { "interval-check", no_argument,   NULL, 'K' },
+    { "simpoints",  required_argument, NULL, 's' },
+    { "bbv",        required_argument, NULL, 'b' },
+    { "simpoints-out", required_argument, NULL, 'o' },
+    { "check",      no_argument,       NULL, 'x' },
+    { "no-idle-skip", no_argument,     NULL, 'N' },
+    { "text-size",  required_argument, NULL, 'T' },
+    { "data-size",  required_argument, NULL, 'D' },
+    { "stack-size", required_argument, NULL, 'S' },
+    { "set-stats",  required_argument, NULL, 'H' },
+    { "export",     required_argument, NULL, 'X' },
+    { "export-range", required_argument, NULL, 'A' },
+    { "diff",       no_argument,       NULL, 'F' },
+    { "lockstep",   no_argument,       NULL, 'O' },
+    { "server",     no_argument,       NULL, 'z' },
+    { NULL, 0, NULL, 0 }
+  };
+  int batch = FALSE, interval_check = FALSE, server = FALSE, opt;
+  int diff = FALSE, lockstep = FALSE;
+  char *json_file = NULL, *trace_file = NULL, *export_file = NULL, *set_stats_file = NULL;
+  uint64_t pc_lo = 0, pc_hi = UINT32_MAX, lo, hi;
+  dump_range export_ranges[DUMP_MAX_RANGES];
+  int export_nranges = 0;
+
+  while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+    switch (opt) {
+    case 'g': batch = TRUE; break;
+    case 'c': MAX_CYCLES = strtoull(optarg, NULL, 0); break;
+    case 'i': MAX_INSTS = strtoull(optarg, NULL, 0); break;
+    case 'j': json_file = optarg; break;
+    case 'q': QUIET = TRUE; break;
+    case 'm':
+      if (strcmp(optarg, "inorder") == 0) pipe_model = CORE_INORDER;
+      else if (strcmp(optarg, "ooo") == 0) pipe_model = CORE_OOO;
+      else usage(argv[0]);
+      break;
+    case 'w': ooo_cfg.width = atoi(optarg); break;
+    case 'r': ooo_cfg.rob_size = atoi(optarg); break;
+    case 'Q': ooo_cfg.iq_size = atoi(optarg); break;
+    case 'L': ooo_cfg.lsq_size = atoi(optarg); break;
+    case 'y':
+      if (strcmp(optarg, "flat") == 0) dram_cfg.enabled = false;
+      else if (strcmp(optarg, "dram") == 0) dram_cfg.enabled = true;
+      else usage(argv[0]);
+      break;
+    case 'Y': dram_cfg.channels = atoi(optarg); break;
+    case 'B': dram_cfg.banks = atoi(optarg); break;
+    case 'P':
+      if (strcmp(optarg, "open") == 0) dram_cfg.open_page = true;
+      else if (strcmp(optarg, "closed") == 0) dram_cfg.open_page = false;
+      else usage(argv[0]);
+      break;
+    case 'a':
+      if (strcmp(optarg, "back") == 0) dcache_cfg.write_through = false;
+      else if (strcmp(optarg, "through") == 0) dcache_cfg.write_through = true;
+      else usage(argv[0]);
+      break;
+    case 'l':
+      if (strcmp(optarg, "on") == 0) dcache_cfg.write_allocate = true;
+      else if (strcmp(optarg, "off") == 0) dcache_cfg.write_allocate = false;
+      else usage(argv[0]);
+      break;
+    case 'V': dcache_cfg.victim_entries = atoi(optarg); break;
+    case 'M': muldiv_cfg.mul_latency = atoi(optarg); break;
+    case 'I': muldiv_cfg.mul_interval = atoi(optarg); break;
+    case 'd': muldiv_cfg.div_latency = atoi(optarg); break;
+    case 'e': muldiv_cfg.div_early = true; break;
+    case 'v': tlb_cfg.enabled = true; break;
+    case 'U':
+      if (!set_tlb_size(optarg, &tlb_cfg.itlb_entries, &tlb_cfg.itlb_ways)) usage(argv[0]);
+      break;
+    case 'E':
+      if (!set_tlb_size(optarg, &tlb_cfg.dtlb_entries, &tlb_cfg.dtlb_ways)) usage(argv[0]);
+      break;
+    case 'G': tlb_cfg.large_pages = tlb_cfg.enabled = true; break;
+    case 'R': trace_file = optarg; break;
+    case 'C':
+      if (!parse_range(optarg, &ptrace_win.cycle_lo, &ptrace_win.cycle_hi)) usage(argv[0]);
+      break;
+    case 'p':
+      if (!parse_range(optarg, &pc_lo, &pc_hi) || pc_hi > UINT32_MAX) usage(argv[0]);
+      ptrace_win.pc_lo = pc_lo;
+      ptrace_win.pc_hi = pc_hi;
+      break;
+    case 'n': ncores = atoi(optarg); break;
+    case 'u': core_quantum = strtoul(optarg, NULL, 0); break;
+    case 'k': interval_length = strtoull(optarg, NULL, 0); break;
+    case 'W': interval_warmup = strtoull(optarg, NULL, 0); break;
+    case 't': interval_threads = atoi(optarg); break;
+    case 'K': interval_check = TRUE; break;
+    case 's': simpoint_k = atoi(optarg); break;
+    case 'b': simpoint_bbv_file = optarg; break;
+    case 'o': simpoint_out_file = optarg; break;
+    case 'x': check_enabled = true; break;
+    case 'N': IDLE_SKIP = FALSE; break;
+    case 'T': if (!set_region_size(MEM_TEXT, optarg)) usage(argv[0]); break;
+    case 'D': if (!set_region_size(MEM_DATA, optarg)) usage(argv[0]); break;
+    case 'S': if (!set_region_size(MEM_STACK, optarg)) usage(argv[0]); break;
+    case 'H':
+      set_stats_file = optarg;
+      setprof_enabled = true;
+      break;
+    case 'X': export_file = optarg; break;
+    case 'A':
+      lo = 0, hi = UINT32_MAX;
+      if (!parse_range(optarg, &lo, &hi) || hi > UINT32_MAX || export_nranges == DUMP_MAX_RANGES)
+        usage(argv[0]);
+      export_ranges[export_nranges].low = lo;
+      export_ranges[export_nranges].high = hi;
+      export_nranges++;
+      break;
+    case 'F': diff = TRUE; break;
+    case 'O': lockstep = TRUE; break;
+    case 'z': server = TRUE; break;
+    default: usage(argv[0]);
+    }
+  }
+
+  /* comparing two dumps needs no simulation */
+  if (diff) {
+    if (argc - optind != 2)
+      usage(argv[0]);
+    int n = dump_diff(argv[optind], argv[optind + 1], stdout);
+    return n < 0 ? 2 : n > 0;
+  }
 
   /* Error Checking */
-  if (argc < 2) {
-    printf("Error: usage: %s <program_file_1> <program_file_2> ...\n",
-           argv[0]);
-    exit(1);
+  if (optind >= argc && !server)
+    usage(argv[0]);
+  if (ooo_cfg.width < 1 || ooo_cfg.rob_size < 1 || ooo_cfg.iq_size < 1 || ooo_cfg.lsq_size < 1)
+    usage(argv[0]);
+  if (ncores < 1 || ncores > MAX_CORES || core_quantum < 1)
+    usage(argv[0]);
+  if (dram_cfg.channels < 1 || dram_cfg.banks < 1)
+    usage(argv[0]);
+  if (dcache_cfg.victim_entries > 1024)
+    usage(argv[0]);
+  if (muldiv_cfg.mul_latency < 1 || muldiv_cfg.mul_interval < 1 ||
+      muldiv_cfg.mul_interval > muldiv_cfg.mul_latency || muldiv_cfg.div_latency < DIV_EARLY_MIN)
+    usage(argv[0]);
+  /* the victim cache and write-around are not snooped */
+  if (ncores > 1 && (dcache_cfg.victim_entries || !dcache_cfg.write_allocate))
+    usage(argv[0]);
+  if (interval_length && (!batch || ncores > 1))
+    usage(argv[0]);
+  if (simpoint_k < 0 || (simpoint_k && !interval_length))
+    usage(argv[0]);
+  if (check_enabled && (ncores > 1 || interval_length))
+    usage(argv[0]);
+  if (trace_file && interval_length)
+    usage(argv[0]);
+  /* the server starts core 0 over for every program, on this thread */
+  if (server && (batch || ncores > 1 || interval_length || trace_file))
+    usage(argv[0]);
+  if ((export_file || export_nranges) && (!batch || interval_length || !export_file))
+    usage(argv[0]);
+  /* interval workers build their own caches */
+  if (set_stats_file && (!batch || interval_length))
+    usage(argv[0]);
+  /* lockstep runs are functional and single-threaded */
+  if (lockstep && (batch || server || ncores > 1 || interval_length || trace_file || check_enabled ||
+                   json_file || export_file || set_stats_file))
+    usage(argv[0]);
+  if (lockstep)
+    return lockstep_run(argv + optind, argc - optind);
+  if (server)
+    QUIET = TRUE;
+  if (export_file && export_nranges == 0) {
+    export_ranges[0].low = MEM_REGIONS[MEM_DATA].start;
+    export_ranges[0].high = MEM_REGIONS[MEM_DATA].start + MEM_REGIONS[MEM_DATA].size - 1;
+    export_nranges = 1;
   }
 
-  printf("MIPS Simulator\n\n");
+  HOSTPROF_START();
 
-  initialize(argv[1], argc - 1);
+  /* batch runs write a lot less often than they compute */
+  if (batch)
+    setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+
+  if (!QUIET) printf("MIPS Simulator\n\n");
+
+  initialize(argv + optind, argc - optind);
+  if (check_enabled)
+    check_init();
+  if (trace_file) {
+    if (!ptrace_open(trace_file)) {
+      fprintf(stderr, "Error: Can't write trace %s\n", trace_file);
+      exit(1);
+    }
+    atexit(ptrace_close);
+  }
+
+  if (server) {
+    server_run(optind < argc ? argv[optind] : NULL);
+    return 0;
+  }
+
+  if (batch) {
+    if (interval_length)
+      interval_run(interval_check);
+    else
+      go();
+    if (!QUIET) rdump();
+
+    if (export_file && !dump_export(export_file, export_ranges, export_nranges))
+      exit(1);
+    if (set_stats_file)
+      write_set_stats(set_stats_file);
+
+    if (json_file) {
+      FILE *out = fopen(json_file, "w");
+      if (out == NULL) {
+        fprintf(stderr, "Error: Can't open %s\n", json_file);
+        exit(1);
+      }
+      stats_json(out, argv[optind]);
+      fclose(out);
+    }
+
+    if (check_failed)
+      return 3;
+    return core_running() ? 2 : 0;
+  }
 
   while (1)
     get_command();
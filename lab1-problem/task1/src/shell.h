@@ -15,17 +15,90 @@
 #define _SIM_SHELL_H_
 
 #include <stdint.h>
+#include <stdio.h>
 
 #define FALSE 0
 #define TRUE  1
 
-extern int RUN_BIT;	/* run bit */
+/* state owned by one simulated core: each core runs on its own host thread
+ * (see core.h), so these variables exist once per core */
+#define CORE_LOCAL __thread
+
+extern CORE_LOCAL int RUN_BIT;	/* run bit */
+
+/* memory layout: default sizes; --text-size, --data-size and --stack-size
+ * change them at startup (the stack keeps its top and grows down) */
+#define MEM_DATA_START  0x10000000
+#define MEM_DATA_SIZE   0x00100000
+#define MEM_TEXT_START  0x00400000
+#define MEM_TEXT_SIZE   0x00100000
+#define MEM_STACK_START 0x7ff00000
+#define MEM_STACK_SIZE  0x00100000
+#define MEM_KDATA_START 0x90000000
+#define MEM_KDATA_SIZE  0x00100000
+#define MEM_KTEXT_START 0x80000000
+#define MEM_KTEXT_SIZE  0x00100000
+
+typedef struct {
+    uint32_t start, size;
+    uint8_t *mem;
+} mem_region_t;
+
+#define MEM_NREGIONS 5
+
+/* indices into MEM_REGIONS */
+#define MEM_TEXT  0
+#define MEM_DATA  1
+#define MEM_STACK 2
+#define MEM_KDATA 3
+#define MEM_KTEXT 4
+
+extern mem_region_t MEM_REGIONS[MEM_NREGIONS];
+extern CORE_LOCAL mem_region_t *mem_regions;
+
+/* demand-zero backing for a region: pages are allocated on first write */
+uint8_t *mem_alloc(uint32_t size);
+void     mem_free(uint8_t *mem, uint32_t size);
+
+/* used[p] = whether page p (of 1 << MEM_PAGE_BITS bytes) of a region
+ * from mem_alloc() holds anything but zeros */
+#define MEM_PAGE_BITS 12
+void     mem_used_pages(const uint8_t *mem, uint32_t size, uint8_t *used);
 
 /* only the cache touches these functions */
 uint32_t mem_read_32(uint32_t address);
 void     mem_write_32(uint32_t address, uint32_t value);
 
 /* statistics */
-extern uint32_t stat_cycles, stat_inst_retire, stat_inst_fetch, stat_squash;
+extern CORE_LOCAL uint64_t stat_cycles, stat_inst_retire, stat_inst_fetch, stat_squash;
+
+/* batch-mode settings */
+extern int QUIET, IDLE_SKIP;
+extern uint64_t MAX_CYCLES, MAX_INSTS;
+
+/* advance the calling core by one cycle */
+void cycle();
+
+/* the same, then skip the idle cycles that follow (see pipe_skip), up to
+ * cycle 'limit' */
+void cycle_skip(uint64_t limit);
+
+/* shell commands, also run by the request server (server.h) */
+void go();
+void rdump_to(FILE *out);
+void stats_json(FILE *out, const char *program);
+
+/* start over with new programs in this process: fresh memory, core and
+ * statistics; FALSE (and nothing changed) if a file can't be read */
+int reload(char **program_filenames, int num_prog_files);
+
+/* read a program file into memory at the text segment (of the memory
+ * image mem_regions points to) */
+void load_program(char *program_filename);
+
+/* set a register the way the shell's input/high/low commands do */
+#define REG_HI 32
+#define REG_LO 33
+void set_register(int reg, uint32_t value);
 
 #endif
@@ -0,0 +1,273 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include "simpoint.h"
+#include "shell.h"
+#include "pipe.h"
+
+int simpoint_k = 0;
+const char* simpoint_bbv_file = NULL;
+const char* simpoint_out_file = NULL;
+
+#define BB_ENTRIES (MEM_REGIONS[MEM_TEXT].size / 4)
+#define BBV_DIMS 15             // BBVs are randomly projected down to this
+#define KMEANS_ITERS 100
+
+typedef struct{
+    uint32_t id;
+    uint32_t count;             // instructions executed in the block
+} bbv_entry;
+
+typedef struct{
+    bbv_entry* bb;
+    int n;
+    uint64_t insts;
+} bbv_t;
+
+static int32_t* bb_id;          // block id by leader (pc - MEM_TEXT_START)/4, or -1
+static int nbb;
+static uint32_t* counts;        // current interval, by block id
+static int* touched;            // ids with a nonzero count
+static int ntouched;
+
+static bbv_t* bbvs;
+static int nbbvs;
+static uint64_t insts;
+
+static uint32_t block_start, block_len;
+
+void bbv_start(){
+    bbv_free();
+    bb_id = malloc(BB_ENTRIES * sizeof(int32_t));
+    memset(bb_id, 0xFF, BB_ENTRIES * sizeof(int32_t));
+    counts = calloc(BB_ENTRIES, sizeof(uint32_t));
+    touched = malloc(BB_ENTRIES * sizeof(int));
+}
+
+void bbv_free(){
+    for(int i=0; i<nbbvs; i++)
+        free(bbvs[i].bb);
+    free(bbvs);
+    free(bb_id);
+    free(counts);
+    free(touched);
+    bbvs = NULL;
+    bb_id = NULL;
+    counts = NULL;
+    touched = NULL;
+    nbbvs = nbb = ntouched = 0;
+    insts = 0;
+    block_len = 0;
+}
+
+static void end_block(){
+    uint32_t i = (block_start - MEM_TEXT_START) >> 2;
+    if(block_len == 0 || i >= BB_ENTRIES){
+        block_len = 0;
+        return;
+    }
+
+    if(bb_id[i] < 0)
+        bb_id[i] = nbb++;
+    int id = bb_id[i];
+    if(counts[id] == 0)
+        touched[ntouched++] = id;
+    counts[id] += block_len;
+    block_len = 0;
+}
+
+void bbv_step(Pipe_Op* op){
+    if(block_len == 0)
+        block_start = op->pc;
+    block_len++;
+    insts++;
+
+    // A block ends at every branch or jump, taken or not
+    if(op->is_branch)
+        end_block();
+}
+
+// A block running across the boundary is split between the intervals
+void bbv_end_interval(){
+    end_block();
+    if(insts == 0)
+        return;
+
+    bbvs = realloc(bbvs, (nbbvs + 1) * sizeof(bbv_t));
+    bbv_t* v = &bbvs[nbbvs++];
+    v->bb = malloc(ntouched * sizeof(bbv_entry));
+    v->n = ntouched;
+    v->insts = insts;
+    for(int k=0; k<ntouched; k++){
+        v->bb[k].id = touched[k];
+        v->bb[k].count = counts[touched[k]];
+        counts[touched[k]] = 0;
+    }
+    ntouched = 0;
+    insts = 0;
+}
+
+// Fixed pseudo-random projection weight in [-1, 1] for a block and dimension
+static double projection(uint32_t id, int d){
+    uint64_t x = (uint64_t)id * BBV_DIMS + d + 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return (double)(x >> 11) / (double)(1ULL << 52) - 1.0;
+}
+
+static double distance(const double* a, const double* b){
+    double sum = 0;
+    for(int d=0; d<BBV_DIMS; d++)
+        sum += (a[d] - b[d]) * (a[d] - b[d]);
+    return sum;
+}
+
+static void write_bbvs(const char* filename){
+    FILE* out = fopen(filename, "w");
+    if(out == NULL){
+        printf("Error: Can't open BBV file %s\n", filename);
+        return;
+    }
+    for(int i=0; i<nbbvs; i++){
+        fprintf(out, "T");
+        for(int k=0; k<bbvs[i].n; k++)
+            fprintf(out, ":%u:%u ", bbvs[i].bb[k].id + 1, bbvs[i].bb[k].count);
+        fprintf(out, "\n");
+    }
+    fclose(out);
+}
+
+static int by_rep(const void* a, const void* b){
+    return ((const int*)a)[0] - ((const int*)b)[0];
+}
+
+int simpoint_pick(int* rep, double* weight){
+    int n = nbbvs;
+    int k = simpoint_k < n ? simpoint_k : n;
+
+    if(simpoint_bbv_file)
+        write_bbvs(simpoint_bbv_file);
+
+    // Normalized BBVs, projected
+    double (*point)[BBV_DIMS] = calloc(n, sizeof(*point));
+    uint64_t total = 0;
+    for(int i=0; i<n; i++){
+        total += bbvs[i].insts;
+        for(int e=0; e<bbvs[i].n; e++){
+            double f = (double)bbvs[i].bb[e].count / bbvs[i].insts;
+            for(int d=0; d<BBV_DIMS; d++)
+                point[i][d] += f * projection(bbvs[i].bb[e].id, d);
+        }
+    }
+
+    // k-means++ seeding, with a fixed seed so runs are repeatable
+    double (*center)[BBV_DIMS] = calloc(k, sizeof(*center));
+    double* dist = malloc(n * sizeof(double));
+    int* cluster = calloc(n, sizeof(int));
+    uint64_t seed = 88172645463325252ULL;
+
+    memcpy(center[0], point[0], sizeof(point[0]));
+    for(int c=1; c<k; c++){
+        double sum = 0;
+        for(int i=0; i<n; i++){
+            dist[i] = DBL_MAX;
+            for(int j=0; j<c; j++){
+                double dd = distance(point[i], center[j]);
+                if(dd < dist[i]) dist[i] = dd;
+            }
+            sum += dist[i];
+        }
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        double r = (double)(seed >> 11) / (double)(1ULL << 53) * sum;
+        int pick = n - 1;
+        for(int i=0; i<n; i++){
+            r -= dist[i];
+            if(r < 0){
+                pick = i;
+                break;
+            }
+        }
+        memcpy(center[c], point[pick], sizeof(point[0]));
+    }
+
+    // Lloyd iterations
+    for(int iter=0; iter<KMEANS_ITERS; iter++){
+        bool changed = iter == 0;
+        for(int i=0; i<n; i++){
+            int best = 0;
+            for(int c=1; c<k; c++)
+                if(distance(point[i], center[c]) < distance(point[i], center[best]))
+                    best = c;
+            if(best != cluster[i]){
+                cluster[i] = best;
+                changed = true;
+            }
+        }
+        if(!changed)
+            break;
+
+        for(int c=0; c<k; c++){
+            int members = 0;
+            double mean[BBV_DIMS] = { 0 };
+            for(int i=0; i<n; i++){
+                if(cluster[i] != c) continue;
+                members++;
+                for(int d=0; d<BBV_DIMS; d++)
+                    mean[d] += point[i][d];
+            }
+            if(members == 0) continue;
+            for(int d=0; d<BBV_DIMS; d++)
+                center[c][d] = mean[d] / members;
+        }
+    }
+
+    // The interval closest to each centroid stands for its cluster
+    int (*pick)[2] = malloc(k * sizeof(*pick));     // representative, cluster
+    double* share = calloc(k, sizeof(double));
+    int npick = 0;
+    for(int c=0; c<k; c++){
+        int best = -1;
+        for(int i=0; i<n; i++){
+            if(cluster[i] != c) continue;
+            share[c] += (double)bbvs[i].insts / total;
+            if(best < 0 || distance(point[i], center[c]) < distance(point[best], center[c]))
+                best = i;
+        }
+        if(best >= 0){
+            pick[npick][0] = best;
+            pick[npick][1] = c;
+            npick++;
+        }
+    }
+
+    // In program order, which is how the checkpoints are replayed
+    qsort(pick, npick, sizeof(*pick), by_rep);
+    for(int p=0; p<npick; p++){
+        rep[p] = pick[p][0];
+        weight[p] = share[pick[p][1]];
+    }
+
+    if(simpoint_out_file){
+        FILE* out = fopen(simpoint_out_file, "w");
+        if(out == NULL)
+            printf("Error: Can't open SimPoint file %s\n", simpoint_out_file);
+        else{
+            fprintf(out, "# interval weight\n");
+            for(int p=0; p<npick; p++)
+                fprintf(out, "%d %.6f\n", rep[p], weight[p]);
+            fclose(out);
+        }
+    }
+
+    free(point);
+    free(center);
+    free(dist);
+    free(cluster);
+    free(pick);
+    free(share);
+    return npick;
+}
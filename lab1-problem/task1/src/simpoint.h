@@ -0,0 +1,30 @@
+/************************************/
+/*                                  */
+/*      SimPoint Sampling           */
+/*                                  */
+/************************************/
+
+#ifndef _SIMPOINT_H
+#define _SIMPOINT_H
+
+#include <stdint.h>
+#include "pipe.h"
+
+// Basic-block vectors (BBVs) are collected per interval during the
+// functional pass of interval simulation, then clustered with k-means so
+// that only one representative interval per cluster is simulated in detail.
+extern int simpoint_k;                  // clusters; 0: simulate every interval
+extern const char* simpoint_bbv_file;   // BBVs in SimPoint's text format
+extern const char* simpoint_out_file;   // chosen intervals and weights
+
+void bbv_start();
+void bbv_step(Pipe_Op* op);             // after every functional instruction
+void bbv_end_interval();                // at every interval boundary and the end
+void bbv_free();
+
+// Cluster the intervals. Fills rep[c] with the representative interval of
+// cluster c and weight[c] with the share of instructions it stands for;
+// returns the number of clusters.
+int simpoint_pick(int* rep, double* weight);
+
+#endif
@@ -0,0 +1,96 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stats.h"
+#include "shell.h"
+
+CORE_LOCAL uint64_t cpi_stack[CPI_NCAUSES];
+
+const char* cpi_names[CPI_NCAUSES] = {
+    "base", "icache", "dcache", "tlb", "load_use", "muldiv", "branch", "empty"
+};
+
+// Interval export state (per core: only the core that opened a file writes)
+CORE_LOCAL uint64_t cpi_next = UINT64_MAX;
+static CORE_LOCAL uint32_t cpi_interval = 0;
+static CORE_LOCAL FILE* cpi_file = NULL;
+static CORE_LOCAL uint64_t cpi_last[CPI_NCAUSES];
+static CORE_LOCAL uint64_t cpi_last_retire = 0;
+
+void cpi_reset(){
+    memset(cpi_stack, 0, sizeof(cpi_stack));
+}
+
+void cpi_print(FILE* out){
+    uint64_t total = 0;
+    for(int i=0; i<CPI_NCAUSES; i++)
+        total += cpi_stack[i];
+
+    fprintf(out, "CPI stack (cycles, CPI, share):\n");
+    for(int i=0; i<CPI_NCAUSES; i++){
+        fprintf(out, "  %-10s %12lu %8.3f %6.1f%%\n", cpi_names[i],
+                (unsigned long)cpi_stack[i],
+                stat_inst_retire ? (double)cpi_stack[i] / stat_inst_retire : 0.0,
+                total ? 100.0 * cpi_stack[i] / total : 0.0);
+    }
+}
+
+void cpi_print_json(FILE* out){
+    fprintf(out, "{");
+    for(int i=0; i<CPI_NCAUSES; i++)
+        fprintf(out, "%s\"%s\": %lu", i ? ", " : "", cpi_names[i], (unsigned long)cpi_stack[i]);
+    fprintf(out, "}");
+}
+
+void cpi_interval_open(uint32_t interval, const char* filename){
+    cpi_interval_close();
+    if(interval == 0)
+        return;
+
+    cpi_file = fopen(filename, "w");
+    if(cpi_file == NULL){
+        printf("Error: Can't open CPI interval file %s\n", filename);
+        return;
+    }
+
+    fprintf(cpi_file, "cycle,retired");
+    for(int i=0; i<CPI_NCAUSES; i++)
+        fprintf(cpi_file, ",%s", cpi_names[i]);
+    fprintf(cpi_file, "\n");
+
+    // Intervals start from the current point of the run
+    cpi_interval = interval;
+    memcpy(cpi_last, cpi_stack, sizeof(cpi_stack));
+    cpi_last_retire = stat_inst_retire;
+    cpi_next = stat_cycles + interval;
+}
+
+// Emit the deltas since the previous row. Called when stat_cycles crosses
+// cpi_next and once more when the program halts.
+void cpi_interval_dump(){
+    if(cpi_file == NULL)
+        return;
+
+    fprintf(cpi_file, "%lu,%lu", (unsigned long)stat_cycles,
+            (unsigned long)(stat_inst_retire - cpi_last_retire));
+    for(int i=0; i<CPI_NCAUSES; i++)
+        fprintf(cpi_file, ",%lu", (unsigned long)(cpi_stack[i] - cpi_last[i]));
+    fprintf(cpi_file, "\n");
+
+    memcpy(cpi_last, cpi_stack, sizeof(cpi_stack));
+    cpi_last_retire = stat_inst_retire;
+
+    // A miss penalty can jump several intervals at once
+    while(cpi_next <= stat_cycles)
+        cpi_next += cpi_interval;
+}
+
+void cpi_interval_close(){
+    if(cpi_file){
+        fclose(cpi_file);
+        cpi_file = NULL;
+    }
+    cpi_interval = 0;
+    cpi_next = UINT64_MAX;
+}
@@ -0,0 +1,45 @@
+/************************************/
+/*                                  */
+/*      Cycle Accounting            */
+/*                                  */
+/************************************/
+
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "shell.h"
+
+// Every simulated cycle is charged to exactly one cause: the one that
+// kept an instruction from retiring in that cycle.
+enum{
+    CPI_BASE,       // an instruction retired
+    CPI_ICACHE,     // icache miss penalty
+    CPI_DCACHE,     // dcache miss penalty
+    CPI_TLB,        // TLB miss page walk
+    CPI_LOAD_USE,   // execute stalled on a load result still in mem
+    CPI_MULDIV,     // execute waited on multiplier_stall (MFHI/MFLO/MTHI/MTLO)
+    CPI_BRANCH,     // bubble left by a pipe_recover flush
+    CPI_EMPTY,      // nothing in flight (startup)
+    CPI_NCAUSES
+};
+
+extern CORE_LOCAL uint64_t cpi_stack[CPI_NCAUSES];
+extern const char* cpi_names[CPI_NCAUSES];
+
+// Charge 'n' cycles to 'cause'
+#define CPI_CHARGE(cause, n) (cpi_stack[(cause)] += (n))
+
+void cpi_reset();
+void cpi_print(FILE*);
+void cpi_print_json(FILE*);
+
+// Per-interval export: one CSV row of per-cause deltas every 'interval'
+// cycles. cpi_next is the cycle of the next row (UINT64_MAX when off).
+extern CORE_LOCAL uint64_t cpi_next;
+void cpi_interval_open(uint32_t interval, const char* filename);
+void cpi_interval_dump();
+void cpi_interval_close();
+
+#endif
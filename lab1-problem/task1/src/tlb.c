@@ -0,0 +1,101 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "tlb.h"
+#include "cache.h"
+#include "hostprof.h"
+
+tlb_config tlb_cfg = { false, 64, 4, 64, 4, false };
+CORE_LOCAL tlb_unit* itlb = NULL;
+CORE_LOCAL tlb_unit* dtlb = NULL;
+
+#define PTE_PER_TABLE 1024
+
+static tlb_unit* tlb_create(int entries, int ways){
+    tlb_unit* t = calloc(1, sizeof(tlb_unit));
+    t->entry = calloc(entries, sizeof(tlb_entry));
+    t->ways = ways;
+    t->sets = entries / ways;
+    return t;
+}
+
+static void tlb_free(tlb_unit* t){
+    if(t == NULL)
+        return;
+    free(t->entry);
+    free(t);
+}
+
+void tlb_init(){
+    // A thread that starts over (interval simulation) starts cold
+    tlb_free(itlb);
+    tlb_free(dtlb);
+    itlb = dtlb = NULL;
+    if(!tlb_cfg.enabled)
+        return;
+
+    itlb = tlb_create(tlb_cfg.itlb_entries, tlb_cfg.itlb_ways);
+    dtlb = tlb_create(tlb_cfg.dtlb_entries, tlb_cfg.dtlb_ways);
+}
+
+// Walk the page table for 'addr'; returns the cycles it took. The root
+// table is the first page of kernel data, the second-level tables follow
+// it (wrapping around the segment, so tables may share lines).
+static uint32_t walk(uint32_t addr){
+    uint32_t base = MEM_REGIONS[MEM_KDATA].start;
+    uint32_t tables = MEM_REGIONS[MEM_KDATA].size / (4 * PTE_PER_TABLE) - 1;
+    uint32_t dir = addr >> TLB_LARGE_PAGE_BITS;
+
+    cache_read(dcache, base + 4 * dir);
+    uint32_t cycles = TLB_WALK_LEVEL + dcache->penalty;
+
+    // A large page is mapped by the directory entry itself
+    if(!tlb_cfg.large_pages){
+        uint32_t table = base + 4 * PTE_PER_TABLE * (1 + dir % tables);
+        cache_read(dcache, table + 4 * ((addr >> TLB_PAGE_BITS) % PTE_PER_TABLE));
+        cycles += TLB_WALK_LEVEL + dcache->penalty;
+    }
+    return cycles;
+}
+
+void tlb_translate(tlb_unit* t, uint32_t addr){
+    uint32_t vpn = addr >> (tlb_cfg.large_pages ? TLB_LARGE_PAGE_BITS : TLB_PAGE_BITS);
+    tlb_entry* set = &t->entry[(vpn % t->sets) * t->ways];
+
+    HOSTPROF_ENTER(HP_TLB);
+    t->accesses++;
+    t->clock++;
+    t->penalty = 0;
+
+    tlb_entry* victim = &set[0];
+    for(int w=0; w<t->ways; w++){
+        if(set[w].valid && set[w].vpn == vpn){
+            set[w].last_use = t->clock;
+            HOSTPROF_LEAVE();
+            return;
+        }
+        if(!set[w].valid || (victim->valid && set[w].last_use < victim->last_use))
+            victim = &set[w];
+    }
+
+    t->misses++;
+    t->penalty = walk(addr);
+    t->walk_cycles += t->penalty;
+    *victim = (tlb_entry){ true, vpn, t->clock };
+    HOSTPROF_LEAVE();
+}
+
+static void print_unit(FILE* out, const char* name, tlb_unit* t){
+    fprintf(out, "  %s %d entries %d-way: %" PRIu64 " accesses, %.2f%% miss, %" PRIu64
+            " walk cycles\n", name, t->sets * t->ways, t->ways, t->accesses,
+            t->accesses ? 100.0 * t->misses / t->accesses : 0.0, t->walk_cycles);
+}
+
+void tlb_print_stats(FILE* out){
+    fprintf(out, "TLBs (%s pages, %d-level walk through the dcache):\n",
+            tlb_cfg.large_pages ? "4 MB" : "4 KB", tlb_cfg.large_pages ? 1 : 2);
+    print_unit(out, "itlb", itlb);
+    print_unit(out, "dtlb", dtlb);
+}
@@ -0,0 +1,57 @@
+/************************************/
+/*                                  */
+/*      TLBs and Page Walks         */
+/*                                  */
+/************************************/
+
+#ifndef _TLB_H
+#define _TLB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "shell.h"
+
+// With --tlb, every fetch and every load/store is translated by an
+// I-TLB or D-TLB first. Addresses map to themselves; only the timing is
+// modeled. A miss walks a two-level page table (one level with large
+// pages) that lives in the kernel data segment, reading each level's
+// entry through the dcache, so walks compete with the program for it.
+
+#define TLB_PAGE_BITS        12     // 4 KB pages
+#define TLB_LARGE_PAGE_BITS  22     // 4 MB pages (--large-pages)
+#define TLB_WALK_LEVEL       2      // cycles per level on top of the dcache access
+
+typedef struct{
+    bool enabled;
+    int itlb_entries, itlb_ways;
+    int dtlb_entries, dtlb_ways;
+    bool large_pages;
+} tlb_config;
+
+extern tlb_config tlb_cfg;
+
+typedef struct{
+    bool valid;
+    uint32_t vpn;
+    uint64_t last_use;      // LRU
+} tlb_entry;
+
+typedef struct{
+    tlb_entry* entry;       // [set * ways + way]
+    int sets, ways;
+    uint64_t clock;
+    uint32_t penalty;       // cycles owed by the last translation (0 on a hit)
+
+    // Statistics
+    uint64_t accesses, misses, walk_cycles;
+} tlb_unit;
+
+// NULL when the TLBs are off
+extern CORE_LOCAL tlb_unit *itlb, *dtlb;
+
+void tlb_init();                            // per core, from pipe_init()
+void tlb_translate(tlb_unit*, uint32_t addr);
+void tlb_print_stats(FILE*);
+
+#endif